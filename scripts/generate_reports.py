@@ -4,6 +4,7 @@ import os
 import io
 import re
 import sys
+import json
 import numpy
 import hashlib
 import pathlib
@@ -379,6 +380,11 @@ class benchmark_case:
     transfer_config: transfer_configuration
     transport: str
     total_time_ms: list[int] = field(default_factory=list)
+    latency_p99_us: list[int] = field(default_factory=list)
+    # one {"interval_ms": ..., "bytes": [...], "in_flight": [...]} per sampled trial
+    timelines: list[dict] = field(default_factory=list)
+    # the "estimate" record of the cell: mean bytes/s without outliers and its confidence interval
+    estimate: dict = field(default_factory=dict)
 
 
 @dataclass
@@ -389,6 +395,8 @@ class benchmark_suite:
     benchmark_cases: list[str] = field(default_factory=list)
     transfer_configs: list[transfer_configuration] = field(default_factory=list)
     cases: list[benchmark_case] = field(default_factory=list)
+    # the "sweep" records of a --sweep run
+    sweeps: list[dict] = field(default_factory=list)
     start_time: datetime.datetime = datetime.datetime.now()
     end_time: datetime.datetime = datetime.datetime.now()
     log_source: str = ""
@@ -435,7 +443,7 @@ def parse_log(content):
         elif m := re.fullmatch("benchmark cases: (.+)", log_message):
             suite.benchmark_cases = [i.strip() for i in m.group(1).split(",")]
         elif m := re.fullmatch(
-            "tr?ansfer config (\\d+): blob size: (\\d+) bytes, number of blobs: (\\d+), concurrency: (\\d+)",
+            "tr?ansfer config (\\d+): blob size: (\\d+) bytes, number of blobs: (\\d+), concurrency: (\\d+)(, .+)?",
             log_message,
         ):
             suite.transfer_configs.append(
@@ -478,6 +486,22 @@ def parse_log(content):
                     break
             else:
                 assert False
+        elif m := re.fullmatch(
+            "(.+) (.+) (\\d+)-byte blobs: .+ ops/s, .+ bytes/s, latency p50 (\\d+)us, p90 (\\d+)us, p99 (\\d+)us, p99.9 (\\d+)us, max (\\d+)us",
+            log_message,
+        ):
+            (transport, case_name, blob_size, latency_p99_us) = m.group(1, 2, 3, 6)
+            blob_size = int(blob_size)
+            # belongs to the trial reported on the previous line
+            for c in suite.cases:
+                if (
+                    transport == c.transport
+                    and case_name == c.case_name
+                    and blob_size == c.transfer_config.blob_size
+                    and len(c.latency_p99_us) < len(c.total_time_ms)
+                ):
+                    c.latency_p99_us.append(int(latency_p99_us))
+                    break
 
     assert len(suite.environment.OS) != 0
     assert len(suite.environment.compiler) != 0
@@ -486,11 +510,215 @@ def parse_log(content):
     assert len(suite.environment.azure_storage_common_version) != 0
     assert len(suite.environment.azure_storage_blobs_version) != 0
     assert len(suite.baseline_transport) != 0
+    # not every case runs with every transfer config, e.g. the chunked transfer sweep
+    suite.cases = [c for c in suite.cases if len(c.total_time_ms) != 0]
     for c in suite.cases:
         assert len(c.total_time_ms) == repeat_times
     return suite
 
 
+def parse_timestamp(timestamp):
+    # 2021-09-01T08:00:00.1234567Z, datetime only takes up to 6 fractional digits
+    m = re.fullmatch("(.+T[0-9:]+)(\\.[0-9]+)?Z", timestamp)
+    fraction = (m.group(2) or ".0")[:7]
+    return datetime.datetime.strptime(m.group(1) + fraction, "%Y-%m-%dT%H:%M:%S.%f")
+
+
+def parse_results(content):
+    """Parses the JSON Lines results written by perftest, returns one suite per run."""
+    suites = []
+    suite = None
+    for l in content.splitlines():
+        if not l.strip():
+            continue
+        record = json.loads(l)
+        if record["type"] == "suite":
+            suite = benchmark_suite()
+            suites.append(suite)
+            env = record["environment"]
+            suite.environment.OS = env["os"]
+            suite.environment.compiler = env["compiler"]
+            suite.environment.azure_core_version = env["azure_core_version"]
+            suite.environment.azure_storage_common_version = env[
+                "azure_storage_common_version"
+            ]
+            suite.environment.azure_storage_blobs_version = env[
+                "azure_storage_blobs_version"
+            ]
+            if env["mock_blob_endpoint"]:
+                suite.environment.storage_account = "mock blob endpoint"
+            else:
+                suite.environment.storage_account = get_storage_account_info(
+                    env["storage_account"]
+                )
+            if env["azure_vm"]:
+                suite.environment.azure_vm = get_azure_vm_info(env["azure_vm"])
+            suite.transports = record["transports"]
+            suite.baseline_transport = record["baseline_transport"]
+            suite.benchmark_cases = record["benchmark_cases"]
+            suite.transfer_configs = [
+                transfer_configuration(
+                    tc["blob_size"], tc["num_blobs"], tc["concurrency"]
+                )
+                for tc in record["transfer_configs"]
+            ]
+            suite.start_time = parse_timestamp(record["start_time"])
+        elif record["type"] == "trial":
+            tc = record["transfer_config"]
+            tc = transfer_configuration(
+                tc["blob_size"], tc["num_blobs"], tc["concurrency"]
+            )
+            for c in suite.cases:
+                if (
+                    record["transport"] == c.transport
+                    and record["case"] == c.case_name
+                    and tc == c.transfer_config
+                ):
+                    break
+            else:
+                c = benchmark_case(record["case"], tc, record["transport"])
+                suite.cases.append(c)
+            c.total_time_ms.append(record["total_time_ms"])
+            c.latency_p99_us.append(record["latency_us"]["p99"])
+            if "timeline" in record:
+                c.timelines.append(record["timeline"])
+        elif record["type"] == "estimate":
+            tc = record["transfer_config"]
+            tc = transfer_configuration(
+                tc["blob_size"], tc["num_blobs"], tc["concurrency"]
+            )
+            for c in suite.cases:
+                if (
+                    record["transport"] == c.transport
+                    and record["case"] == c.case_name
+                    and tc == c.transfer_config
+                ):
+                    c.estimate = record
+        elif record["type"] == "sweep":
+            suite.sweeps.append(record)
+        elif record["type"] == "end":
+            suite.end_time = parse_timestamp(record["end_time"])
+    return suites
+
+
+def timeline_svg(timelines, width=600, height=150):
+    """Throughput of every trial over time as a line, operations in flight dashed, each scaled
+    to its peak across trials."""
+    # the last sample is shorter than the interval
+    rates = [
+        [b * 1000 / t["interval_ms"] for b in t["bytes"][:-1]] for t in timelines
+    ]
+    in_flight = [t["in_flight"][:-1] for t in timelines]
+    num_samples = max([len(r) for r in rates] + [2])
+    peak_rate = max([max(r, default=0) for r in rates] + [1])
+    peak_in_flight = max([max(f, default=0) for f in in_flight] + [1])
+
+    def polyline(values, peak, style):
+        points = " ".join(
+            f"{i * width / (num_samples - 1):.1f},{height - v * height / peak:.1f}"
+            for i, v in enumerate(values)
+        )
+        return f'<polyline points="{points}" fill="none" {style}/>'
+
+    svg = f'<svg width="{width}" height="{height}" style="border: 1px solid #ccc">'
+    for f in in_flight:
+        svg += polyline(f, peak_in_flight, 'stroke="#999" stroke-dasharray="4 2"')
+    for r in rates:
+        svg += polyline(r, peak_rate, 'stroke="#1f77b4"')
+    svg += "</svg>"
+    return svg, peak_rate, peak_in_flight
+
+
+def generate_timeline_report(a, suite):
+    cases = [c for c in suite.cases if c.timelines]
+    if not cases:
+        return
+    with a.details():
+        a.summary(_t="throughput over time")
+        for c in cases:
+            tc = c.transfer_config
+            svg, peak_rate, peak_in_flight = timeline_svg(c.timelines)
+            interval_ms = c.timelines[0]["interval_ms"]
+            a.p(
+                _t=f"{c.transport} {c.case_name}, {size_format(tc.blob_size)} x "
+                f"{tc.num_blobs}, concurrency {tc.concurrency}: {len(c.timelines)} trials, "
+                f"{interval_ms}ms samples, peak {size_format(peak_rate)}/s (solid), "
+                f"peak {peak_in_flight} in flight (dashed)"
+            )
+            a(svg)
+
+
+def generate_sweep_report(a, suite):
+    if not suite.sweeps:
+        return
+    a.p(_t="concurrency sweeps, the knee is the concurrency to provision (bold)")
+    with a.table():
+        with a.thead().tr():
+            a.th(_t="")
+            a.th(_t="transport")
+            a.th(_t="blob size")
+            a.th(_t="number of blobs")
+            a.th(_t="knee")
+            a.th(_t="peak")
+            a.th(_t="stopped by")
+            a.th(_t="bytes/s and p99 latency by concurrency")
+        with a.tbody():
+            for s in suite.sweeps:
+                tc = s["transfer_config"]
+                peak = max(s["curve"], key=lambda p: p["bytes_per_second"])
+                with a.tr():
+                    a.td(_t=s["case"])
+                    a.td(_t=s["transport"])
+                    a.td(_t=size_format(tc["blob_size"]))
+                    a.td(_t=tc["num_blobs"])
+                    a.td(_t=s["knee_concurrency"])
+                    a.td(
+                        _t=f"{size_format(peak['bytes_per_second'])}/s at "
+                        f"{peak['concurrency']}"
+                    )
+                    a.td(_t=s["stop_reason"])
+                    with a.td():
+                        for p in s["curve"]:
+                            text = (
+                                f"{p['concurrency']}: {size_format(p['bytes_per_second'])}/s, "
+                                f"p99 {p['latency_p99_us']}us"
+                            )
+                            if p["concurrency"] == s["knee_concurrency"]:
+                                a.b(_t=text)
+                            else:
+                                a.span(_t=text)
+                            a.br()
+
+
+def case_speed(r, total_size):
+    """Mean bytes/s without outliers for runs with estimates, otherwise from the mean time of the
+    trials without the fastest and the slowest one."""
+    if r.estimate:
+        return r.estimate["bytes_per_second"]
+    return total_size / numpy.mean(sorted(r.total_time_ms)[1:-1]) * 1000
+
+
+def case_cell(r, speed, cv):
+    """Text and tooltip of the cell of a case, * marks noisy cases, ? cases whose confidence
+    interval never got narrow enough."""
+    title = ", ".join([str(i) + "ms" for i in r.total_time_ms]) + "; " + f"{cv:.3f}"
+    if r.latency_p99_us:
+        title += "; p99 " + ", ".join([str(i) + "us" for i in r.latency_p99_us])
+    data = size_format(speed) + "/s"
+    if r.estimate:
+        e = r.estimate
+        if e["ci_half_width"] is not None:
+            data += f" ±{e['ci_half_width'] / max(speed, 1) * 100:.1f}%"
+        title += f"; {e['trials']} trials, {e['confidence'] * 100:.0f}% confidence"
+        if e["outliers"]:
+            title += "; outlier trials " + ", ".join(str(i) for i in e["outliers"])
+        if not e["converged"]:
+            data += "?"
+    if cv > 0.3:
+        data += "*"
+    return data, title
+
+
 def generate_suite_report(a, suite):
     with a.table():
         with a.thead().tr():
@@ -508,9 +736,23 @@ def generate_suite_report(a, suite):
             for (c, tc) in itertools.product(
                 suite.benchmark_cases, suite.transfer_configs
             ):
+                if tc not in [r.transfer_config for r in suite.cases if r.case_name == c]:
+                    continue
                 with a.tr():
                     if c != last_case_name:
-                        a.td(_t=c, rowspan=len(suite.transfer_configs))
+                        num_rows = len(
+                            [
+                                t
+                                for t in suite.transfer_configs
+                                if t
+                                in [
+                                    r.transfer_config
+                                    for r in suite.cases
+                                    if r.case_name == c
+                                ]
+                            ]
+                        )
+                        a.td(_t=c, rowspan=num_rows)
                         last_case_name = c
                     a.td(_t=size_format(tc.blob_size))
                     a.td(_t=tc.num_blobs)
@@ -527,43 +769,40 @@ def generate_suite_report(a, suite):
                             suite.cases,
                         )
                     )
-                    baseline_time = list(
+                    baseline_results = list(
                         filter(
                             lambda r: r.transport == suite.baseline_transport,
                             filtered_results,
                         )
-                    )[0].total_time_ms
-                    baseline_avg_time = numpy.mean(sorted(baseline_time)[1:-1])
+                    )
+                    if not baseline_results:
+                        # e.g. async cases, which only run with async transports
+                        a.td(_t="n/a")
+                        for t in suite.transports[1:]:
+                            r = [r for r in filtered_results if r.transport == t]
+                            if r:
+                                speed = case_speed(r[0], tc_total_size)
+                                a.td(_t=size_format(speed) + "/s")
+                            else:
+                                a.td(_t="n/a")
+                            a.td(_t="n/a")
+                        continue
+                    baseline_time = baseline_results[0].total_time_ms
                     baseline_cv = numpy.std(baseline_time) / numpy.mean(baseline_time)
-                    baseline_speed = tc_total_size / baseline_avg_time * 1000
-
-                    td_title = (
-                        ", ".join([str(i) + "ms" for i in baseline_time])
-                        + "; "
-                        + f"{baseline_cv:.3f}"
+                    baseline_speed = case_speed(baseline_results[0], tc_total_size)
+                    td_data, td_title = case_cell(
+                        baseline_results[0], baseline_speed, baseline_cv
                     )
-                    td_data = size_format(baseline_speed) + "/s"
-                    if baseline_cv > 0.3:
-                        td_data += "*"
                     a.td(_t=td_data, title=td_title)
 
                     for r in filter(
                         lambda r: r.transport != suite.baseline_transport,
                         filtered_results,
                     ):
-                        avg_time = numpy.mean(sorted(r.total_time_ms)[1:-1])
                         cv = numpy.std(r.total_time_ms) / numpy.mean(r.total_time_ms)
-                        speed = tc_total_size / avg_time * 1000
+                        speed = case_speed(r, tc_total_size)
                         percent = speed / baseline_speed * 100
-
-                        td_title = (
-                            ", ".join([str(i) + "ms" for i in r.total_time_ms])
-                            + "; "
-                            + f"{cv:.3f}"
-                        )
-                        td_data = size_format(speed) + "/s"
-                        if cv > 0.3:
-                            td_data += "*"
+                        td_data, td_title = case_cell(r, speed, cv)
                         a.td(_t=td_data, title=td_title)
                         a.td(_t=f"{percent:.1f}" + "%")
     with a.ul():
@@ -583,6 +822,8 @@ def generate_suite_report(a, suite):
                 urllib.parse.unquote(urllib.parse.urlparse(suite.log_source).path)
             )
             a.a(href=suite.log_source, _t=logname)
+    generate_sweep_report(a, suite)
+    generate_timeline_report(a, suite)
 
 
 @contextlib.contextmanager
@@ -650,9 +891,13 @@ def publish_report(container_client, blob_name, content):
 if __name__ == "__main__":
     if len(sys.argv) == 2:
         report_filename = "reports.html"
-        suite = parse_log(open(sys.argv[1]).read())
-        with open(report_filename, "w") as f:
-            f.write(generate_suites_report(suite))
+        content = open(sys.argv[1]).read()
+        if sys.argv[1].endswith(".jsonl"):
+            suites = parse_results(content)
+        else:
+            suites = [parse_log(content)]
+        with open(report_filename, "wb") as f:
+            f.write(generate_suites_report(suites))
         logger.info(f"saved to {report_filename}")
     elif len(sys.argv) == 1:
         log_account_name = "azsdkcpp"
@@ -672,15 +917,32 @@ if __name__ == "__main__":
                 f"{raw_log_contianer_name} container doesn't exist in storage account {log_account_name}"
             )
             exit(1)
+        raw_log_blobs = [b.name for b in raw_log_container_client.list_blobs()]
         log_blobs = filter(
             lambda b: re.fullmatch("[0-9-]{10}T[0-9:]{8}Z-[0-9a-z]+.log", b),
-            map(lambda b: b.name, raw_log_container_client.list_blobs()),
+            raw_log_blobs,
         )
+        results_blobs = set(filter(lambda b: b.endswith(".jsonl"), raw_log_blobs))
 
         def parse_log_from_blob(blob_name):
             blob_client = raw_log_container_client.get_blob_client(blob_name)
-            blob_content = blob_client.download_blob().content_as_text()
-            suite = parse_log(blob_content)
+            # older runs only have the text log
+            results_blob_name = blob_name[: -len(".log")] + ".jsonl"
+            if results_blob_name in results_blobs:
+                # long runs continue their results in <run_id>.1.jsonl, <run_id>.2.jsonl, ...
+                content = ""
+                part = 0
+                while results_blob_name in results_blobs:
+                    results_blob_client = raw_log_container_client.get_blob_client(
+                        results_blob_name
+                    )
+                    content += results_blob_client.download_blob().content_as_text()
+                    part += 1
+                    results_blob_name = f"{blob_name[: -len('.log')]}.{part}.jsonl"
+                suite = parse_results(content)[0]
+            else:
+                blob_content = blob_client.download_blob().content_as_text()
+                suite = parse_log(blob_content)
             suite.log_source = blob_client.url
             return suite
 
@@ -0,0 +1,227 @@
+#include "async_log_sink.hh"
+
+#include <algorithm>
+#include <exception>
+#include <iterator>
+#include <vector>
+
+#include <spdlog/details/log_msg_buffer.h>
+#include <spdlog/pattern_formatter.h>
+#include <spdlog/spdlog.h>
+
+#include "cpu_usage.hh"
+#include "memory_usage.hh"
+
+struct async_log_sink::producer_queue
+{
+  explicit producer_queue(size_t capacity) : slots(capacity) {}
+
+  // only called from the thread the queue belongs to
+  bool push(const spdlog::details::log_msg& msg)
+  {
+    const size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == slots.size())
+    {
+      return false;
+    }
+    slots[t % slots.size()] = spdlog::details::log_msg_buffer(msg);
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // only called from the background thread
+  void drain(std::vector<spdlog::details::log_msg_buffer>& messages)
+  {
+    const size_t h = head.load(std::memory_order_relaxed);
+    const size_t t = tail.load(std::memory_order_acquire);
+    for (size_t i = h; i != t; ++i)
+    {
+      messages.push_back(std::move(slots[i % slots.size()]));
+    }
+    head.store(t, std::memory_order_release);
+  }
+
+  std::vector<spdlog::details::log_msg_buffer> slots;
+  // next slot to read
+  std::atomic<size_t> head{0};
+  // next slot to write
+  std::atomic<size_t> tail{0};
+  // set once the thread has exited or logs to another sink, the queue is dropped once drained
+  std::atomic<bool> abandoned{false};
+};
+
+namespace {
+
+uint64_t next_sink_id()
+{
+  static std::atomic<uint64_t> id(0);
+  return ++id;
+}
+
+} // namespace
+
+async_log_sink::async_log_sink(
+    writer write,
+    std::chrono::milliseconds flush_interval,
+    size_t queue_capacity)
+    : m_id(next_sink_id()), m_write(std::move(write)), m_flush_interval(flush_interval),
+      m_queue_capacity(queue_capacity), m_formatter(new spdlog::pattern_formatter())
+{
+  m_flusher = std::thread(&async_log_sink::flusher_loop, this);
+}
+
+async_log_sink::~async_log_sink() { stop(); }
+
+async_log_sink::producer_queue* async_log_sink::thread_queue()
+{
+  // shares the queue with the sink, which may be destroyed before the thread exits
+  struct cached_queue
+  {
+    uint64_t sink_id = 0;
+    std::shared_ptr<producer_queue> queue;
+
+    ~cached_queue() { abandon(); }
+    void abandon()
+    {
+      if (queue)
+      {
+        queue->abandoned.store(true, std::memory_order_release);
+      }
+    }
+  };
+  thread_local cached_queue cached;
+  if (cached.sink_id != m_id)
+  {
+    cached.abandon();
+    std::lock_guard<std::mutex> guard(m_queues_lock);
+    auto& queue = m_queues[std::this_thread::get_id()];
+    if (!queue)
+    {
+      queue = std::make_shared<producer_queue>(m_queue_capacity);
+    }
+    // the thread may come back to a queue it abandoned, or reuse the ID of one that has exited
+    queue->abandoned.store(false, std::memory_order_relaxed);
+    cached.sink_id = m_id;
+    cached.queue = queue;
+  }
+  return cached.queue.get();
+}
+
+void async_log_sink::log(const spdlog::details::log_msg& msg)
+{
+  if (!thread_queue()->push(msg))
+  {
+    m_dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void async_log_sink::flush()
+{
+  if (std::this_thread::get_id() == m_flusher.get_id())
+  {
+    return;
+  }
+  std::unique_lock<std::mutex> guard(m_flush_lock);
+  const uint64_t request = ++m_flush_requests;
+  m_flush_requested_cv.notify_one();
+  m_flushed_cv.wait(guard, [&]() { return m_flushes >= request || m_stopped; });
+}
+
+void async_log_sink::set_pattern(const std::string& pattern)
+{
+  set_formatter(std::unique_ptr<spdlog::formatter>(new spdlog::pattern_formatter(pattern)));
+}
+
+void async_log_sink::set_formatter(std::unique_ptr<spdlog::formatter> sink_formatter)
+{
+  std::lock_guard<std::mutex> guard(m_formatter_lock);
+  m_formatter = std::move(sink_formatter);
+}
+
+void async_log_sink::stop()
+{
+  {
+    std::lock_guard<std::mutex> guard(m_flush_lock);
+    if (m_stopped)
+    {
+      return;
+    }
+    m_stopped = true;
+  }
+  m_flush_requested_cv.notify_one();
+  m_flusher.join();
+  m_flushed_cv.notify_all();
+}
+
+void async_log_sink::flusher_loop()
+{
+  ignore_thread_allocations();
+  ignore_thread_cpu_usage();
+  std::unique_lock<std::mutex> guard(m_flush_lock);
+  while (true)
+  {
+    m_flush_requested_cv.wait_for(guard, m_flush_interval, [this]() {
+      return m_stopped || m_flush_requests != m_flushes;
+    });
+    const uint64_t requests = m_flush_requests;
+    const bool stopped = m_stopped;
+    guard.unlock();
+    write_pending();
+    guard.lock();
+    m_flushes = requests;
+    m_flushed_cv.notify_all();
+    if (stopped)
+    {
+      break;
+    }
+  }
+}
+
+void async_log_sink::write_pending()
+{
+  std::vector<spdlog::details::log_msg_buffer> messages;
+  {
+    std::lock_guard<std::mutex> guard(m_queues_lock);
+    for (auto ite = m_queues.begin(); ite != m_queues.end();)
+    {
+      // nothing is pushed to an abandoned queue, unless it's taken up again under the lock
+      const bool abandoned = ite->second->abandoned.load(std::memory_order_acquire);
+      ite->second->drain(messages);
+      ite = abandoned ? m_queues.erase(ite) : std::next(ite);
+    }
+  }
+  std::stable_sort(
+      messages.begin(),
+      messages.end(),
+      [](const spdlog::details::log_msg_buffer& lhs, const spdlog::details::log_msg_buffer& rhs) {
+        return lhs.time < rhs.time;
+      });
+
+  std::string text;
+  {
+    std::lock_guard<std::mutex> guard(m_formatter_lock);
+    spdlog::memory_buf_t formatted;
+    for (const auto& msg : messages)
+    {
+      formatted.clear();
+      m_formatter->format(msg, formatted);
+      text.append(formatted.data(), formatted.size());
+    }
+  }
+  const uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+  if (dropped != m_dropped_reported)
+  {
+    text += std::to_string(dropped - m_dropped_reported)
+        + " log messages were dropped because the log queue was full\n";
+    m_dropped_reported = dropped;
+  }
+
+  try
+  {
+    m_write(text);
+  }
+  catch (std::exception& e)
+  {
+    spdlog::error("failed to write log: {}", e.what());
+  }
+}
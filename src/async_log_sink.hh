@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <spdlog/sinks/sink.h>
+
+/*
+ * spdlog sink that doesn't take a lock or do I/O on the logging thread. Every thread copies its
+ * messages into a fixed-size single-producer queue of its own, a background thread drains the
+ * queues, formats the messages in time order and hands the text to a writer. A message logged
+ * while the queue of its thread is full is dropped, the number of dropped messages is reported in
+ * the text, so memory stays bounded however much is logged.
+ */
+class async_log_sink : public spdlog::sinks::sink {
+public:
+  // Called on the background thread once per flush_interval with the text logged since the
+  // previous call, which may be empty. Exceptions are caught and logged.
+  using writer = std::function<void(const std::string& text)>;
+
+  async_log_sink(
+      writer write,
+      std::chrono::milliseconds flush_interval,
+      size_t queue_capacity = 1024);
+  async_log_sink(const async_log_sink&) = delete;
+  async_log_sink& operator=(const async_log_sink&) = delete;
+  // stop()s
+  ~async_log_sink();
+
+  void log(const spdlog::details::log_msg& msg) override;
+  // Writes everything logged so far and waits for the writer to return.
+  void flush() override;
+  void set_pattern(const std::string& pattern) override;
+  void set_formatter(std::unique_ptr<spdlog::formatter> sink_formatter) override;
+
+  // Writes what is left and stops the background thread, later messages are dropped.
+  void stop();
+  uint64_t dropped() const { return m_dropped; }
+
+private:
+  struct producer_queue;
+
+  producer_queue* thread_queue();
+  void flusher_loop();
+  // drains the queues and calls the writer, only called from the background thread
+  void write_pending();
+
+  const uint64_t m_id;
+  writer m_write;
+  std::chrono::milliseconds m_flush_interval;
+  size_t m_queue_capacity;
+
+  std::mutex m_queues_lock;
+  // a queue per thread that has logged, dropped once its thread has exited and it is drained
+  std::map<std::thread::id, std::shared_ptr<producer_queue>> m_queues;
+
+  std::mutex m_formatter_lock;
+  std::unique_ptr<spdlog::formatter> m_formatter;
+
+  std::mutex m_flush_lock;
+  std::condition_variable m_flush_requested_cv;
+  std::condition_variable m_flushed_cv;
+  uint64_t m_flush_requests = 0;
+  uint64_t m_flushes = 0;
+  bool m_stopped = false;
+  std::atomic<uint64_t> m_dropped{0};
+  // dropped messages already reported in the text, only used by the background thread
+  uint64_t m_dropped_reported = 0;
+  std::thread m_flusher;
+};
@@ -2,32 +2,341 @@
 
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <numeric>
+#include <random>
+#include <stdexcept>
 #include <string>
 #include <thread>
 #include <vector>
 
 #include "constants.hh"
+#include "cpu_usage.hh"
+#include "memory_usage.hh"
+#include "settings.hh"
 #include "utilities.hh"
+#include "worker_pool.hh"
 
-transfer_result case_download::operator()(
-    transport& transport,
-    transfer_configuration& transfer_config)
+bool operator==(const transfer_configuration& lhs, const transfer_configuration& rhs)
 {
-  transport.reset(transfer_config.concurrency);
+  return lhs.blob_size == rhs.blob_size && lhs.num_blobs == rhs.num_blobs
+      && lhs.concurrency == rhs.concurrency && lhs.target_rate == rhs.target_rate
+      && lhs.arrivals == rhs.arrivals && lhs.download_sink == rhs.download_sink
+      && lhs.sink_size == rhs.sink_size && lhs.payload == rhs.payload
+      && lhs.verify == rhs.verify && lhs.transactional_hash == rhs.transactional_hash;
+}
+
+std::string to_string(arrival_process arrivals)
+{
+  switch (arrivals)
+  {
+    case arrival_process::constant:
+      return "constant";
+    case arrival_process::poisson:
+      return "poisson";
+  }
+  return "unknown";
+}
+
+std::string to_string(download_sink_type download_sink)
+{
+  switch (download_sink)
+  {
+    case download_sink_type::buffer:
+      return "buffer";
+    case download_sink_type::ring_buffer:
+      return "ring buffer";
+    case download_sink_type::discard:
+      return "discard";
+  }
+  return "unknown";
+}
+
+namespace {
+
+// Feeds everything downloaded into a content_checker on its way to the wrapped sink.
+class verifying_sink : public download_sink {
+public:
+  verifying_sink(std::unique_ptr<download_sink> sink, const expected_content& expected)
+      : m_sink(std::move(sink)), m_expected(expected), m_checker(expected)
+  {
+  }
+
+  uint8_t* contiguous_buffer(size_t blob_size) override
+  {
+    m_contiguous = m_sink->contiguous_buffer(blob_size);
+    return m_contiguous;
+  }
+  uint8_t* prepare(size_t& size) override
+  {
+    m_prepared = m_sink->prepare(size);
+    return m_prepared;
+  }
+  void commit(size_t size) override
+  {
+    m_checker.update(m_prepared, size);
+    m_sink->commit(size);
+  }
+  void write(const uint8_t* data, size_t size) override
+  {
+    m_checker.update(data, size);
+    m_sink->write(data, size);
+  }
+
+  // checks the download that just completed, throws std::runtime_error on a mismatch
+  void finish()
+  {
+    if (m_contiguous)
+    {
+      m_checker.update(m_contiguous, m_expected.size());
+      m_contiguous = nullptr;
+    }
+    m_checker.finish();
+  }
+
+private:
+  std::unique_ptr<download_sink> m_sink;
+  const expected_content& m_expected;
+  content_checker m_checker;
+  uint8_t* m_contiguous = nullptr;
+  uint8_t* m_prepared = nullptr;
+};
+
+// content of the blob download cases read, nullptr unless downloads are verified
+std::unique_ptr<expected_content> make_expected_content(
+    const transfer_configuration& transfer_config)
+{
+  if (transfer_config.verify == verification::none)
+  {
+    return nullptr;
+  }
+  // what init_blobs uploads as blob 0
+  std::vector<uint8_t> content(static_cast<size_t>(transfer_config.blob_size));
+  fill_payload_parallel(content.data(), content.size(), transfer_config.payload);
+  if (transfer_config.payload == payload_profile::unique)
+  {
+    stamp_payload(content.data(), content.size(), 0);
+  }
+  return std::make_unique<expected_content>(transfer_config.verify, std::move(content));
+}
+
+// expected is nullptr or the content downloads are verified against
+std::unique_ptr<download_sink> make_download_sink(
+    const transfer_configuration& transfer_config,
+    const expected_content* expected)
+{
+  std::unique_ptr<download_sink> sink;
+  switch (transfer_config.download_sink)
+  {
+    case download_sink_type::ring_buffer:
+      sink = std::make_unique<ring_buffer_sink>(transfer_config.sink_size);
+      break;
+    case download_sink_type::discard:
+      sink = std::make_unique<discard_sink>(transfer_config.sink_size);
+      break;
+    case download_sink_type::buffer:
+      sink = std::make_unique<ring_buffer_sink>(static_cast<size_t>(transfer_config.blob_size));
+      break;
+  }
+  if (expected)
+  {
+    sink = std::make_unique<verifying_sink>(std::move(sink), *expected);
+  }
+  return sink;
+}
+
+// verifies the download that just completed into sink if it was made with expected content
+void finish_download(download_sink& sink)
+{
+  if (auto verifier = dynamic_cast<verifying_sink*>(&sink))
+  {
+    verifier->finish();
+  }
+}
+
+/*
+ * Content of uploaded blobs. Users share one buffer, except with payload_profile::unique where
+ * every user has its own copy, stamped with the index of the blob before each upload. Like
+ * init_blobs, copies take at most 1GB; users beyond that share copies and an upload waits until
+ * the copy of its user is free.
+ */
+class upload_payload {
+public:
+  // Content of one upload, the copy it was stamped in is reserved until the lease is destroyed.
+  class lease {
+  public:
+    lease(upload_payload* payload, size_t copy, const uint8_t* data)
+        : m_payload(payload), m_copy(copy), m_data(data)
+    {
+    }
+    lease(lease&& other) noexcept
+        : m_payload(other.m_payload), m_copy(other.m_copy), m_data(other.m_data)
+    {
+      other.m_payload = nullptr;
+    }
+    lease& operator=(lease&&) = delete;
+    ~lease()
+    {
+      if (m_payload)
+      {
+        m_payload->release(m_copy);
+      }
+    }
+
+    const uint8_t* data() const { return m_data; }
+
+  private:
+    // nullptr if the copy isn't shared with other users
+    upload_payload* m_payload;
+    size_t m_copy;
+    const uint8_t* m_data;
+  };
 
-  const std::string blob_name = get_blob_name(transfer_config.blob_size);
-  init_blobs(transfer_config.blob_size, 1);
+  upload_payload(const transfer_configuration& transfer_config, int num_users)
+      : m_size(static_cast<size_t>(transfer_config.blob_size)),
+        m_unique(transfer_config.payload == payload_profile::unique)
+  {
+    m_shared.reset(new uint8_t[m_size]);
+    fill_payload_parallel(m_shared.get(), m_size, transfer_config.payload);
+    if (m_unique)
+    {
+      const int num_copies = static_cast<int>(std::max<size_t>(
+          std::min<size_t>(1_GB / m_size, static_cast<size_t>(num_users)), 1));
+      if (num_copies < num_users)
+      {
+        spdlog::warn(
+            "{} copies of the unique {}-byte payload for {} workers, uploads wait for a free copy",
+            num_copies,
+            m_size,
+            num_users);
+      }
+      // copied by the worker that uses it, so it's placed on the worker's NUMA node
+      m_copies.resize(num_copies);
+      m_busy.resize(num_copies, false);
+      benchmark_worker_pool().run(num_copies, [&](int copy) {
+        m_copies[copy].reset(new uint8_t[m_size]);
+        std::memcpy(m_copies[copy].get(), m_shared.get(), m_size);
+      });
+      m_copies_shared = num_copies < num_users;
+    }
+  }
 
-  std::vector<std::vector<uint8_t>> buffer_array(
-      transfer_config.concurrency, std::vector<uint8_t>(transfer_config.blob_size, uint8_t(0)));
+  // not to be called concurrently for the same user
+  lease get(int user, int blob_index)
+  {
+    if (!m_unique)
+    {
+      return lease(nullptr, 0, m_shared.get());
+    }
+    const size_t copy = static_cast<size_t>(user) % m_copies.size();
+    if (m_copies_shared)
+    {
+      std::unique_lock<std::mutex> guard(m_lock);
+      m_free_cv.wait(guard, [&]() { return !m_busy[copy]; });
+      m_busy[copy] = true;
+    }
+    stamp_payload(m_copies[copy].get(), m_size, static_cast<uint64_t>(blob_index));
+    return lease(m_copies_shared ? this : nullptr, copy, m_copies[copy].get());
+  }
+  size_t size() const { return m_size; }
+
+private:
+  void release(size_t copy)
+  {
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      m_busy[copy] = false;
+    }
+    m_free_cv.notify_all();
+  }
+
+  size_t m_size;
+  bool m_unique;
+  std::unique_ptr<uint8_t[]> m_shared;
+  std::vector<std::unique_ptr<uint8_t[]>> m_copies;
+  bool m_copies_shared = false;
+  std::mutex m_lock;
+  std::condition_variable m_free_cv;
+  std::vector<bool> m_busy;
+};
+
+// Offsets from the start of the run at which each request is intended to be issued.
+std::vector<std::chrono::nanoseconds> make_schedule(const transfer_configuration& transfer_config)
+{
+  std::vector<std::chrono::nanoseconds> schedule(transfer_config.num_blobs);
+  const double interval_ns = 1e9 / transfer_config.target_rate;
+  std::mt19937_64 g(transfer_config.num_blobs);
+  std::exponential_distribution<double> gap_ns(1.0 / interval_ns);
+  double offset_ns = 0.0;
+  for (auto& s : schedule)
+  {
+    s = std::chrono::nanoseconds(static_cast<int64_t>(offset_ns));
+    offset_ns += transfer_config.arrivals == arrival_process::poisson ? gap_ns(g) : interval_ns;
+  }
+  return schedule;
+}
+
+/*
+ * Runs transfer_config.num_blobs operations on transfer_config.concurrency workers of the shared
+ * pool. Every call to op(thread_id, i), which transfers the i-th blob, is timed individually into
+ * a histogram owned by the calling worker, the histograms are merged after all workers return.
+ * op_bytes(i), if given, is the size of the i-th transfer, otherwise every transfer is
+ * transfer_config.blob_size bytes.
+ */
+transfer_result run_transfer(
+    const transfer_configuration& transfer_config,
+    const std::function<void(int, int)>& op,
+    const std::function<int64_t(int)>& op_bytes = nullptr)
+{
+  const bool open_loop = transfer_config.target_rate > 0;
+  const auto schedule = open_loop ? make_schedule(transfer_config)
+                                  : std::vector<std::chrono::nanoseconds>();
 
   std::atomic<int> counter(transfer_config.num_blobs);
   std::atomic<bool> exception_observed(false);
+  std::atomic<int64_t> retried_operations(0);
+  // operations are only retried when the network proxy injects faults, whatever failed them
+  const int max_retries
+      = settings().network.injects_faults() ? settings().network.max_retries : 0;
   std::mutex lock;
   std::chrono::microseconds total_time_us(0);
+  std::chrono::nanoseconds worker_cpu_time(0);
+  int64_t num_completed = 0;
+  int64_t bytes_completed = 0;
+  std::vector<latency_histogram> histograms(transfer_config.concurrency);
+  throughput_sampler sampler(
+      std::chrono::milliseconds(settings().sample_interval_ms), transfer_config.concurrency);
+  // all workers start together, the last one to arrive starts the clock
+  std::mutex start_lock;
+  std::condition_variable start_cv;
+  int num_arrived = 0;
+  std::chrono::steady_clock::time_point wall_start;
+  auto wait_for_start = [&]() {
+    std::unique_lock<std::mutex> guard(start_lock);
+    if (++num_arrived == transfer_config.concurrency)
+    {
+      wall_start = std::chrono::steady_clock::now();
+      sampler.start(wall_start);
+      start_cv.notify_all();
+    }
+    else
+    {
+      start_cv.wait(guard, [&]() { return num_arrived == transfer_config.concurrency; });
+    }
+    return wall_start;
+  };
   auto thread_func = [&](int thread_id) {
+    auto& histogram = histograms[thread_id];
+    int64_t thread_completed = 0;
+    int64_t thread_bytes = 0;
+    const auto run_start = wait_for_start();
     auto start = std::chrono::steady_clock::now();
+    const auto cpu_start = thread_cpu_time();
     while (true)
     {
       int i = counter.fetch_sub(1);
@@ -35,96 +344,791 @@ transfer_result case_download::operator()(
       {
         break;
       }
-      try
+      auto op_start = std::chrono::steady_clock::now();
+      if (open_loop)
       {
-        transport.download_blob(
-            blob_name, buffer_array[thread_id].data(), buffer_array[thread_id].size());
+        // requests are claimed in schedule order, a request whose time has passed is late because
+        // all threads were busy and is issued immediately, the delay counts towards its latency
+        op_start = run_start + schedule[transfer_config.num_blobs - i];
+        std::this_thread::sleep_until(op_start);
       }
-      catch (std::exception& e)
+      sampler.operation_started(thread_id);
+      bool failed = false;
+      for (int attempt = 0;; ++attempt)
       {
+        try
+        {
+          op(thread_id, i);
+          break;
+        }
+        catch (std::exception& e)
+        {
+          spdlog::debug(e.what());
+          if (attempt == max_retries)
+          {
+            failed = true;
+            break;
+          }
+        }
+        retried_operations.fetch_add(1, std::memory_order_relaxed);
+        std::this_thread::sleep_for(
+            std::chrono::milliseconds(settings().network.retry_backoff_ms)
+            * (1 << std::min(attempt, 10)));
+      }
+      if (failed)
+      {
+        sampler.operation_failed(thread_id);
         exception_observed.store(true, std::memory_order_relaxed);
-        spdlog::debug(e.what());
         break;
       }
+      const int64_t bytes = op_bytes ? op_bytes(i) : transfer_config.blob_size;
+      sampler.operation_finished(thread_id, bytes);
+      histogram.record(std::chrono::steady_clock::now() - op_start);
+      ++thread_completed;
+      thread_bytes += bytes;
     }
     auto end = std::chrono::steady_clock::now();
+    const auto cpu_time = thread_cpu_time() - cpu_start;
     {
       std::lock_guard<std::mutex> guard(lock);
       total_time_us += std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+      worker_cpu_time += cpu_time;
+      num_completed += thread_completed;
+      bytes_completed += thread_bytes;
     }
   };
 
-  std::vector<std::thread> ths;
-  for (int i = 0; i < transfer_config.concurrency; ++i)
-  {
-    ths.emplace_back(thread_func, i);
-  }
-  for (auto& th : ths)
-  {
-    th.join();
-  }
+  // drop phases of requests made while preparing the case
+  take_request_phases();
+  // workers have to exist before the meter opens its per-thread counters
+  benchmark_worker_pool().reserve(transfer_config.concurrency);
+  cpu_usage_meter cpu_meter(settings().hardware_counters);
+  memory_usage_meter memory_meter;
+  benchmark_worker_pool().run(transfer_config.concurrency, thread_func);
+  auto wall_end = std::chrono::steady_clock::now();
+  auto cpu = cpu_meter.read();
+  const auto memory = memory_meter.read();
+  auto timeline = sampler.stop();
 
   transfer_result ret;
   ret.total_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
       total_time_us / transfer_config.concurrency);
+  for (const auto& h : histograms)
+  {
+    ret.latency.merge(h);
+  }
+  ret.latency_percentiles = latency_summary::from(ret.latency);
+  const double wall_seconds = std::chrono::duration<double>(wall_end - wall_start).count();
+  if (wall_seconds > 0)
+  {
+    ret.ops_per_second = static_cast<double>(num_completed) / wall_seconds;
+    ret.bytes_per_second = static_cast<double>(bytes_completed) / wall_seconds;
+  }
+  ret.bytes_transferred = bytes_completed;
   ret.exception_observed = exception_observed;
+  ret.retried_operations = retried_operations;
+  ret.request_phases = take_request_phases();
+  cpu.worker_time = std::chrono::duration_cast<std::chrono::microseconds>(worker_cpu_time);
+  ret.cpu = cpu;
+  ret.memory = memory;
+  ret.sample_interval = sampler.interval();
+  ret.timeline = std::move(timeline);
   return ret;
 }
 
-transfer_result case_upload::operator()(
-    transport& transport,
-    transfer_configuration& transfer_config)
+/*
+ * Issues transfer_config.num_blobs operations from the calling thread with up to
+ * transfer_config.concurrency of them in flight. op(slot, i, on_done) starts the transfer of the
+ * i-th blob, no other operation in flight uses the same slot in [0, concurrency). Completions are
+ * recorded on transport threads.
+ */
+transfer_result run_async_transfer(
+    const transfer_configuration& transfer_config,
+    const std::function<void(int, int, async_transport::completion_handler)>& op)
 {
-  transport.reset(transfer_config.concurrency);
+  const bool open_loop = transfer_config.target_rate > 0;
+  const auto schedule = open_loop ? make_schedule(transfer_config)
+                                  : std::vector<std::chrono::nanoseconds>();
 
-  std::vector<uint8_t> buffer(transfer_config.blob_size);
-  fill_buffer(buffer.data(), buffer.size());
-
-  std::atomic<int> counter(transfer_config.num_blobs);
-  std::atomic<bool> exception_observed(false);
   std::mutex lock;
-  std::chrono::microseconds total_time_us(0);
-  auto thread_func = [&]() {
-    auto start = std::chrono::steady_clock::now();
-    while (true)
+  std::condition_variable cv;
+  std::vector<int> free_slots(transfer_config.concurrency);
+  std::iota(free_slots.begin(), free_slots.end(), 0);
+  int in_flight = 0;
+  bool exception_observed = false;
+  int64_t num_completed = 0;
+  latency_histogram histogram;
+  throughput_sampler sampler(
+      std::chrono::milliseconds(settings().sample_interval_ms), transfer_config.concurrency);
+
+  take_request_phases();
+  cpu_usage_meter cpu_meter(settings().hardware_counters);
+  memory_usage_meter memory_meter;
+  const auto cpu_start = thread_cpu_time();
+  const auto wall_start = std::chrono::steady_clock::now();
+  sampler.start(wall_start);
+  for (int i = 0; i < transfer_config.num_blobs; ++i)
+  {
+    int slot;
     {
-      int i = counter.fetch_sub(1);
-      if (i <= 0)
+      std::unique_lock<std::mutex> guard(lock);
+      cv.wait(guard, [&]() { return !free_slots.empty() || exception_observed; });
+      if (exception_observed)
       {
         break;
       }
-      try
+      slot = free_slots.back();
+      free_slots.pop_back();
+      ++in_flight;
+    }
+    auto op_start = std::chrono::steady_clock::now();
+    if (open_loop)
+    {
+      op_start = wall_start + schedule[i];
+      std::this_thread::sleep_until(op_start);
+    }
+    auto on_done = [&, slot, op_start](std::exception_ptr exception) {
+      const auto latency = std::chrono::steady_clock::now() - op_start;
+      std::lock_guard<std::mutex> guard(lock);
+      if (exception)
       {
-        std::string blob_name = get_blob_name(transfer_config.blob_size, i);
-        transport.upload_blob(blob_name, buffer.data(), buffer.size());
+        sampler.operation_failed(slot);
+        exception_observed = true;
+        try
+        {
+          std::rethrow_exception(exception);
+        }
+        catch (std::exception& e)
+        {
+          spdlog::debug(e.what());
+        }
       }
-      catch (std::exception& e)
+      else
       {
-        exception_observed.store(true, std::memory_order_relaxed);
-        spdlog::debug(e.what());
-        break;
+        sampler.operation_finished(slot, transfer_config.blob_size);
+        histogram.record(latency);
+        ++num_completed;
       }
+      free_slots.push_back(slot);
+      --in_flight;
+      cv.notify_all();
+    };
+    sampler.operation_started(slot);
+    try
+    {
+      op(slot, i, on_done);
     }
-    auto end = std::chrono::steady_clock::now();
+    catch (std::exception&)
     {
-      std::lock_guard<std::mutex> guard(lock);
-      total_time_us += std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+      on_done(std::current_exception());
+    }
+  }
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    cv.wait(guard, [&]() { return in_flight == 0; });
+  }
+  const auto wall_end = std::chrono::steady_clock::now();
+  auto cpu = cpu_meter.read();
+  cpu.worker_time
+      = std::chrono::duration_cast<std::chrono::microseconds>(thread_cpu_time() - cpu_start);
+  const auto memory = memory_meter.read();
+  auto timeline = sampler.stop();
+
+  transfer_result ret;
+  // there's a single issuing thread, its time is the wall time
+  ret.total_time_ms
+      = std::chrono::duration_cast<std::chrono::milliseconds>(wall_end - wall_start);
+  ret.latency = histogram;
+  ret.latency_percentiles = latency_summary::from(ret.latency);
+  const double wall_seconds = std::chrono::duration<double>(wall_end - wall_start).count();
+  if (wall_seconds > 0)
+  {
+    ret.ops_per_second = static_cast<double>(num_completed) / wall_seconds;
+    ret.bytes_per_second
+        = static_cast<double>(num_completed * transfer_config.blob_size) / wall_seconds;
+  }
+  ret.bytes_transferred = num_completed * transfer_config.blob_size;
+  ret.exception_observed = exception_observed;
+  ret.request_phases = take_request_phases();
+  ret.cpu = cpu;
+  ret.memory = memory;
+  ret.sample_interval = sampler.interval();
+  ret.timeline = std::move(timeline);
+  return ret;
+}
+
+/*
+ * With settings().prewarm, connections workers of the pool make a request each at the same time
+ * before the case is timed, so that the case starts with that many connections open. Failures are
+ * ignored, a request for a blob that doesn't exist opens its connection too.
+ */
+void prewarm_connections(transport& transport, const std::string& blob_name, int connections)
+{
+  if (!settings().prewarm)
+  {
+    return;
+  }
+  benchmark_worker_pool().run(connections, [&](int) {
+    try
+    {
+      transport.get_blob_properties(blob_name);
+    }
+    catch (std::exception& e)
+    {
+      spdlog::debug(e.what());
+    }
+  });
+}
+
+// Forwards to a sink owned elsewhere, so that several verifying_sinks can share one buffer.
+class borrowed_sink : public download_sink {
+public:
+  explicit borrowed_sink(download_sink& sink) : m_sink(sink) {}
+
+  uint8_t* contiguous_buffer(size_t blob_size) override
+  {
+    return m_sink.contiguous_buffer(blob_size);
+  }
+  uint8_t* prepare(size_t& size) override { return m_sink.prepare(size); }
+  void commit(size_t size) override { m_sink.commit(size); }
+  void write(const uint8_t* data, size_t size) override { m_sink.write(data, size); }
+
+private:
+  download_sink& m_sink;
+};
+
+async_transport& to_async_transport(transport& transport, const std::string& case_name)
+{
+  auto async = dynamic_cast<async_transport*>(&transport);
+  if (!async)
+  {
+    throw std::invalid_argument(
+        case_name + " needs an async transport, " + transport.name + " isn't");
+  }
+  return *async;
+}
+
+} // namespace
+
+transfer_result case_download::operator()(
+    transport& transport,
+    transfer_configuration& transfer_config)
+{
+  transport.reset(transfer_config.concurrency);
+
+  const std::string blob_name
+      = get_blob_name(transfer_config.blob_size, 0, transfer_config.payload);
+  init_blobs(transfer_config.blob_size, 1, transfer_config.payload);
+  const auto expected = make_expected_content(transfer_config);
+
+  // created by the worker that uses it, so it's allocated on the worker's NUMA node
+  std::vector<std::unique_ptr<download_sink>> sinks(transfer_config.concurrency);
+  benchmark_worker_pool().run(transfer_config.concurrency, [&](int thread_id) {
+    sinks[thread_id] = make_download_sink(transfer_config, expected.get());
+  });
+  prewarm_connections(transport, blob_name, transfer_config.concurrency);
+
+  return run_transfer(transfer_config, [&](int thread_id, int) {
+    transport.download_blob(blob_name, *sinks[thread_id], transfer_config.blob_size);
+    finish_download(*sinks[thread_id]);
+  });
+}
+
+transfer_result case_upload::operator()(
+    transport& transport,
+    transfer_configuration& transfer_config)
+{
+  transport.reset(transfer_config.concurrency);
+
+  upload_payload payload(transfer_config, transfer_config.concurrency);
+  prewarm_connections(
+      transport,
+      get_upload_blob_name(transfer_config.blob_size, 0, transfer_config.payload),
+      transfer_config.concurrency);
+
+  return run_transfer(transfer_config, [&](int thread_id, int i) {
+    std::string blob_name
+        = get_upload_blob_name(transfer_config.blob_size, i, transfer_config.payload);
+    transport.upload_blob(blob_name, payload.get(thread_id, i).data(), payload.size());
+  });
+}
+
+case_parallel_download::case_parallel_download(size_t chunk_size, int per_blob_concurrency)
+    : case_base(
+        "parallel_download_" + size_to_string(chunk_size) + "x"
+        + std::to_string(per_blob_concurrency)),
+      chunk_size(chunk_size), per_blob_concurrency(per_blob_concurrency)
+{
+}
+
+transfer_result case_parallel_download::operator()(
+    transport& transport,
+    transfer_configuration& transfer_config)
+{
+  transport.reset(transfer_config.concurrency * per_blob_concurrency);
+
+  const std::string blob_name
+      = get_blob_name(transfer_config.blob_size, 0, transfer_config.payload);
+  init_blobs(transfer_config.blob_size, 1, transfer_config.payload);
+  const auto expected = make_expected_content(transfer_config);
+
+  // allocated by the worker that uses it, see allocate_worker_buffer()
+  std::vector<std::unique_ptr<uint8_t[]>> buffer_array(transfer_config.concurrency);
+  std::vector<std::unique_ptr<content_checker>> checkers(transfer_config.concurrency);
+  benchmark_worker_pool().run(transfer_config.concurrency, [&](int thread_id) {
+    buffer_array[thread_id] = allocate_worker_buffer(transfer_config.blob_size);
+    if (expected)
+    {
+      checkers[thread_id] = std::make_unique<content_checker>(*expected);
     }
+  });
+  prewarm_connections(transport, blob_name, transfer_config.concurrency * per_blob_concurrency);
+
+  return run_transfer(transfer_config, [&](int thread_id, int) {
+    transport.download_blob_parallel(
+        blob_name,
+        buffer_array[thread_id].get(),
+        transfer_config.blob_size,
+        chunk_size,
+        per_blob_concurrency);
+    if (checkers[thread_id])
+    {
+      checkers[thread_id]->update(buffer_array[thread_id].get(), transfer_config.blob_size);
+      checkers[thread_id]->finish();
+    }
+  });
+}
+
+case_parallel_upload::case_parallel_upload(size_t chunk_size, int per_blob_concurrency)
+    : case_base(
+        "parallel_upload_" + size_to_string(chunk_size) + "x"
+        + std::to_string(per_blob_concurrency)),
+      chunk_size(chunk_size), per_blob_concurrency(per_blob_concurrency)
+{
+}
+
+transfer_result case_parallel_upload::operator()(
+    transport& transport,
+    transfer_configuration& transfer_config)
+{
+  transport.reset(transfer_config.concurrency * per_blob_concurrency);
+
+  upload_payload payload(transfer_config, transfer_config.concurrency);
+  prewarm_connections(
+      transport,
+      get_upload_blob_name(transfer_config.blob_size, 0, transfer_config.payload),
+      transfer_config.concurrency * per_blob_concurrency);
+
+  return run_transfer(transfer_config, [&](int thread_id, int i) {
+    std::string blob_name
+        = get_upload_blob_name(transfer_config.blob_size, i, transfer_config.payload);
+    transport.upload_blob_parallel(
+        blob_name,
+        payload.get(thread_id, i).data(),
+        payload.size(),
+        chunk_size,
+        per_blob_concurrency);
+  });
+}
+
+case_staged_upload::case_staged_upload(size_t block_size, int per_blob_concurrency)
+    : case_base(
+        "staged_upload_" + size_to_string(block_size) + "x"
+        + std::to_string(per_blob_concurrency)),
+      block_size(block_size), per_blob_concurrency(per_blob_concurrency)
+{
+}
+
+transfer_result case_staged_upload::operator()(
+    transport& transport,
+    transfer_configuration& transfer_config)
+{
+  transport.reset(transfer_config.concurrency * per_blob_concurrency);
+
+  upload_payload payload(transfer_config, transfer_config.concurrency);
+  prewarm_connections(
+      transport,
+      get_upload_blob_name(transfer_config.blob_size, 0, transfer_config.payload),
+      transfer_config.concurrency * per_blob_concurrency);
+
+  const size_t num_blocks = (payload.size() + block_size - 1) / block_size;
+  struct thread_stages
+  {
+    latency_histogram stage;
+    latency_histogram commit;
   };
+  std::vector<thread_stages> stages(transfer_config.concurrency);
+  auto ret = run_transfer(transfer_config, [&](int thread_id, int i) {
+    std::string blob_name
+        = get_upload_blob_name(transfer_config.blob_size, i, transfer_config.payload);
+    const auto start = std::chrono::steady_clock::now();
+    transport.stage_blocks(
+        blob_name,
+        payload.get(thread_id, i).data(),
+        payload.size(),
+        block_size,
+        per_blob_concurrency);
+    const auto staged = std::chrono::steady_clock::now();
+    transport.commit_blocks(blob_name, num_blocks);
+    stages[thread_id].stage.record(staged - start);
+    stages[thread_id].commit.record(std::chrono::steady_clock::now() - staged);
+  });
+
+  for (const auto& s : stages)
+  {
+    ret.stages["stage_blocks"].merge(s.stage);
+    ret.stages["commit_block_list"].merge(s.commit);
+  }
+  return ret;
+}
 
-  std::vector<std::thread> ths;
+transfer_result case_async_download::operator()(
+    transport& transport,
+    transfer_configuration& transfer_config)
+{
+  auto& async = to_async_transport(transport, name);
+  async.reset(transfer_config.concurrency);
+
+  const std::string blob_name
+      = get_blob_name(transfer_config.blob_size, 0, transfer_config.payload);
+  init_blobs(transfer_config.blob_size, 1, transfer_config.payload);
+  const auto expected = make_expected_content(transfer_config);
+
+  std::vector<std::unique_ptr<download_sink>> sinks;
   for (int i = 0; i < transfer_config.concurrency; ++i)
   {
-    ths.emplace_back(thread_func);
+    sinks.push_back(make_download_sink(transfer_config, expected.get()));
   }
-  for (auto& th : ths)
+  prewarm_connections(async, blob_name, transfer_config.concurrency);
+
+  return run_async_transfer(
+      transfer_config, [&](int slot, int, async_transport::completion_handler on_done) {
+        // verified on the transport thread, like a real application would
+        auto verify_then_done = [&sinks, slot, on_done](std::exception_ptr exception) {
+          if (!exception)
+          {
+            try
+            {
+              finish_download(*sinks[slot]);
+            }
+            catch (std::exception&)
+            {
+              exception = std::current_exception();
+            }
+          }
+          on_done(exception);
+        };
+        async.download_blob_async(
+            blob_name, *sinks[slot], transfer_config.blob_size, std::move(verify_then_done));
+      });
+}
+
+transfer_result case_async_upload::operator()(
+    transport& transport,
+    transfer_configuration& transfer_config)
+{
+  auto& async = to_async_transport(transport, name);
+  async.reset(transfer_config.concurrency);
+
+  upload_payload payload(transfer_config, transfer_config.concurrency);
+  prewarm_connections(
+      async,
+      get_upload_blob_name(transfer_config.blob_size, 0, transfer_config.payload),
+      transfer_config.concurrency);
+
+  return run_async_transfer(
+      transfer_config, [&](int slot, int i, async_transport::completion_handler on_done) {
+        // the content stays reserved until the upload completes
+        auto content = std::make_shared<upload_payload::lease>(payload.get(slot, i));
+        const uint8_t* data = content->data();
+        async.upload_blob_async(
+            get_upload_blob_name(transfer_config.blob_size, i, transfer_config.payload),
+            data,
+            payload.size(),
+            [content, on_done](std::exception_ptr exception) mutable {
+              content.reset();
+              on_done(exception);
+            });
+      });
+}
+
+transfer_result case_cold_start::operator()(
+    transport& transport,
+    transfer_configuration& transfer_config)
+{
+  const std::string blob_name
+      = get_blob_name(transfer_config.blob_size, 0, transfer_config.payload);
+  init_blobs(transfer_config.blob_size, 1, transfer_config.payload);
+  const auto expected = make_expected_content(transfer_config);
+
+  std::vector<std::unique_ptr<download_sink>> sinks(transfer_config.concurrency);
+  benchmark_worker_pool().run(transfer_config.concurrency, [&](int thread_id) {
+    sinks[thread_id] = make_download_sink(transfer_config, expected.get());
+  });
+
+  struct thread_stages
   {
-    th.join();
+    latency_histogram construct;
+    latency_histogram first_request;
+    latency_histogram warm_request;
+    latency_histogram time_to_first_request;
+  };
+  std::vector<thread_stages> stages(transfer_config.concurrency);
+  auto ret = run_transfer(transfer_config, [&](int thread_id, int) {
+    auto& sink = *sinks[thread_id];
+    const auto start = std::chrono::steady_clock::now();
+    auto client = make_transport(transport.name);
+    client->reset(1);
+    const auto constructed = std::chrono::steady_clock::now();
+    client->download_blob(blob_name, sink, transfer_config.blob_size);
+    finish_download(sink);
+    const auto first_done = std::chrono::steady_clock::now();
+    client->download_blob(blob_name, sink, transfer_config.blob_size);
+    finish_download(sink);
+    const auto warm_done = std::chrono::steady_clock::now();
+
+    auto& s = stages[thread_id];
+    s.construct.record(constructed - start);
+    s.first_request.record(first_done - constructed);
+    s.warm_request.record(warm_done - first_done);
+    s.time_to_first_request.record(first_done - start);
+  });
+
+  // an operation is timed to the end of its first request and transfers the blob twice
+  ret.latency.reset();
+  for (const auto& s : stages)
+  {
+    ret.latency.merge(s.time_to_first_request);
+    ret.stages["construct"].merge(s.construct);
+    ret.stages["first_request"].merge(s.first_request);
+    ret.stages["warm_request"].merge(s.warm_request);
   }
+  ret.latency_percentiles = latency_summary::from(ret.latency);
+  ret.bytes_per_second *= 2;
+  ret.bytes_transferred *= 2;
+  return ret;
+}
 
-  transfer_result ret;
-  ret.total_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-      total_time_us / transfer_config.concurrency);
-  ret.exception_observed = exception_observed;
+case_mixed::case_mixed(const mixed_workload& workload)
+    : case_base(
+        "mixed_" + std::to_string(std::lround(workload.read_ratio * 100)) + "r_"
+        + (workload.sizes == size_distribution::log_normal
+               ? fmt::format("lognormal{}", workload.size_sigma)
+               : workload.sizes == size_distribution::histogram ? workload.size_histogram_name
+                                                                : to_string(workload.sizes))
+        + "_"
+        + (workload.popularity == key_popularity::zipf
+               ? fmt::format("zipf{}", workload.zipf_exponent)
+               : to_string(workload.popularity))
+        + "_" + std::to_string(workload.key_space) + "keys"),
+      workload(workload)
+{
+}
+
+transfer_result case_mixed::operator()(
+    transport& transport,
+    transfer_configuration& transfer_config)
+{
+  transport.reset(transfer_config.concurrency);
+
+  const workload_plan plan(workload, transfer_config.blob_size, transfer_config.num_blobs);
+  const auto& class_sizes = plan.class_sizes();
+  int64_t key_space_bytes = 0;
+  for (size_t c = 0; c < class_sizes.size(); ++c)
+  {
+    init_blobs(static_cast<size_t>(class_sizes[c]), plan.class_keys()[c], transfer_config.payload);
+    key_space_bytes += class_sizes[c] * plan.class_keys()[c];
+  }
+  spdlog::debug(
+      "{}: {} keys of {} to {} in {} size classes, {} in total, the top 1% of keys get {:.1f}% of "
+      "operations",
+      name,
+      workload.key_space,
+      size_to_string(static_cast<uint64_t>(class_sizes.front())),
+      size_to_string(static_cast<uint64_t>(class_sizes.back())),
+      class_sizes.size(),
+      size_to_string(static_cast<uint64_t>(key_space_bytes)),
+      plan.share_of_top_keys(0.01) * 100.0);
+
+  std::vector<std::string> blob_names;
+  for (int k = 0; k < workload.key_space; ++k)
+  {
+    const auto size = static_cast<size_t>(plan.size_of(k));
+    blob_names.push_back(get_blob_name(size, plan.key_of(k).index, transfer_config.payload));
+  }
+  // content of every size class, the unique payload is rejected with verification by the settings
+  std::vector<std::unique_ptr<expected_content>> expected;
+  std::vector<std::unique_ptr<upload_payload>> payloads;
+  for (auto size : class_sizes)
+  {
+    auto class_config = transfer_config;
+    class_config.blob_size = size;
+    expected.push_back(make_expected_content(class_config));
+    payloads.push_back(std::make_unique<upload_payload>(class_config, transfer_config.concurrency));
+  }
+
+  // one buffer per worker that fits the largest size class, wrapped by a verifier per class
+  struct worker_sinks
+  {
+    std::unique_ptr<download_sink> buffer;
+    std::vector<std::unique_ptr<download_sink>> by_class;
+  };
+  std::vector<worker_sinks> sinks(transfer_config.concurrency);
+  benchmark_worker_pool().run(transfer_config.concurrency, [&](int thread_id) {
+    auto buffer_config = transfer_config;
+    buffer_config.blob_size = class_sizes.back();
+    auto& s = sinks[thread_id];
+    s.buffer = make_download_sink(buffer_config, nullptr);
+    for (const auto& e : expected)
+    {
+      std::unique_ptr<download_sink> sink = std::make_unique<borrowed_sink>(*s.buffer);
+      if (e)
+      {
+        sink = std::make_unique<verifying_sink>(std::move(sink), *e);
+      }
+      s.by_class.push_back(std::move(sink));
+    }
+  });
+  prewarm_connections(transport, blob_names[0], transfer_config.concurrency);
+
+  struct thread_stages
+  {
+    latency_histogram read;
+    latency_histogram write;
+  };
+  std::vector<thread_stages> stages(transfer_config.concurrency);
+  const auto& operations = plan.operations();
+  // writes overwrite the keys reads download with the content they were provisioned with, the
+  // payload metadata keeps the blobs from being provisioned again
+  transport.set_upload_metadata(get_payload_metadata(transfer_config.payload));
+  auto ret = run_transfer(
+      transfer_config,
+      [&](int thread_id, int i) {
+        const auto& op = operations[i - 1];
+        const auto& key = plan.key_of(op.key);
+        const auto size = plan.size_of(op.key);
+        const auto start = std::chrono::steady_clock::now();
+        if (op.write)
+        {
+          auto& payload = *payloads[key.size_class];
+          transport.upload_blob(
+              blob_names[op.key], payload.get(thread_id, key.index).data(), payload.size());
+          stages[thread_id].write.record(std::chrono::steady_clock::now() - start);
+        }
+        else
+        {
+          auto& sink = *sinks[thread_id].by_class[key.size_class];
+          transport.download_blob(blob_names[op.key], sink, size);
+          finish_download(sink);
+          stages[thread_id].read.record(std::chrono::steady_clock::now() - start);
+        }
+      },
+      [&](int i) { return plan.size_of(operations[i - 1].key); });
+  transport.set_upload_metadata({});
+
+  for (const auto& s : stages)
+  {
+    ret.stages["read"].merge(s.read);
+    ret.stages["write"].merge(s.write);
+  }
   return ret;
-}
\ No newline at end of file
+}
+
+case_range_read::case_range_read(size_t range_size, size_t range_stride)
+    : case_base(
+        "range_read_" + size_to_string(range_size) + "_"
+        + (range_stride == 0            ? std::string("random")
+               : range_stride == range_size ? std::string("sequential")
+                                            : "stride" + size_to_string(range_stride))),
+      range_size(range_size), range_stride(range_stride)
+{
+}
+
+transfer_result case_range_read::operator()(
+    transport& transport,
+    transfer_configuration& transfer_config)
+{
+  if (static_cast<size_t>(transfer_config.blob_size) < range_size)
+  {
+    throw std::invalid_argument(name + " needs blobs of at least " + size_to_string(range_size));
+  }
+  transport.reset(transfer_config.concurrency);
+
+  const std::string blob_name
+      = get_blob_name(transfer_config.blob_size, 0, transfer_config.payload);
+  init_blobs(transfer_config.blob_size, 1, transfer_config.payload);
+
+  // offsets of the reads, from the end like run_transfer counts them
+  const size_t num_offsets = static_cast<size_t>(transfer_config.blob_size) - range_size + 1;
+  std::vector<size_t> offsets(transfer_config.num_blobs);
+  std::mt19937_64 g(transfer_config.num_blobs);
+  std::uniform_int_distribution<size_t> random_offset(0, num_offsets - 1);
+  for (size_t i = 0; i < offsets.size(); ++i)
+  {
+    offsets[i] = range_stride == 0 ? random_offset(g) : i * range_stride % num_offsets;
+  }
+
+  auto range_config = transfer_config;
+  range_config.blob_size = static_cast<int64_t>(range_size);
+  std::vector<std::unique_ptr<download_sink>> sinks(transfer_config.concurrency);
+  benchmark_worker_pool().run(transfer_config.concurrency, [&](int thread_id) {
+    sinks[thread_id] = make_download_sink(range_config, nullptr);
+  });
+  prewarm_connections(transport, blob_name, transfer_config.concurrency);
+
+  return run_transfer(
+      transfer_config,
+      [&](int thread_id, int i) {
+        transport.download_range(
+            blob_name, *sinks[thread_id], offsets[transfer_config.num_blobs - i], range_size);
+      },
+      [&](int) { return static_cast<int64_t>(range_size); });
+}
+
+std::shared_ptr<case_base> make_case(const case_parameters& parameters)
+{
+  if (parameters.type == "download")
+  {
+    return std::make_shared<case_download>();
+  }
+  else if (parameters.type == "upload")
+  {
+    return std::make_shared<case_upload>();
+  }
+  else if (parameters.type == "parallel_download")
+  {
+    return std::make_shared<case_parallel_download>(
+        parameters.chunk_size, parameters.per_blob_concurrency);
+  }
+  else if (parameters.type == "parallel_upload")
+  {
+    return std::make_shared<case_parallel_upload>(
+        parameters.chunk_size, parameters.per_blob_concurrency);
+  }
+  else if (parameters.type == "staged_upload")
+  {
+    return std::make_shared<case_staged_upload>(
+        parameters.chunk_size, parameters.per_blob_concurrency);
+  }
+  else if (parameters.type == "async_download")
+  {
+    return std::make_shared<case_async_download>();
+  }
+  else if (parameters.type == "async_upload")
+  {
+    return std::make_shared<case_async_upload>();
+  }
+  else if (parameters.type == "cold_start")
+  {
+    return std::make_shared<case_cold_start>();
+  }
+  else if (parameters.type == "mixed")
+  {
+    return std::make_shared<case_mixed>(parameters.workload);
+  }
+  else if (parameters.type == "range_read")
+  {
+    return std::make_shared<case_range_read>(parameters.range_size, parameters.range_stride);
+  }
+  return nullptr;
+}
@@ -2,20 +2,79 @@
 
 #include <chrono>
 #include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
 
+#include "cpu_usage.hh"
+#include "memory_usage.hh"
+#include "histogram.hh"
+#include "payload.hh"
+#include "request_timing.hh"
+#include "throughput_sampler.hh"
 #include "transport.hh"
+#include "workload.hh"
+
+enum class arrival_process
+{
+  constant,
+  poisson,
+};
+
+enum class download_sink_type
+{
+  // a whole blob per thread
+  buffer,
+  // sink_size bytes per thread, the most recent part of the blob is kept
+  ring_buffer,
+  // sink_size bytes of scratch space per thread, content is dropped
+  discard,
+};
 
 struct transfer_configuration
 {
   int64_t blob_size;
   int num_blobs;
   int concurrency;
+  // Requests per second. 0 runs closed-loop, each thread issues the next request as soon as the
+  // previous one completes. Otherwise requests are issued open-loop on a fixed timeline and
+  // latency is measured from the intended start, concurrency caps the requests in flight.
+  double target_rate = 0.0;
+  arrival_process arrivals = arrival_process::constant;
+  download_sink_type download_sink = download_sink_type::buffer;
+  size_t sink_size = 8 * 1024 * 1024;
+  // content of uploaded blobs and of the blobs download cases read
+  payload_profile payload = payload_profile::random;
+  // check of downloaded content, part of the timed operation
+  verification verify = verification::none;
+  hash_algorithm transactional_hash = hash_algorithm::none;
 };
 
+bool operator==(const transfer_configuration& lhs, const transfer_configuration& rhs);
+std::string to_string(arrival_process arrivals);
+std::string to_string(download_sink_type download_sink);
+
 struct transfer_result
 {
   std::chrono::milliseconds total_time_ms;
+  latency_histogram latency;
+  latency_summary latency_percentiles;
+  double ops_per_second = 0.0;
+  double bytes_per_second = 0.0;
+  int64_t bytes_transferred = 0;
   bool exception_observed = false;
+  // attempts of operations that failed and were retried, see network_profile::max_retries
+  int64_t retried_operations = 0;
+  // phases of the HTTP requests made by the transfers, as far as the transport reports them
+  request_phase_histograms request_phases;
+  // latency of the parts of an operation of cases that time them separately, by name
+  std::map<std::string, latency_histogram> stages;
+  cpu_usage cpu;
+  memory_usage memory;
+  // progress every sample_interval from the start of the trial, empty if not sampled
+  std::chrono::milliseconds sample_interval{0};
+  std::vector<throughput_sample> timeline;
 };
 
 struct case_base
@@ -24,6 +83,16 @@ struct case_base
   case_base(std::string name) : name(std::move(name)) {}
   virtual transfer_result operator()(transport& transport, transfer_configuration& transfer_config)
       = 0;
+  // cases that need an async_transport are only run with transports for which
+  // is_async_transport() is true
+  virtual bool requires_async_transport() const { return false; }
+  // whether the case runs with transfer configs that have a transactional_hash
+  virtual bool supports_transactional_hash() const { return false; }
+  // whether the case runs with transfer configs that verify downloads
+  virtual bool supports_verification() const { return true; }
+  // cases that need every client to open connections of its own aren't run with transports for
+  // which shares_connections() is true
+  virtual bool requires_private_connections() const { return false; }
   virtual ~case_base() {}
 };
 
@@ -33,6 +102,7 @@ struct case_download : case_base
 
   transfer_result operator()(transport& transport, transfer_configuration& transfer_config)
       override;
+  bool supports_transactional_hash() const override { return true; }
 };
 
 struct case_upload : case_base
@@ -41,4 +111,132 @@ struct case_upload : case_base
 
   transfer_result operator()(transport& transport, transfer_configuration& transfer_config)
       override;
-};
\ No newline at end of file
+  bool supports_transactional_hash() const override { return true; }
+};
+
+// Transfers every blob in chunk_size pieces with per_blob_concurrency pieces in flight, on top of
+// transfer_config.concurrency blobs in flight.
+struct case_parallel_download : case_base
+{
+  case_parallel_download(size_t chunk_size, int per_blob_concurrency);
+
+  transfer_result operator()(transport& transport, transfer_configuration& transfer_config)
+      override;
+
+  const size_t chunk_size;
+  const int per_blob_concurrency;
+};
+
+struct case_parallel_upload : case_base
+{
+  case_parallel_upload(size_t chunk_size, int per_blob_concurrency);
+
+  transfer_result operator()(transport& transport, transfer_configuration& transfer_config)
+      override;
+
+  const size_t chunk_size;
+  const int per_blob_concurrency;
+};
+
+/*
+ * Uploads every blob as block_size blocks with per_blob_concurrency Put Block requests in flight,
+ * then commits them with Put Block List, even when the blob fits in one block. Stages
+ * "stage_blocks" and "commit_block_list" time the two steps of an operation.
+ */
+struct case_staged_upload : case_base
+{
+  case_staged_upload(size_t block_size, int per_blob_concurrency);
+
+  transfer_result operator()(transport& transport, transfer_configuration& transfer_config)
+      override;
+
+  const size_t block_size;
+  const int per_blob_concurrency;
+};
+
+// Issues every request from one thread, transfer_config.concurrency is the number of requests in
+// flight rather than the number of threads.
+struct case_async_download : case_base
+{
+  case_async_download() : case_base("async_download") {}
+
+  transfer_result operator()(transport& transport, transfer_configuration& transfer_config)
+      override;
+  bool requires_async_transport() const override { return true; }
+};
+
+struct case_async_upload : case_base
+{
+  case_async_upload() : case_base("async_upload") {}
+
+  transfer_result operator()(transport& transport, transfer_configuration& transfer_config)
+      override;
+  bool requires_async_transport() const override { return true; }
+};
+
+/*
+ * Every operation builds a new client of the transport, downloads the blob with it and downloads
+ * it once more. Latency is the time to the first successful request, from the start of client
+ * construction to the end of the first download, the stages are "construct", "first_request" and
+ * "warm_request". The first request has to connect, so transports whose clients share
+ * connections, Track2(curl), aren't run.
+ */
+struct case_cold_start : case_base
+{
+  case_cold_start() : case_base("cold_start") {}
+
+  transfer_result operator()(transport& transport, transfer_configuration& transfer_config)
+      override;
+  bool requires_private_connections() const override { return true; }
+};
+
+/*
+ * Downloads and uploads over a key space of workload.key_space blobs with the size distribution
+ * and key popularity of the workload, transfer_config.num_blobs operations in total. Uploads
+ * overwrite keys with the content and payload metadata they were provisioned with, so downloads
+ * verify either way and init_blobs keeps the blobs. Stages "read" and "write" time the two kinds
+ * of operations.
+ */
+struct case_mixed : case_base
+{
+  explicit case_mixed(const mixed_workload& workload);
+
+  transfer_result operator()(transport& transport, transfer_configuration& transfer_config)
+      override;
+
+  const mixed_workload workload;
+};
+
+/*
+ * Reads range_size bytes of blob 0 per operation, transfer_config.num_blobs reads in total. With a
+ * range_stride of 0 reads start at random offsets, otherwise read i starts i * range_stride bytes
+ * into the blob, wrapping around at its end. Offsets are the same for every transport. Ranges
+ * aren't verified, the expected content is whole blobs.
+ */
+struct case_range_read : case_base
+{
+  case_range_read(size_t range_size, size_t range_stride);
+
+  transfer_result operator()(transport& transport, transfer_configuration& transfer_config)
+      override;
+  bool supports_verification() const override { return false; }
+
+  const size_t range_size;
+  const size_t range_stride;
+};
+
+// Identifies a case and its parameters, e.g. in a config file.
+struct case_parameters
+{
+  // download, upload, parallel_download, parallel_upload, staged_upload, async_download,
+  // async_upload, cold_start, mixed or range_read
+  std::string type;
+  size_t chunk_size = 0;
+  int per_blob_concurrency = 0;
+  size_t range_size = 0;
+  size_t range_stride = 0;
+  mixed_workload workload{};
+};
+
+// returns nullptr for an unknown type
+std::shared_ptr<case_base> make_case(const case_parameters& parameters);
@@ -0,0 +1,84 @@
+#include "concurrency_sweep.hh"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+size_t find_peak(const std::vector<sweep_point>& curve)
+{
+  return std::max_element(
+             curve.begin(),
+             curve.end(),
+             [](const sweep_point& lhs, const sweep_point& rhs) {
+               return lhs.bytes_per_second < rhs.bytes_per_second;
+             })
+      - curve.begin();
+}
+
+} // namespace
+
+sweep_result run_concurrency_sweep(
+    const sweep_settings& settings,
+    const std::function<sweep_point(int)>& measure)
+{
+  sweep_result ret;
+  ret.stop_reason = "max_concurrency";
+  double best_bytes_per_second = 0.0;
+  std::chrono::microseconds best_latency_p99(0);
+  int levels_without_gain = 0;
+  for (int concurrency = settings.min_concurrency; concurrency <= settings.max_concurrency;
+       concurrency = std::max(
+           concurrency + 1,
+           static_cast<int>(std::lround(static_cast<double>(concurrency) * settings.growth))))
+  {
+    ret.curve.push_back(measure(concurrency));
+    const auto& point = ret.curve.back();
+    if (ret.curve.size() == 1
+        || point.bytes_per_second > best_bytes_per_second * (1.0 + settings.plateau_gain))
+    {
+      levels_without_gain = 0;
+    }
+    else
+    {
+      ++levels_without_gain;
+    }
+    if (point.bytes_per_second > best_bytes_per_second)
+    {
+      best_bytes_per_second = point.bytes_per_second;
+      best_latency_p99 = point.latency_p99;
+    }
+    if (levels_without_gain >= settings.plateau_levels)
+    {
+      ret.stop_reason = "plateau";
+      break;
+    }
+    if (levels_without_gain > 0 && best_latency_p99.count() > 0
+        && static_cast<double>(point.latency_p99.count())
+            > static_cast<double>(best_latency_p99.count()) * settings.latency_blowup)
+    {
+      ret.stop_reason = "latency";
+      break;
+    }
+  }
+  ret.peak = ret.curve.empty() ? 0 : find_peak(ret.curve);
+  ret.knee = find_knee(ret.curve, settings.knee_tolerance);
+  return ret;
+}
+
+size_t find_knee(const std::vector<sweep_point>& curve, double tolerance)
+{
+  if (curve.empty())
+  {
+    return 0;
+  }
+  const double peak = curve[find_peak(curve)].bytes_per_second;
+  for (size_t i = 0; i < curve.size(); ++i)
+  {
+    if (curve[i].bytes_per_second >= peak * (1.0 - tolerance))
+    {
+      return i;
+    }
+  }
+  return 0;
+}
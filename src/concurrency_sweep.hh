@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct sweep_settings
+{
+  // run every cell at growing concurrency instead of the concurrency of its transfer config
+  bool enabled = false;
+  int min_concurrency = 1;
+  int max_concurrency = 256;
+  // each level is growth times the previous one, at least one more
+  double growth = 2.0;
+  // trials per level, the one with the median throughput counts
+  int trials = 1;
+  // a level has to beat the best throughput so far by this fraction to count as a gain
+  double plateau_gain = 0.05;
+  // the sweep stops after this many levels in a row without a gain
+  int plateau_levels = 2;
+  // the sweep stops once p99 latency exceeds this multiple of p99 at the best level
+  double latency_blowup = 4.0;
+  // the knee is the lowest concurrency within this fraction of the peak throughput
+  double knee_tolerance = 0.05;
+};
+
+struct sweep_point
+{
+  int concurrency = 0;
+  double bytes_per_second = 0.0;
+  double ops_per_second = 0.0;
+  std::chrono::microseconds latency_p99{0};
+};
+
+struct sweep_result
+{
+  // in the order the levels ran, concurrency increases
+  std::vector<sweep_point> curve;
+  size_t peak = 0;
+  // index of the knee in curve, the concurrency to provision
+  size_t knee = 0;
+  // why the sweep stopped: "plateau", "latency" or "max_concurrency"
+  std::string stop_reason;
+};
+
+/*
+ * Runs measure(concurrency) at min_concurrency and growing concurrency until throughput stops
+ * growing, latency blows up or max_concurrency is reached, and finds the knee of the curve.
+ */
+sweep_result run_concurrency_sweep(
+    const sweep_settings& settings,
+    const std::function<sweep_point(int)>& measure);
+// index of the lowest concurrency whose throughput is within tolerance of the peak
+size_t find_knee(const std::vector<sweep_point>& curve, double tolerance);
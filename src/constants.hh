@@ -3,7 +3,28 @@
 constexpr static const char* connection_string = "";
 constexpr static const char* log_connection_string = "";
 
+// serve the benchmark from the in-process loopback blob endpoint instead of connection_string
+constexpr bool use_mock_blob_endpoint = false;
+
 constexpr static const char* container_name = "perf-test";
+// JSON Lines file every trial is appended to, empty to only upload it next to the log
+constexpr static const char* results_path = "";
 constexpr int repeat = 7;
+// repeat a cell until its throughput is known within repetition_settings::target_ci instead of
+// repeat times
+constexpr bool adaptive_repeat = true;
 constexpr int exception_sleep_seconds = 60;
-constexpr int delay_seconds_between_tasks = 5;
\ No newline at end of file
+constexpr int delay_seconds_between_tasks = 5;
+// "none", "compact" or "scatter", see affinity_policy in worker_pool.hh
+constexpr static const char* cpu_affinity = "none";
+// threads driving the requests of the curl-multi transport
+constexpr int event_loop_threads = 1;
+// count CPU cycles, instructions and cache misses of every case, Linux only, subject to
+// perf_event_paranoid
+constexpr bool hardware_counters = false;
+// every case but cold_start opens its connections before it's timed
+constexpr bool prewarm = false;
+// length of a sample of the throughput timeline of a trial, 0 to not sample
+constexpr int sample_interval_ms = 100;
+// sweep the concurrency of every cell instead of repeating it, see sweep_settings
+constexpr bool concurrency_sweep = false;
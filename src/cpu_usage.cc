@@ -0,0 +1,397 @@
+#include "cpu_usage.hh"
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include "utilities.hh"
+
+namespace {
+
+#if defined(_WIN32)
+
+std::chrono::microseconds to_microseconds(const FILETIME& time)
+{
+  // FILETIME counts 100ns intervals
+  const uint64_t ticks = (uint64_t(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+  return std::chrono::microseconds(ticks / 10);
+}
+
+using thread_handle = HANDLE;
+
+thread_handle current_thread()
+{
+  HANDLE thread = nullptr;
+  DuplicateHandle(
+      GetCurrentProcess(),
+      GetCurrentThread(),
+      GetCurrentProcess(),
+      &thread,
+      0,
+      FALSE,
+      DUPLICATE_SAME_ACCESS);
+  return thread;
+}
+
+void close_thread(thread_handle thread) { CloseHandle(thread); }
+
+cpu_usage get_thread_usage(thread_handle thread)
+{
+  cpu_usage usage;
+  FILETIME creation_time, exit_time, kernel_time, user_time;
+  if (GetThreadTimes(thread, &creation_time, &exit_time, &kernel_time, &user_time))
+  {
+    usage.user_time = to_microseconds(user_time);
+    usage.system_time = to_microseconds(kernel_time);
+  }
+  return usage;
+}
+
+#elif defined(__linux__)
+
+struct hardware_event
+{
+  const char* name;
+  uint32_t type;
+  uint64_t config;
+};
+
+constexpr hardware_event hardware_events[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+};
+
+int open_counter(const hardware_event& event, int tid)
+{
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = event.type;
+  attr.config = event.config;
+  attr.inherit = 1;
+  attr.exclude_hv = 1;
+  int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0));
+  if (fd < 0)
+  {
+    // counting kernel code needs perf_event_paranoid <= 1
+    attr.exclude_kernel = 1;
+    fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0));
+  }
+  return fd;
+}
+
+using thread_handle = int;
+
+thread_handle current_thread() { return static_cast<int>(syscall(SYS_gettid)); }
+
+void close_thread(thread_handle) {}
+
+// from /proc, which another thread can read too, times are counted in clock ticks
+cpu_usage get_thread_usage(thread_handle tid)
+{
+  cpu_usage usage;
+  const std::string task = "/proc/self/task/" + std::to_string(tid);
+  std::ifstream stat(task + "/stat");
+  std::string line;
+  if (std::getline(stat, line) && line.rfind(')') != std::string::npos)
+  {
+    // the command name in parentheses can contain spaces, field 3 is the first after it
+    std::istringstream fields(line.substr(line.rfind(')') + 1));
+    std::string field;
+    long long utime = 0;
+    long long stime = 0;
+    for (int i = 3; i <= 15 && fields >> field; ++i)
+    {
+      if (i == 14)
+      {
+        utime = std::atoll(field.c_str());
+      }
+      else if (i == 15)
+      {
+        stime = std::atoll(field.c_str());
+      }
+    }
+    const long long ticks_per_second = sysconf(_SC_CLK_TCK);
+    usage.user_time = std::chrono::microseconds(utime * 1000000 / ticks_per_second);
+    usage.system_time = std::chrono::microseconds(stime * 1000000 / ticks_per_second);
+  }
+  std::ifstream status(task + "/status");
+  while (std::getline(status, line))
+  {
+    const auto colon = line.find(':');
+    const std::string key = line.substr(0, colon);
+    if (key == "voluntary_ctxt_switches")
+    {
+      usage.voluntary_context_switches = std::atoll(line.c_str() + colon + 1);
+    }
+    else if (key == "nonvoluntary_ctxt_switches")
+    {
+      usage.involuntary_context_switches = std::atoll(line.c_str() + colon + 1);
+    }
+  }
+  return usage;
+}
+
+std::vector<int> get_thread_ids()
+{
+  std::vector<int> tids;
+  if (DIR* dir = opendir("/proc/self/task"))
+  {
+    while (dirent* entry = readdir(dir))
+    {
+      if (entry->d_name[0] != '.')
+      {
+        tids.push_back(std::atoi(entry->d_name));
+      }
+    }
+    closedir(dir);
+  }
+  return tids;
+}
+
+#endif
+
+#if defined(_WIN32) || defined(__linux__)
+
+// adds the times and context switches of usage to total, counters that either lacks are left
+void accumulate(cpu_usage& total, const cpu_usage& usage)
+{
+  total.user_time += usage.user_time;
+  total.system_time += usage.system_time;
+  if (total.voluntary_context_switches >= 0 && usage.voluntary_context_switches >= 0)
+  {
+    total.voluntary_context_switches += usage.voluntary_context_switches;
+    total.involuntary_context_switches += usage.involuntary_context_switches;
+  }
+}
+
+struct ignored_thread_registry
+{
+  std::mutex lock;
+  std::vector<thread_handle> threads;
+  // usage of the ignored threads that have exited
+  cpu_usage retired = []() {
+    cpu_usage usage;
+    usage.voluntary_context_switches = 0;
+    usage.involuntary_context_switches = 0;
+    return usage;
+  }();
+};
+
+ignored_thread_registry& ignored_threads()
+{
+  static ignored_thread_registry registry;
+  return registry;
+}
+
+class ignored_thread {
+public:
+  ignored_thread() : m_thread(current_thread())
+  {
+    auto& r = ignored_threads();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.threads.push_back(m_thread);
+  }
+  ~ignored_thread()
+  {
+    auto& r = ignored_threads();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.threads.erase(std::find(r.threads.begin(), r.threads.end(), m_thread));
+    accumulate(r.retired, get_thread_usage(m_thread));
+    close_thread(m_thread);
+  }
+
+private:
+  thread_handle m_thread;
+};
+
+#endif
+
+cpu_usage get_process_usage()
+{
+#if defined(_WIN32) || defined(__linux__)
+  // an ignored thread that exits meanwhile would be counted twice or not at all
+  auto& r = ignored_threads();
+  std::lock_guard<std::mutex> guard(r.lock);
+#endif
+  cpu_usage usage;
+#if defined(_WIN32)
+  FILETIME creation_time, exit_time, kernel_time, user_time;
+  if (GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time))
+  {
+    usage.user_time = to_microseconds(user_time);
+    usage.system_time = to_microseconds(kernel_time);
+  }
+#elif defined(__linux__)
+  rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) == 0)
+  {
+    usage.user_time = std::chrono::seconds(ru.ru_utime.tv_sec)
+        + std::chrono::microseconds(ru.ru_utime.tv_usec);
+    usage.system_time = std::chrono::seconds(ru.ru_stime.tv_sec)
+        + std::chrono::microseconds(ru.ru_stime.tv_usec);
+    usage.voluntary_context_switches = ru.ru_nvcsw;
+    usage.involuntary_context_switches = ru.ru_nivcsw;
+  }
+#endif
+#if defined(_WIN32) || defined(__linux__)
+  cpu_usage ignored = r.retired;
+  for (auto thread : r.threads)
+  {
+    accumulate(ignored, get_thread_usage(thread));
+  }
+  usage.user_time -= ignored.user_time;
+  usage.system_time -= ignored.system_time;
+  if (usage.voluntary_context_switches >= 0 && ignored.voluntary_context_switches >= 0)
+  {
+    usage.voluntary_context_switches -= ignored.voluntary_context_switches;
+    usage.involuntary_context_switches -= ignored.involuntary_context_switches;
+  }
+#endif
+  return usage;
+}
+
+} // namespace
+
+cpu_usage_meter::cpu_usage_meter(bool hardware_counters)
+{
+#if defined(__linux__)
+  if (hardware_counters)
+  {
+    auto tids = get_thread_ids();
+    {
+      auto& r = ignored_threads();
+      std::lock_guard<std::mutex> guard(r.lock);
+      tids.erase(
+          std::remove_if(
+              tids.begin(),
+              tids.end(),
+              [&](int tid) {
+                return std::find(r.threads.begin(), r.threads.end(), tid) != r.threads.end();
+              }),
+          tids.end());
+    }
+    for (const auto& event : hardware_events)
+    {
+      std::vector<int> fds;
+      for (int tid : tids)
+      {
+        const int fd = open_counter(event, tid);
+        if (fd < 0)
+        {
+          // warned once, the reason is the same for every case
+          static bool warned = false;
+          if (!warned)
+          {
+            spdlog::warn("cannot count {}: {}", event.name, std::strerror(errno));
+            warned = true;
+          }
+          for (int opened : fds)
+          {
+            close(opened);
+          }
+          fds.clear();
+          break;
+        }
+        fds.push_back(fd);
+      }
+      m_counters.push_back(std::move(fds));
+    }
+  }
+#else
+  if (hardware_counters)
+  {
+    spdlog::warn("hardware counters aren't supported on this platform");
+  }
+#endif
+  m_start = get_process_usage();
+}
+
+cpu_usage_meter::~cpu_usage_meter()
+{
+#if defined(__linux__)
+  for (const auto& fds : m_counters)
+  {
+    for (int fd : fds)
+    {
+      close(fd);
+    }
+  }
+#endif
+}
+
+cpu_usage cpu_usage_meter::read() const
+{
+  cpu_usage usage = get_process_usage();
+  usage.user_time -= m_start.user_time;
+  usage.system_time -= m_start.system_time;
+  if (usage.voluntary_context_switches >= 0)
+  {
+    usage.voluntary_context_switches -= m_start.voluntary_context_switches;
+    usage.involuntary_context_switches -= m_start.involuntary_context_switches;
+  }
+#if defined(__linux__)
+  int64_t* values[] = {&usage.cycles, &usage.instructions, &usage.cache_misses};
+  for (size_t i = 0; i < m_counters.size(); ++i)
+  {
+    if (m_counters[i].empty())
+    {
+      continue;
+    }
+    int64_t sum = 0;
+    for (int fd : m_counters[i])
+    {
+      uint64_t value = 0;
+      if (::read(fd, &value, sizeof(value)) == sizeof(value))
+      {
+        sum += static_cast<int64_t>(value);
+      }
+    }
+    *values[i] = sum;
+  }
+#endif
+  return usage;
+}
+
+std::chrono::nanoseconds thread_cpu_time()
+{
+#if defined(_WIN32)
+  FILETIME creation_time, exit_time, kernel_time, user_time;
+  if (GetThreadTimes(GetCurrentThread(), &creation_time, &exit_time, &kernel_time, &user_time))
+  {
+    return to_microseconds(kernel_time) + to_microseconds(user_time);
+  }
+  return std::chrono::nanoseconds(0);
+#elif defined(__linux__)
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+#else
+  return std::chrono::nanoseconds(0);
+#endif
+}
+
+void ignore_thread_cpu_usage()
+{
+#if defined(_WIN32) || defined(__linux__)
+  thread_local ignored_thread registered;
+  (void)registered;
+#endif
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/*
+ * CPU consumed by the process, threads of the transports included, while a case runs. Threads
+ * that called ignore_thread_cpu_usage() are left out. Counters a platform can't provide are -1.
+ */
+struct cpu_usage
+{
+  std::chrono::microseconds user_time{0};
+  std::chrono::microseconds system_time{0};
+  // CPU time of the threads issuing the transfers, the rest of user_time + system_time is spent on
+  // threads owned by the transports
+  std::chrono::microseconds worker_time{0};
+  int64_t voluntary_context_switches = -1;
+  int64_t involuntary_context_switches = -1;
+  // hardware counters, only collected on request
+  int64_t cycles = -1;
+  int64_t instructions = -1;
+  int64_t cache_misses = -1;
+
+  std::chrono::microseconds total_time() const { return user_time + system_time; }
+};
+
+// Starts measuring when constructed.
+class cpu_usage_meter {
+public:
+  // Hardware counters come from perf_event_open on Linux and are counted for the threads that
+  // exist at construction and the threads they create afterwards, but for ignored threads.
+  explicit cpu_usage_meter(bool hardware_counters);
+  cpu_usage_meter(const cpu_usage_meter&) = delete;
+  cpu_usage_meter& operator=(const cpu_usage_meter&) = delete;
+  ~cpu_usage_meter();
+
+  // usage since construction, worker_time is left to the caller
+  cpu_usage read() const;
+
+private:
+  cpu_usage m_start;
+  // one list of per-thread counters per hardware event
+  std::vector<std::vector<int>> m_counters;
+};
+
+// CPU time used by the calling thread so far.
+std::chrono::nanoseconds thread_cpu_time();
+// Leaves the CPU time of the calling thread out of cpu_usage_meter, for threads that serve the
+// transports in-process, see ignore_thread_allocations(). Where the time of a running thread
+// is read from /proc (Linux) it's only accurate to a clock tick.
+void ignore_thread_cpu_usage();
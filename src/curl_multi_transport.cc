@@ -0,0 +1,776 @@
+#include "curl_multi_transport.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+#include <azure/core/base64.hpp>
+#include <azure/core/datetime.hpp>
+#include <cryptopp/hmac.h>
+#include <cryptopp/sha.h>
+#include <curl/curl.h>
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#endif
+
+#include "request_timing.hh"
+#include "settings.hh"
+#include "utilities.hh"
+
+struct curl_multi_transport::request
+{
+  std::string method;
+  std::string url;
+  // x-ms-* headers, signed
+  std::vector<std::pair<std::string, std::string>> headers;
+  // /account/container/blob\nparameter:value...
+  std::string canonicalized_resource;
+  int expected_status = 200;
+
+  const uint8_t* upload_data = nullptr;
+  size_t upload_size = 0;
+  size_t upload_offset = 0;
+  // request body owned by the request, e.g. a block list
+  std::string body;
+
+  download_sink* sink = nullptr;
+  std::unique_ptr<download_sink> owned_sink;
+  // checked against the length of a successful response if not 0
+  size_t expected_length = 0;
+  size_t received = 0;
+  // body of a failed response
+  std::string error_body;
+  std::exception_ptr exception;
+
+  CURL* handle = nullptr;
+  curl_slist* header_list = nullptr;
+  completion_handler on_done;
+  std::chrono::steady_clock::time_point created = std::chrono::steady_clock::now();
+
+  ~request() { curl_slist_free_all(header_list); }
+};
+
+namespace {
+
+constexpr const char* storage_api_version = "2020-02-10";
+
+std::string url_encode(const std::string& str)
+{
+  constexpr const char* hex = "0123456789ABCDEF";
+  std::string ret;
+  for (unsigned char c : str)
+  {
+    if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~')
+    {
+      ret += static_cast<char>(c);
+    }
+    else
+    {
+      ret += '%';
+      ret += hex[c >> 4];
+      ret += hex[c & 0xf];
+    }
+  }
+  return ret;
+}
+
+// value of x-ms-range for length bytes from offset
+std::string range_header(size_t offset, size_t length)
+{
+  return "bytes=" + std::to_string(offset) + "-" + std::to_string(offset + length - 1);
+}
+
+// Receives a ranged download into the caller's buffer.
+class span_sink : public download_sink {
+public:
+  span_sink(uint8_t* buffer, size_t size) : m_buffer(buffer), m_size(size) {}
+
+  uint8_t* contiguous_buffer(size_t) override { return m_buffer; }
+  uint8_t* prepare(size_t& size) override
+  {
+    if (m_offset == m_size)
+    {
+      throw std::runtime_error("response is longer than the requested range");
+    }
+    size = m_size - m_offset;
+    return m_buffer + m_offset;
+  }
+  void commit(size_t size) override { m_offset += size; }
+
+private:
+  uint8_t* m_buffer;
+  size_t m_size;
+  size_t m_offset = 0;
+};
+
+size_t write_callback(char* data, size_t size, size_t count, void* user_data)
+{
+  auto r = static_cast<curl_multi_transport::request*>(user_data);
+  const size_t length = size * count;
+  r->received += length;
+
+  long status = 0;
+  curl_easy_getinfo(r->handle, CURLINFO_RESPONSE_CODE, &status);
+  if (status != r->expected_status || !r->sink)
+  {
+    r->error_body.append(data, std::min<size_t>(length, 4096));
+    return length;
+  }
+  try
+  {
+    r->sink->write(reinterpret_cast<const uint8_t*>(data), length);
+  }
+  catch (...)
+  {
+    r->exception = std::current_exception();
+    return 0;
+  }
+  return length;
+}
+
+size_t read_callback(char* data, size_t size, size_t count, void* user_data)
+{
+  auto r = static_cast<curl_multi_transport::request*>(user_data);
+  const size_t length = std::min(size * count, r->upload_size - r->upload_offset);
+  std::memcpy(data, r->upload_data + r->upload_offset, length);
+  r->upload_offset += length;
+  return length;
+}
+
+// curl rewinds the body when it resends a request on a connection the server has closed
+int seek_callback(void* user_data, curl_off_t offset, int origin)
+{
+  auto r = static_cast<curl_multi_transport::request*>(user_data);
+  if (origin != SEEK_SET || offset < 0 || static_cast<size_t>(offset) > r->upload_size)
+  {
+    return CURL_SEEKFUNC_CANTSEEK;
+  }
+  r->upload_offset = static_cast<size_t>(offset);
+  return CURL_SEEKFUNC_OK;
+}
+
+// sizes the socket buffers of a new connection, clientp is the transport_tuning
+int sockopt_callback(void* clientp, curl_socket_t socket, curlsocktype purpose)
+{
+  const auto& tuning = *static_cast<const transport_tuning*>(clientp);
+  if (purpose != CURLSOCKTYPE_IPCXN)
+  {
+    return CURL_SOCKOPT_OK;
+  }
+  auto set_buffer = [socket](int option, int64_t size) {
+    if (size > 0)
+    {
+      const int value = static_cast<int>(std::min<int64_t>(size, INT32_MAX));
+      setsockopt(socket, SOL_SOCKET, option, reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+  };
+  set_buffer(SO_SNDBUF, tuning.socket_send_buffer);
+  set_buffer(SO_RCVBUF, tuning.socket_receive_buffer);
+  return CURL_SOCKOPT_OK;
+}
+
+} // namespace
+
+class curl_multi_transport::event_loop {
+public:
+  // a max_connections of 0 doesn't limit connections
+  event_loop(const transport_tuning& tuning, long max_connections);
+  event_loop(const event_loop&) = delete;
+  event_loop& operator=(const event_loop&) = delete;
+  // requests still in flight fail
+  ~event_loop();
+
+  void submit(std::unique_ptr<request> request);
+
+private:
+  void run();
+  void start(std::unique_ptr<request> request);
+  void finish(CURL* handle, CURLcode result);
+  static void record_phases(CURL* handle, bool has_body);
+  static void complete(std::unique_ptr<request> request, std::exception_ptr exception);
+
+  const transport_tuning m_tuning;
+  CURLM* m_multi;
+  std::vector<CURL*> m_idle_handles;
+  std::set<CURL*> m_active_handles;
+
+  std::mutex m_lock;
+  std::vector<std::unique_ptr<request>> m_submitted;
+  bool m_stopped = false;
+  std::thread m_thread;
+};
+
+curl_multi_transport::event_loop::event_loop(const transport_tuning& tuning, long max_connections)
+    : m_tuning(tuning), m_multi(curl_multi_init())
+{
+  if (!m_multi)
+  {
+    throw std::runtime_error("failed to create curl multi handle");
+  }
+  if (max_connections > 0)
+  {
+    // further requests wait for a connection of the pool to become idle
+    curl_multi_setopt(m_multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, max_connections);
+    curl_multi_setopt(m_multi, CURLMOPT_MAXCONNECTS, max_connections);
+  }
+  m_thread = std::thread(&event_loop::run, this);
+}
+
+curl_multi_transport::event_loop::~event_loop()
+{
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_stopped = true;
+  }
+  curl_multi_wakeup(m_multi);
+  m_thread.join();
+
+  std::vector<std::unique_ptr<request>> abandoned;
+  abandoned.swap(m_submitted);
+  for (CURL* handle : m_active_handles)
+  {
+    char* r = nullptr;
+    curl_easy_getinfo(handle, CURLINFO_PRIVATE, &r);
+    abandoned.emplace_back(reinterpret_cast<request*>(r));
+    curl_multi_remove_handle(m_multi, handle);
+    m_idle_handles.push_back(handle);
+  }
+  for (CURL* handle : m_idle_handles)
+  {
+    curl_easy_cleanup(handle);
+  }
+  curl_multi_cleanup(m_multi);
+  for (auto& r : abandoned)
+  {
+    complete(
+        std::move(r),
+        std::make_exception_ptr(std::runtime_error("request abandoned by transport reset")));
+  }
+}
+
+void curl_multi_transport::event_loop::submit(std::unique_ptr<request> r)
+{
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    if (!m_stopped)
+    {
+      m_submitted.push_back(std::move(r));
+    }
+  }
+  if (r)
+  {
+    complete(
+        std::move(r),
+        std::make_exception_ptr(std::runtime_error("request submitted to a stopped transport")));
+    return;
+  }
+  curl_multi_wakeup(m_multi);
+}
+
+void curl_multi_transport::event_loop::run()
+{
+  while (true)
+  {
+    std::vector<std::unique_ptr<request>> submitted;
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      if (m_stopped)
+      {
+        break;
+      }
+      submitted.swap(m_submitted);
+    }
+    for (auto& r : submitted)
+    {
+      start(std::move(r));
+    }
+
+    int running = 0;
+    curl_multi_perform(m_multi, &running);
+    int num_messages = 0;
+    while (CURLMsg* message = curl_multi_info_read(m_multi, &num_messages))
+    {
+      if (message->msg == CURLMSG_DONE)
+      {
+        finish(message->easy_handle, message->data.result);
+      }
+    }
+    // returns early on socket activity or curl_multi_wakeup()
+    curl_multi_poll(m_multi, nullptr, 0, 1000, nullptr);
+  }
+}
+
+void curl_multi_transport::event_loop::start(std::unique_ptr<request> r)
+{
+  CURL* handle;
+  if (m_idle_handles.empty())
+  {
+    handle = curl_easy_init();
+    if (!handle)
+    {
+      complete(
+          std::move(r),
+          std::make_exception_ptr(std::runtime_error("failed to create curl easy handle")));
+      return;
+    }
+  }
+  else
+  {
+    // connections are cached by the multi handle, not by easy handles
+    handle = m_idle_handles.back();
+    m_idle_handles.pop_back();
+    curl_easy_reset(handle);
+  }
+  r->handle = handle;
+  curl_easy_setopt(handle, CURLOPT_URL, r->url.data());
+  curl_easy_setopt(handle, CURLOPT_HTTPHEADER, r->header_list);
+  curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, write_callback);
+  curl_easy_setopt(handle, CURLOPT_WRITEDATA, r.get());
+  if (r->method == "PUT")
+  {
+    curl_easy_setopt(handle, CURLOPT_UPLOAD, 1L);
+    curl_easy_setopt(handle, CURLOPT_READFUNCTION, read_callback);
+    curl_easy_setopt(handle, CURLOPT_READDATA, r.get());
+    curl_easy_setopt(handle, CURLOPT_SEEKFUNCTION, seek_callback);
+    curl_easy_setopt(handle, CURLOPT_SEEKDATA, r.get());
+    curl_easy_setopt(handle, CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(r->upload_size));
+  }
+  else if (r->method == "HEAD")
+  {
+    curl_easy_setopt(handle, CURLOPT_NOBODY, 1L);
+  }
+  if (m_tuning.tcp_nodelay >= 0)
+  {
+    curl_easy_setopt(handle, CURLOPT_TCP_NODELAY, static_cast<long>(m_tuning.tcp_nodelay));
+  }
+  if (m_tuning.socket_send_buffer > 0 || m_tuning.socket_receive_buffer > 0)
+  {
+    curl_easy_setopt(handle, CURLOPT_SOCKOPTFUNCTION, sockopt_callback);
+    curl_easy_setopt(handle, CURLOPT_SOCKOPTDATA, &m_tuning);
+  }
+  if (m_tuning.http_version == "1.1")
+  {
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+  }
+  else if (m_tuning.http_version == "2")
+  {
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+  }
+  if (m_tuning.tls_session_reuse >= 0)
+  {
+    curl_easy_setopt(
+        handle, CURLOPT_SSL_SESSIONID_CACHE, static_cast<long>(m_tuning.tls_session_reuse));
+  }
+  if (m_tuning.receive_buffer > 0)
+  {
+    curl_easy_setopt(handle, CURLOPT_BUFFERSIZE, static_cast<long>(m_tuning.receive_buffer));
+  }
+  curl_easy_setopt(handle, CURLOPT_PRIVATE, r.get());
+  curl_multi_add_handle(m_multi, handle);
+  m_active_handles.insert(handle);
+  r.release();
+}
+
+void curl_multi_transport::event_loop::finish(CURL* handle, CURLcode result)
+{
+  char* private_data = nullptr;
+  curl_easy_getinfo(handle, CURLINFO_PRIVATE, &private_data);
+  std::unique_ptr<request> r(reinterpret_cast<request*>(private_data));
+  long status = 0;
+  curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+  curl_multi_remove_handle(m_multi, handle);
+  m_active_handles.erase(handle);
+  m_idle_handles.push_back(handle);
+
+  if (result == CURLE_OK)
+  {
+    record_phases(handle, r->received != 0);
+  }
+
+  // an exception thrown by the sink takes precedence over the CURLE_WRITE_ERROR it causes
+  std::exception_ptr exception = r->exception;
+  if (!exception && result != CURLE_OK)
+  {
+    exception = std::make_exception_ptr(std::runtime_error(
+        r->method + " " + r->url + " failed: " + curl_easy_strerror(result)));
+  }
+  else if (!exception && status != r->expected_status)
+  {
+    exception = std::make_exception_ptr(std::runtime_error(
+        r->method + " " + r->url + " failed with HTTP status " + std::to_string(status) + " "
+        + r->error_body));
+  }
+  else if (!exception && r->expected_length != 0 && r->received != r->expected_length)
+  {
+    exception = std::make_exception_ptr(std::runtime_error(
+        r->method + " " + r->url + " received " + std::to_string(r->received) + " of "
+        + std::to_string(r->expected_length) + " bytes"));
+  }
+  complete(std::move(r), exception);
+}
+
+void curl_multi_transport::event_loop::record_phases(CURL* handle, bool has_body)
+{
+  // microseconds from the start of the transfer
+  curl_off_t connect = 0;
+  curl_off_t tls = 0;
+  curl_off_t pretransfer = 0;
+  curl_off_t first_byte = 0;
+  curl_off_t total = 0;
+  long num_connects = 0;
+  curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &connect);
+  curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &tls);
+  curl_easy_getinfo(handle, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+  curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &first_byte);
+  curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &total);
+  curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &num_connects);
+
+  using std::chrono::microseconds;
+  if (num_connects != 0)
+  {
+    // name resolution is counted as part of connecting
+    record_request_phase(request_phase::connect, microseconds(connect));
+    if (tls != 0)
+    {
+      record_request_phase(request_phase::tls, microseconds(tls - connect));
+    }
+  }
+  record_request_phase(request_phase::first_byte, microseconds(first_byte - pretransfer));
+  if (has_body)
+  {
+    record_request_phase(request_phase::body, microseconds(total - first_byte));
+  }
+}
+
+void curl_multi_transport::event_loop::complete(
+    std::unique_ptr<request> r,
+    std::exception_ptr exception)
+{
+  auto on_done = std::move(r->on_done);
+  r.reset();
+  try
+  {
+    on_done(exception);
+  }
+  catch (std::exception& e)
+  {
+    spdlog::error("completion handler threw: {}", e.what());
+  }
+}
+
+curl_multi_transport::curl_multi_transport(int num_event_loops, const transport_tuning& tuning)
+    : async_transport("curl-multi" + to_string(tuning)),
+      m_num_event_loops(std::max(num_event_loops, 1)), m_tuning(tuning)
+{
+  m_blob_endpoint = get_blob_endpoint_from_connection_string();
+  while (!m_blob_endpoint.empty() && m_blob_endpoint.back() == '/')
+  {
+    m_blob_endpoint.pop_back();
+  }
+  const auto scheme_end = m_blob_endpoint.find("://");
+  const auto path_begin = m_blob_endpoint.find(
+      '/', scheme_end == std::string::npos ? 0 : scheme_end + 3);
+  if (path_begin != std::string::npos)
+  {
+    m_endpoint_path = m_blob_endpoint.substr(path_begin);
+  }
+  m_account_name = get_account_name_from_connection_string();
+  m_account_key = Azure::Core::Convert::Base64Decode(get_access_key_from_connection_string());
+  reset(0);
+}
+
+curl_multi_transport::~curl_multi_transport() {}
+
+void curl_multi_transport::reset(int)
+{
+  // new multi handles, so no connection is reused across cases
+  m_event_loops.clear();
+  for (int i = 0; i < m_num_event_loops; ++i)
+  {
+    // the pool is split evenly between the event loops, each has its own connection cache, the
+    // settings reject pool sizes that are not a multiple of their number
+    const long max_connections = m_tuning.connection_pool_size > 0
+        ? std::max(1L, static_cast<long>(m_tuning.connection_pool_size) / m_num_event_loops)
+        : 0;
+    m_event_loops.push_back(std::make_unique<event_loop>(m_tuning, max_connections));
+  }
+}
+
+std::unique_ptr<curl_multi_transport::request> curl_multi_transport::make_request(
+    const std::string& method,
+    const std::string& blob_name,
+    std::vector<std::pair<std::string, std::string>> query,
+    std::vector<std::pair<std::string, std::string>> headers,
+    int expected_status) const
+{
+  auto r = std::make_unique<request>();
+  r->method = method;
+  r->expected_status = expected_status;
+  r->headers = std::move(headers);
+
+  const std::string path = "/" + settings().container_name + "/" + blob_name;
+  r->url = m_blob_endpoint + path;
+  r->canonicalized_resource = "/" + m_account_name + m_endpoint_path + path;
+  std::sort(query.begin(), query.end());
+  for (size_t i = 0; i < query.size(); ++i)
+  {
+    r->url += (i == 0 ? "?" : "&") + query[i].first + "=" + url_encode(query[i].second);
+    r->canonicalized_resource += "\n" + query[i].first + ":" + query[i].second;
+  }
+  return r;
+}
+
+void curl_multi_transport::submit(std::unique_ptr<request> r, completion_handler on_done)
+{
+  const auto sign_start = std::chrono::steady_clock::now();
+  record_request_phase(request_phase::build, sign_start - r->created);
+
+  // Shared Key authorization, every standard header we don't send is an empty line
+  r->headers.emplace_back(
+      "x-ms-date",
+      Azure::DateTime(std::chrono::system_clock::now())
+          .ToString(Azure::DateTime::DateFormat::Rfc1123));
+  r->headers.emplace_back("x-ms-version", storage_api_version);
+  std::sort(r->headers.begin(), r->headers.end());
+  std::string string_to_sign = r->method + "\n\n\n"
+      + (r->upload_size == 0 ? std::string() : std::to_string(r->upload_size))
+      + "\n\n\n\n\n\n\n\n\n";
+  for (const auto& h : r->headers)
+  {
+    string_to_sign += h.first + ":" + h.second + "\n";
+  }
+  string_to_sign += r->canonicalized_resource;
+
+  CryptoPP::HMAC<CryptoPP::SHA256> hmac(m_account_key.data(), m_account_key.size());
+  hmac.Update(
+      reinterpret_cast<const CryptoPP::byte*>(string_to_sign.data()), string_to_sign.length());
+  std::vector<uint8_t> signature(hmac.DigestSize());
+  hmac.Final(signature.data());
+
+  for (const auto& h : r->headers)
+  {
+    r->header_list = curl_slist_append(r->header_list, (h.first + ": " + h.second).data());
+  }
+  r->header_list = curl_slist_append(
+      r->header_list,
+      ("Authorization: SharedKey " + m_account_name + ":"
+       + Azure::Core::Convert::Base64Encode(signature))
+          .data());
+  // no 100-continue round trip before uploads
+  r->header_list = curl_slist_append(r->header_list, "Expect:");
+  record_request_phase(request_phase::sign, std::chrono::steady_clock::now() - sign_start);
+
+  r->on_done = std::move(on_done);
+  const size_t i = m_next_event_loop.fetch_add(1) % m_event_loops.size();
+  m_event_loops[i]->submit(std::move(r));
+}
+
+void curl_multi_transport::run_pipeline(
+    size_t num_requests,
+    int concurrency,
+    const std::function<std::unique_ptr<request>(size_t)>& make)
+{
+  std::mutex lock;
+  std::condition_variable cv;
+  int in_flight = 0;
+  std::exception_ptr exception;
+
+  std::unique_lock<std::mutex> guard(lock);
+  for (size_t i = 0; i < num_requests; ++i)
+  {
+    cv.wait(guard, [&]() { return in_flight < concurrency || exception; });
+    if (exception)
+    {
+      break;
+    }
+    ++in_flight;
+    guard.unlock();
+    try
+    {
+      submit(make(i), [&](std::exception_ptr e) {
+        std::lock_guard<std::mutex> g(lock);
+        if (e && !exception)
+        {
+          exception = e;
+        }
+        --in_flight;
+        cv.notify_all();
+      });
+    }
+    catch (std::exception&)
+    {
+      // the request never got to an event loop, but those that did still refer to this frame
+      guard.lock();
+      if (!exception)
+      {
+        exception = std::current_exception();
+      }
+      --in_flight;
+      break;
+    }
+    guard.lock();
+  }
+  cv.wait(guard, [&]() { return in_flight == 0; });
+  if (exception)
+  {
+    std::rethrow_exception(exception);
+  }
+}
+
+void curl_multi_transport::download_blob(
+    const std::string& blob_name,
+    download_sink& sink,
+    size_t blob_size)
+{
+  run_pipeline(1, 1, [&](size_t) {
+    auto r = make_request("GET", blob_name, {}, {}, 200);
+    r->sink = &sink;
+    r->expected_length = blob_size;
+    return r;
+  });
+}
+
+void curl_multi_transport::upload_blob(
+    const std::string& blob_name,
+    const uint8_t* buffer,
+    size_t blob_size)
+{
+  run_pipeline(1, 1, [&](size_t) {
+    std::vector<std::pair<std::string, std::string>> headers{{"x-ms-blob-type", "BlockBlob"}};
+    for (const auto& m : m_upload_metadata)
+    {
+      headers.emplace_back("x-ms-meta-" + m.first, m.second);
+    }
+    auto r = make_request("PUT", blob_name, {}, std::move(headers), 201);
+    r->upload_data = buffer;
+    r->upload_size = blob_size;
+    return r;
+  });
+}
+
+void curl_multi_transport::download_range(
+    const std::string& blob_name,
+    download_sink& sink,
+    size_t offset,
+    size_t length)
+{
+  run_pipeline(1, 1, [&](size_t) {
+    auto r = make_request(
+        "GET", blob_name, {}, {{"x-ms-range", range_header(offset, length)}}, 206);
+    r->sink = &sink;
+    r->expected_length = length;
+    return r;
+  });
+}
+
+void curl_multi_transport::get_blob_properties(const std::string& blob_name)
+{
+  run_pipeline(1, 1, [&](size_t) { return make_request("HEAD", blob_name, {}, {}, 200); });
+}
+
+void curl_multi_transport::download_blob_parallel(
+    const std::string& blob_name,
+    uint8_t* buffer,
+    size_t blob_size,
+    size_t chunk_size,
+    int concurrency)
+{
+  const size_t num_chunks = (blob_size + chunk_size - 1) / chunk_size;
+  run_pipeline(num_chunks, concurrency, [&](size_t i) {
+    const size_t offset = i * chunk_size;
+    const size_t length = std::min(chunk_size, blob_size - offset);
+    auto r = make_request(
+        "GET", blob_name, {}, {{"x-ms-range", range_header(offset, length)}}, 206);
+    r->owned_sink = std::make_unique<span_sink>(buffer + offset, length);
+    r->sink = r->owned_sink.get();
+    r->expected_length = length;
+    return r;
+  });
+}
+
+void curl_multi_transport::upload_blob_parallel(
+    const std::string& blob_name,
+    const uint8_t* buffer,
+    size_t blob_size,
+    size_t chunk_size,
+    int concurrency)
+{
+  if (blob_size <= chunk_size)
+  {
+    upload_blob(blob_name, buffer, blob_size);
+    return;
+  }
+
+  stage_blocks(blob_name, buffer, blob_size, chunk_size, concurrency);
+  commit_blocks(blob_name, (blob_size + chunk_size - 1) / chunk_size);
+}
+
+void curl_multi_transport::stage_blocks(
+    const std::string& blob_name,
+    const uint8_t* buffer,
+    size_t blob_size,
+    size_t block_size,
+    int concurrency)
+{
+  const size_t num_blocks = (blob_size + block_size - 1) / block_size;
+  run_pipeline(num_blocks, concurrency, [&](size_t i) {
+    const size_t offset = i * block_size;
+    auto r = make_request(
+        "PUT",
+        blob_name,
+        {{"comp", "block"}, {"blockid", get_block_id(static_cast<int>(i))}},
+        {},
+        201);
+    r->upload_data = buffer + offset;
+    r->upload_size = std::min(block_size, blob_size - offset);
+    return r;
+  });
+}
+
+void curl_multi_transport::commit_blocks(const std::string& blob_name, size_t num_blocks)
+{
+  run_pipeline(1, 1, [&](size_t) {
+    auto r = make_request("PUT", blob_name, {{"comp", "blocklist"}}, {}, 201);
+    r->body = "<?xml version=\"1.0\" encoding=\"utf-8\"?><BlockList>";
+    for (size_t i = 0; i < num_blocks; ++i)
+    {
+      r->body += "<Uncommitted>" + get_block_id(static_cast<int>(i)) + "</Uncommitted>";
+    }
+    r->body += "</BlockList>";
+    r->upload_data = reinterpret_cast<const uint8_t*>(r->body.data());
+    r->upload_size = r->body.length();
+    return r;
+  });
+}
+
+void curl_multi_transport::download_blob_async(
+    const std::string& blob_name,
+    download_sink& sink,
+    size_t blob_size,
+    completion_handler on_done)
+{
+  auto r = make_request("GET", blob_name, {}, {}, 200);
+  r->sink = &sink;
+  r->expected_length = blob_size;
+  submit(std::move(r), std::move(on_done));
+}
+
+void curl_multi_transport::upload_blob_async(
+    const std::string& blob_name,
+    const uint8_t* buffer,
+    size_t blob_size,
+    completion_handler on_done)
+{
+  auto r = make_request("PUT", blob_name, {}, {{"x-ms-blob-type", "BlockBlob"}}, 201);
+  r->upload_data = buffer;
+  r->upload_size = blob_size;
+  submit(std::move(r), std::move(on_done));
+}
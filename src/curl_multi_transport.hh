@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "transport.hh"
+
+/*
+ * Talks to the Blob service over plain libcurl instead of an SDK. Every request is driven by one
+ * of num_event_loops threads, each running a curl multi handle, so the number of requests in
+ * flight doesn't depend on the number of threads. Requests are signed locally with the account key
+ * from the connection string. Blocking calls submit requests and wait for them, so the transport
+ * also runs the thread-per-request cases.
+ */
+class curl_multi_transport : public async_transport {
+public:
+  explicit curl_multi_transport(
+      int num_event_loops = 1,
+      const transport_tuning& tuning = transport_tuning());
+  ~curl_multi_transport();
+
+  void reset(int concurrency) override;
+  void download_blob(const std::string& blob_name, download_sink& sink, size_t blob_size) override;
+  void upload_blob(const std::string& blob_name, const uint8_t* buffer, size_t blob_size) override;
+  void download_range(
+      const std::string& blob_name,
+      download_sink& sink,
+      size_t offset,
+      size_t length) override;
+  void get_blob_properties(const std::string& blob_name) override;
+  void download_blob_parallel(
+      const std::string& blob_name,
+      uint8_t* buffer,
+      size_t blob_size,
+      size_t chunk_size,
+      int concurrency) override;
+  void upload_blob_parallel(
+      const std::string& blob_name,
+      const uint8_t* buffer,
+      size_t blob_size,
+      size_t chunk_size,
+      int concurrency) override;
+  void stage_blocks(
+      const std::string& blob_name,
+      const uint8_t* buffer,
+      size_t blob_size,
+      size_t block_size,
+      int concurrency) override;
+  void commit_blocks(const std::string& blob_name, size_t num_blocks) override;
+  void download_blob_async(
+      const std::string& blob_name,
+      download_sink& sink,
+      size_t blob_size,
+      completion_handler on_done) override;
+  void upload_blob_async(
+      const std::string& blob_name,
+      const uint8_t* buffer,
+      size_t blob_size,
+      completion_handler on_done) override;
+
+  struct request;
+
+private:
+  class event_loop;
+
+  std::unique_ptr<request> make_request(
+      const std::string& method,
+      const std::string& blob_name,
+      std::vector<std::pair<std::string, std::string>> query,
+      std::vector<std::pair<std::string, std::string>> headers,
+      int expected_status) const;
+  void submit(std::unique_ptr<request> request, completion_handler on_done);
+  // Issues requests make(0), ..., make(num_requests - 1) with up to concurrency in flight and
+  // waits for all of them, the first failure is rethrown.
+  void run_pipeline(
+      size_t num_requests,
+      int concurrency,
+      const std::function<std::unique_ptr<request>(size_t)>& make);
+
+  int m_num_event_loops;
+  transport_tuning m_tuning;
+  std::vector<std::unique_ptr<event_loop>> m_event_loops;
+  std::atomic<size_t> m_next_event_loop{0};
+
+  std::string m_blob_endpoint;
+  // path of m_blob_endpoint, e.g. /devstoreaccount1 for path-style endpoints
+  std::string m_endpoint_path;
+  std::string m_account_name;
+  std::vector<uint8_t> m_account_key;
+};
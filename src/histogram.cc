@@ -0,0 +1,131 @@
+#include "histogram.hh"
+
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr int sub_bucket_bits = 7;
+constexpr uint64_t sub_bucket_count = uint64_t(1) << sub_bucket_bits;
+constexpr uint64_t sub_bucket_half_count = sub_bucket_count / 2;
+constexpr size_t bucket_array_size = (64 - sub_bucket_bits + 1) * sub_bucket_half_count
+    + sub_bucket_half_count;
+
+int most_significant_bit(uint64_t value)
+{
+#ifdef _WIN32
+  unsigned long index;
+  _BitScanReverse64(&index, value);
+  return static_cast<int>(index);
+#else
+  return 63 - __builtin_clzll(value);
+#endif
+}
+
+} // namespace
+
+latency_histogram::latency_histogram() : m_counts(bucket_array_size, 0) {}
+
+size_t latency_histogram::index_of(uint64_t value)
+{
+  if (value < sub_bucket_count)
+  {
+    return static_cast<size_t>(value);
+  }
+  // keep the 7 most significant bits, top is in [64, 128)
+  const int shift = most_significant_bit(value) - (sub_bucket_bits - 1);
+  const uint64_t top = value >> shift;
+  return static_cast<size_t>(shift * sub_bucket_half_count + top);
+}
+
+uint64_t latency_histogram::highest_equivalent_value(size_t index)
+{
+  if (index < sub_bucket_count)
+  {
+    return index;
+  }
+  const uint64_t shift = index / sub_bucket_half_count - 1;
+  const uint64_t top = index - shift * sub_bucket_half_count;
+  return ((top + 1) << shift) - 1;
+}
+
+void latency_histogram::record(std::chrono::nanoseconds value)
+{
+  const uint64_t v = value.count() > 0 ? static_cast<uint64_t>(value.count()) : 0;
+  ++m_counts[index_of(v)];
+  ++m_count;
+  m_min = std::min(m_min, v);
+  m_max = std::max(m_max, v);
+  m_sum += static_cast<double>(v);
+}
+
+void latency_histogram::merge(const latency_histogram& other)
+{
+  for (size_t i = 0; i < m_counts.size(); ++i)
+  {
+    m_counts[i] += other.m_counts[i];
+  }
+  m_count += other.m_count;
+  m_min = std::min(m_min, other.m_min);
+  m_max = std::max(m_max, other.m_max);
+  m_sum += other.m_sum;
+}
+
+void latency_histogram::reset()
+{
+  std::fill(m_counts.begin(), m_counts.end(), uint64_t(0));
+  m_count = 0;
+  m_min = UINT64_MAX;
+  m_max = 0;
+  m_sum = 0.0;
+}
+
+std::chrono::nanoseconds latency_histogram::min() const
+{
+  return std::chrono::nanoseconds(m_count == 0 ? 0 : m_min);
+}
+
+std::chrono::nanoseconds latency_histogram::mean() const
+{
+  return std::chrono::nanoseconds(
+      m_count == 0 ? 0 : static_cast<int64_t>(m_sum / static_cast<double>(m_count)));
+}
+
+std::chrono::nanoseconds latency_histogram::percentile(double percentile) const
+{
+  if (m_count == 0)
+  {
+    return std::chrono::nanoseconds(0);
+  }
+  percentile = std::min(std::max(percentile, 0.0), 100.0);
+  const uint64_t target = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(m_count))));
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < m_counts.size(); ++i)
+  {
+    cumulative += m_counts[i];
+    if (cumulative >= target)
+    {
+      return std::chrono::nanoseconds(std::min(highest_equivalent_value(i), m_max));
+    }
+  }
+  return std::chrono::nanoseconds(m_max);
+}
+
+latency_summary latency_summary::from(const latency_histogram& histogram)
+{
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+
+  latency_summary s;
+  s.p50 = duration_cast<microseconds>(histogram.percentile(50.0));
+  s.p90 = duration_cast<microseconds>(histogram.percentile(90.0));
+  s.p99 = duration_cast<microseconds>(histogram.percentile(99.0));
+  s.p999 = duration_cast<microseconds>(histogram.percentile(99.9));
+  s.max = duration_cast<microseconds>(histogram.max());
+  return s;
+}
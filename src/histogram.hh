@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Log-linear latency histogram in the spirit of HdrHistogram: values below 128ns are counted
+ * exactly, larger values fall into one of 64 linear sub-buckets per power of two, which bounds the
+ * relative error of every reported percentile to 1/64. Recording is not synchronized, each worker
+ * thread records into its own instance and the instances are merged once the threads are joined.
+ */
+class latency_histogram {
+public:
+  latency_histogram();
+
+  void record(std::chrono::nanoseconds value);
+  void merge(const latency_histogram& other);
+  void reset();
+
+  uint64_t count() const { return m_count; }
+  std::chrono::nanoseconds min() const;
+  std::chrono::nanoseconds max() const { return std::chrono::nanoseconds(m_max); }
+  std::chrono::nanoseconds mean() const;
+  // percentile in [0, 100]
+  std::chrono::nanoseconds percentile(double percentile) const;
+
+private:
+  static size_t index_of(uint64_t value);
+  static uint64_t highest_equivalent_value(size_t index);
+
+  std::vector<uint64_t> m_counts;
+  uint64_t m_count = 0;
+  uint64_t m_min = UINT64_MAX;
+  uint64_t m_max = 0;
+  double m_sum = 0.0;
+};
+
+struct latency_summary
+{
+  std::chrono::microseconds p50{0};
+  std::chrono::microseconds p90{0};
+  std::chrono::microseconds p99{0};
+  std::chrono::microseconds p999{0};
+  std::chrono::microseconds max{0};
+
+  static latency_summary from(const latency_histogram& histogram);
+};
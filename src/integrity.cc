@@ -0,0 +1,123 @@
+#include "integrity.hh"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <azure/storage/common/crypt.hpp>
+
+namespace {
+
+hash_algorithm hash_of(verification method)
+{
+  switch (method)
+  {
+    case verification::md5:
+      return hash_algorithm::md5;
+    case verification::crc64:
+      return hash_algorithm::crc64;
+    case verification::none:
+    case verification::compare:
+      break;
+  }
+  return hash_algorithm::none;
+}
+
+} // namespace
+
+std::string to_string(verification method)
+{
+  switch (method)
+  {
+    case verification::none:
+      return "none";
+    case verification::compare:
+      return "compare";
+    case verification::crc64:
+      return "crc64";
+    case verification::md5:
+      return "md5";
+  }
+  return "unknown";
+}
+
+std::string to_string(hash_algorithm hash)
+{
+  switch (hash)
+  {
+    case hash_algorithm::none:
+      return "none";
+    case hash_algorithm::md5:
+      return "md5";
+    case hash_algorithm::crc64:
+      return "crc64";
+  }
+  return "unknown";
+}
+
+std::unique_ptr<Azure::Core::Cryptography::Hash> make_hash(hash_algorithm hash)
+{
+  switch (hash)
+  {
+    case hash_algorithm::md5:
+      return std::make_unique<Azure::Core::Cryptography::Md5Hash>();
+    case hash_algorithm::crc64:
+      return std::make_unique<Azure::Storage::Crc64Hash>();
+    case hash_algorithm::none:
+      break;
+  }
+  return nullptr;
+}
+
+expected_content::expected_content(verification method, std::vector<uint8_t> content)
+    : m_method(method), m_size(content.size())
+{
+  if (auto hash = make_hash(hash_of(method)))
+  {
+    m_hash = hash->Final(content.data(), content.size());
+  }
+  else if (method == verification::compare)
+  {
+    m_content = std::move(content);
+  }
+}
+
+content_checker::content_checker(const expected_content& expected)
+    : m_expected(expected), m_hash(make_hash(hash_of(expected.m_method)))
+{
+}
+
+void content_checker::update(const uint8_t* data, size_t size)
+{
+  if (m_offset + size > m_expected.m_size)
+  {
+    m_mismatch = true;
+  }
+  else if (m_hash)
+  {
+    m_hash->Append(data, size);
+  }
+  else if (m_expected.m_method == verification::compare)
+  {
+    m_mismatch = m_mismatch || std::memcmp(data, m_expected.m_content.data() + m_offset, size) != 0;
+  }
+  m_offset += size;
+}
+
+void content_checker::finish()
+{
+  bool mismatch = m_mismatch || m_offset != m_expected.m_size;
+  if (m_hash)
+  {
+    mismatch = mismatch || m_hash->Final() != m_expected.m_hash;
+    m_hash = make_hash(hash_of(m_expected.m_method));
+  }
+  const size_t received = m_offset;
+  m_offset = 0;
+  m_mismatch = false;
+  if (mismatch && m_expected.m_method != verification::none)
+  {
+    throw std::runtime_error(
+        "downloaded content failed " + to_string(m_expected.m_method) + " verification, received "
+        + std::to_string(received) + " of " + std::to_string(m_expected.m_size) + " bytes");
+  }
+}
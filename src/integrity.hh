@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <azure/core/cryptography/hash.hpp>
+
+// How downloaded content is checked against the content the blob was created with.
+enum class verification
+{
+  none,
+  // byte by byte against a copy of the expected content
+  compare,
+  // streaming checksums compared with the checksum of the expected content
+  crc64,
+  md5,
+};
+
+// Transactional hashes are sent with every request for the service to check, Track2 only.
+enum class hash_algorithm
+{
+  none,
+  md5,
+  crc64,
+};
+
+std::string to_string(verification method);
+std::string to_string(hash_algorithm hash);
+
+// MD5 from azure-core or the CRC64 of azure-storage-common, nullptr for hash_algorithm::none
+std::unique_ptr<Azure::Core::Cryptography::Hash> make_hash(hash_algorithm hash);
+
+// What a downloaded blob has to look like, computed once per case.
+class expected_content {
+public:
+  expected_content(verification method, std::vector<uint8_t> content);
+
+  verification method() const { return m_method; }
+  size_t size() const { return m_size; }
+
+private:
+  friend class content_checker;
+
+  verification m_method;
+  size_t m_size;
+  // kept for verification::compare only
+  std::vector<uint8_t> m_content;
+  std::vector<uint8_t> m_hash;
+};
+
+// Checks one download at a time, the content has to be fed in order.
+class content_checker {
+public:
+  explicit content_checker(const expected_content& expected);
+
+  void update(const uint8_t* data, size_t size);
+  // Throws std::runtime_error if what was fed since the previous call isn't the expected content,
+  // then starts over.
+  void finish();
+
+private:
+  const expected_content& m_expected;
+  size_t m_offset = 0;
+  bool m_mismatch = false;
+  std::unique_ptr<Azure::Core::Cryptography::Hash> m_hash;
+};
@@ -1,5 +1,8 @@
 #include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
 #include <memory>
 #include <numeric>
 #include <random>
@@ -7,7 +10,13 @@
 #include <vector>
 
 #include "cases.hh"
-#include "constants.hh"
+#include "concurrency_sweep.hh"
+#include "memory_usage.hh"
+#include "mock_blob_server.hh"
+#include "network_proxy.hh"
+#include "repetition.hh"
+#include "results.hh"
+#include "settings.hh"
 #include "transport.hh"
 #include "utilities.hh"
 
@@ -18,102 +27,635 @@ struct benchmark_case
   std::shared_ptr<case_base> func;
 };
 
-void perform(const std::vector<benchmark_case>& benchmark_cases)
+struct trial
 {
-  std::vector<size_t> task_order;
-  for (size_t i = 0; i < benchmark_cases.size(); ++i)
+  transfer_result result;
+  std::chrono::system_clock::time_point start_time;
+  std::chrono::system_clock::time_point end_time;
+  int failed_attempts = 0;
+};
+
+// runs the case until it doesn't observe an exception, backing off after every failed attempt
+trial run_trial(benchmark_case casei)
+{
+  trial ret;
+  while (true)
+  {
+    casei.transport->set_transactional_hash(casei.transfer_config.transactional_hash);
+    ret.start_time = std::chrono::system_clock::now();
+    ret.result = (*casei.func)(*casei.transport, casei.transfer_config);
+    ret.end_time = std::chrono::system_clock::now();
+    if (!ret.result.exception_observed)
+    {
+      return ret;
+    }
+    const int sleep_seconds
+        = settings().exception_sleep_seconds * (1 << std::min(ret.failed_attempts, 3));
+    spdlog::warn(
+        "exception observed with {}, sleep {} seconds", casei.transport->name, sleep_seconds);
+    std::this_thread::sleep_for(std::chrono::seconds(sleep_seconds));
+    ++ret.failed_attempts;
+  }
+}
+
+void log_trial(const benchmark_case& casei, const transfer_result& result)
+{
+  spdlog::info(
+      "{} used {}ms to {} {} {}-byte blobs with {} threads",
+      casei.transport->name,
+      result.total_time_ms.count(),
+      casei.func->name,
+      casei.transfer_config.num_blobs,
+      casei.transfer_config.blob_size,
+      casei.transfer_config.concurrency);
+  spdlog::info(
+      "{} {} {}-byte blobs: {:.1f} ops/s, {:.0f} bytes/s, latency p50 {}us, p90 {}us, p99 "
+      "{}us, p99.9 {}us, max {}us",
+      casei.transport->name,
+      casei.func->name,
+      casei.transfer_config.blob_size,
+      result.ops_per_second,
+      result.bytes_per_second,
+      result.latency_percentiles.p50.count(),
+      result.latency_percentiles.p90.count(),
+      result.latency_percentiles.p99.count(),
+      result.latency_percentiles.p999.count(),
+      result.latency_percentiles.max.count());
+  if (result.retried_operations > 0)
+  {
+    spdlog::info(
+        "{} {} {}-byte blobs: {} failed attempts retried",
+        casei.transport->name,
+        casei.func->name,
+        casei.transfer_config.blob_size,
+        result.retried_operations);
+  }
+  const auto& cpu = result.cpu;
+  const auto operations = std::max<uint64_t>(result.latency.count(), 1);
+  std::string hardware_counters;
+  if (cpu.cycles >= 0 && cpu.instructions >= 0)
+  {
+    hardware_counters = fmt::format(
+        ", {:.2f} cycles/byte, {:.2f} instructions/cycle",
+        static_cast<double>(cpu.cycles)
+            / static_cast<double>(std::max<int64_t>(result.bytes_transferred, 1)),
+        static_cast<double>(cpu.instructions)
+            / static_cast<double>(std::max<int64_t>(cpu.cycles, 1)));
+  }
+  spdlog::info(
+      "{} {} {}-byte blobs: CPU {:.1f}us/op, user {}ms, system {}ms, workers {}ms, {} context "
+      "switches{}",
+      casei.transport->name,
+      casei.func->name,
+      casei.transfer_config.blob_size,
+      static_cast<double>(cpu.total_time().count()) / static_cast<double>(operations),
+      cpu.user_time.count() / 1000,
+      cpu.system_time.count() / 1000,
+      cpu.worker_time.count() / 1000,
+      std::max<int64_t>(cpu.voluntary_context_switches, 0)
+          + std::max<int64_t>(cpu.involuntary_context_switches, 0),
+      hardware_counters);
+  const auto& memory = result.memory;
+  if (memory.allocations >= 0)
+  {
+    spdlog::info(
+        "{} {} {}-byte blobs: {:.1f} allocations/op, {:.0f} bytes allocated/op, peak RSS {} MB",
+        casei.transport->name,
+        casei.func->name,
+        casei.transfer_config.blob_size,
+        static_cast<double>(memory.allocations) / static_cast<double>(operations),
+        static_cast<double>(memory.bytes_allocated) / static_cast<double>(operations),
+        memory.peak_rss / 1_MB);
+  }
+  else if (memory.peak_rss >= 0)
+  {
+    spdlog::info(
+        "{} {} {}-byte blobs: peak RSS {} MB",
+        casei.transport->name,
+        casei.func->name,
+        casei.transfer_config.blob_size,
+        memory.peak_rss / 1_MB);
+  }
+  if (!result.request_phases.empty())
   {
-    task_order.insert(task_order.end(), repeat, i);
+    std::string phases;
+    for (const auto& p : result.request_phases)
+    {
+      const auto summary = latency_summary::from(p.second);
+      phases += fmt::format(
+          "{}{} p50 {}us p99 {}us",
+          phases.empty() ? "" : ", ",
+          to_string(p.first),
+          summary.p50.count(),
+          summary.p99.count());
+    }
+    spdlog::info(
+        "{} {} {}-byte blobs: request phases {}",
+        casei.transport->name,
+        casei.func->name,
+        casei.transfer_config.blob_size,
+        phases);
   }
+  if (!result.stages.empty())
   {
-    std::random_device rd;
-    std::mt19937 g(rd());
+    std::string stages;
+    for (const auto& p : result.stages)
+    {
+      const auto summary = latency_summary::from(p.second);
+      stages += fmt::format(
+          "{}{} p50 {}us p99 {}us",
+          stages.empty() ? "" : ", ",
+          p.first,
+          summary.p50.count(),
+          summary.p99.count());
+    }
+    spdlog::info(
+        "{} {} {}-byte blobs: stages {}",
+        casei.transport->name,
+        casei.func->name,
+        casei.transfer_config.blob_size,
+        stages);
+  }
+  // the last sample is shorter than the interval and left out
+  if (result.timeline.size() > 1)
+  {
+    const double interval_seconds = std::chrono::duration<double>(result.sample_interval).count();
+    std::vector<double> rates;
+    int64_t peak_in_flight = 0;
+    for (size_t j = 0; j + 1 < result.timeline.size(); ++j)
+    {
+      rates.push_back(static_cast<double>(result.timeline[j].bytes) / interval_seconds);
+      peak_in_flight = std::max(peak_in_flight, result.timeline[j].in_flight);
+    }
+    std::sort(rates.begin(), rates.end());
+    const double mean
+        = std::accumulate(rates.begin(), rates.end(), 0.0) / static_cast<double>(rates.size());
+    double variance = 0.0;
+    for (double r : rates)
+    {
+      variance += (r - mean) * (r - mean);
+    }
+    variance /= static_cast<double>(rates.size());
+    spdlog::info(
+        "{} {} {}-byte blobs: {} samples of {}ms, bytes/s min {:.0f}, median {:.0f}, max "
+        "{:.0f}, coefficient of variation {:.2f}, peak in flight {}",
+        casei.transport->name,
+        casei.func->name,
+        casei.transfer_config.blob_size,
+        rates.size(),
+        result.sample_interval.count(),
+        rates.front(),
+        rates[rates.size() / 2],
+        rates.back(),
+        mean > 0 ? std::sqrt(variance) / mean : 0.0,
+        peak_in_flight);
+  }
+}
+
+nlohmann::json trial_record(
+    const benchmark_case& casei,
+    const trial& t,
+    const std::string& run_id,
+    int trial_index)
+{
+  nlohmann::json record = to_json(t.result);
+  record["type"] = "trial";
+  record["run_id"] = run_id;
+  record["transport"] = casei.transport->name;
+  record["case"] = casei.func->name;
+  record["transfer_config"] = to_json(casei.transfer_config);
+  record["trial"] = trial_index;
+  record["start_time"] = to_timestamp(t.start_time);
+  record["end_time"] = to_timestamp(t.end_time);
+  record["failed_attempts"] = t.failed_attempts;
+  return record;
+}
+
+// logs the throughput estimate of a cell whose trials are done and writes it as an estimate record
+void report_estimate(
+    const benchmark_case& casei,
+    const std::vector<double>& bytes_per_second,
+    const std::string& run_id,
+    results_writer& results)
+{
+  const auto& repetition = settings().repetition;
+  const auto estimate = estimate_throughput(bytes_per_second, repetition);
+  const bool converged = is_converged(estimate, bytes_per_second.size(), repetition);
+  spdlog::info(
+      "{} {} {}-byte blobs: {:.0f} bytes/s +/- {:.1f}% at {:.0f}% confidence over {} trials, {} "
+      "outliers{}",
+      casei.transport->name,
+      casei.func->name,
+      casei.transfer_config.blob_size,
+      estimate.mean,
+      estimate.relative_ci() * 100.0,
+      repetition.confidence * 100.0,
+      bytes_per_second.size(),
+      estimate.outliers.size(),
+      converged ? "" : ", inconclusive");
+
+  nlohmann::json record;
+  record["type"] = "estimate";
+  record["run_id"] = run_id;
+  record["transport"] = casei.transport->name;
+  record["case"] = casei.func->name;
+  record["transfer_config"] = to_json(casei.transfer_config);
+  record["trials"] = bytes_per_second.size();
+  record["bytes_per_second"] = estimate.mean;
+  // JSON has no infinity
+  record["ci_half_width"] = std::isfinite(estimate.ci_half_width)
+      ? nlohmann::json(estimate.ci_half_width)
+      : nlohmann::json();
+  record["confidence"] = repetition.confidence;
+  record["outliers"] = estimate.outliers;
+  record["converged"] = converged;
+  results.write(std::move(record));
+}
+
+/*
+ * Runs the cells in rounds, every round runs each remaining cell in shuffled order so that drift
+ * of the environment spreads over all cells. The first round runs every cell min_trials times,
+ * or repeat times without adaptive repetition. Later rounds run each cell whose confidence
+ * interval is still too wide once more, until it reaches max_trials.
+ */
+void perform(
+    const std::vector<benchmark_case>& benchmark_cases,
+    const std::string& run_id,
+    results_writer& results)
+{
+  const auto& repetition = settings().repetition;
+  std::vector<std::vector<double>> bytes_per_second(benchmark_cases.size());
+  std::vector<size_t> pending(benchmark_cases.size());
+  std::iota(pending.begin(), pending.end(), 0);
+  int round_trials = repetition.adaptive ? repetition.min_trials : settings().repeat;
+  std::random_device rd;
+  std::mt19937 g(rd());
+  while (!pending.empty())
+  {
+    std::vector<size_t> task_order;
+    for (auto i : pending)
+    {
+      task_order.insert(task_order.end(), round_trials, i);
+    }
     std::shuffle(task_order.begin(), task_order.end(), g);
+    for (auto i : task_order)
+    {
+      const auto& casei = benchmark_cases[i];
+      const auto t = run_trial(casei);
+      log_trial(casei, t.result);
+      results.write(trial_record(casei, t, run_id, static_cast<int>(bytes_per_second[i].size())));
+      bytes_per_second[i].push_back(t.result.bytes_per_second);
+      std::this_thread::sleep_for(std::chrono::seconds(settings().delay_seconds_between_tasks));
+    }
+    round_trials = 1;
+
+    std::vector<size_t> next_round;
+    for (auto i : pending)
+    {
+      const auto& trials = bytes_per_second[i];
+      if (repetition.adaptive && trials.size() < static_cast<size_t>(repetition.max_trials)
+          && !is_converged(estimate_throughput(trials, repetition), trials.size(), repetition))
+      {
+        next_round.push_back(i);
+      }
+      else
+      {
+        report_estimate(benchmark_cases[i], trials, run_id, results);
+      }
+    }
+    pending = std::move(next_round);
   }
-  for (auto i : task_order)
+}
+
+/*
+ * Sweeps the concurrency of every cell, cells that only differ in concurrency are swept once. Every
+ * trial is written like a trial of perform(), the curve and its knee are written as a sweep record.
+ */
+void perform_sweeps(
+    const std::vector<benchmark_case>& benchmark_cases,
+    const std::string& run_id,
+    results_writer& results)
+{
+  std::vector<benchmark_case> sweep_cases;
+  for (auto casei : benchmark_cases)
   {
-    auto casei = benchmark_cases[i];
-    int n_trial = 1;
-    while (true)
+    casei.transfer_config.concurrency = 0;
+    if (std::none_of(sweep_cases.begin(), sweep_cases.end(), [&casei](const benchmark_case& c) {
+          return c.transport == casei.transport && c.func->name == casei.func->name
+              && c.transfer_config == casei.transfer_config;
+        }))
     {
-      auto transfer_result = (*casei.func)(*casei.transport, casei.transfer_config);
-      if (transfer_result.exception_observed)
+      sweep_cases.push_back(casei);
+    }
+  }
+  for (const auto& sweep_case : sweep_cases)
+  {
+    // workers beyond num_blobs have nothing to transfer, and buffers per worker, e.g. those of
+    // parallel_download, would be allocated for nothing
+    auto sweep_settings = settings().sweep;
+    sweep_settings.max_concurrency
+        = std::min(sweep_settings.max_concurrency, sweep_case.transfer_config.num_blobs);
+    sweep_settings.min_concurrency
+        = std::min(sweep_settings.min_concurrency, sweep_settings.max_concurrency);
+    const auto sweep = run_concurrency_sweep(sweep_settings, [&](int concurrency) {
+      auto casei = sweep_case;
+      casei.transfer_config.concurrency = concurrency;
+      std::vector<sweep_point> points;
+      for (int i = 0; i < settings().sweep.trials; ++i)
       {
-        const int sleep_seconds = exception_sleep_seconds * (1 >> std::min(n_trial - 1, 3));
-        spdlog::warn(
-            "exception observed with {}, sleep {} seconds", casei.transport->name, sleep_seconds);
-        std::this_thread::sleep_for(std::chrono::seconds(sleep_seconds));
-        ++n_trial;
-        continue;
+        const auto t = run_trial(casei);
+        log_trial(casei, t.result);
+        results.write(trial_record(casei, t, run_id, i));
+        points.push_back(
+            {concurrency,
+             t.result.bytes_per_second,
+             t.result.ops_per_second,
+             t.result.latency_percentiles.p99});
+        std::this_thread::sleep_for(std::chrono::seconds(settings().delay_seconds_between_tasks));
       }
-      spdlog::info(
-          "{} used {}ms to {} {} {}-byte blobs with {} threads",
-          casei.transport->name,
-          transfer_result.total_time_ms.count(),
-          casei.func->name,
-          casei.transfer_config.num_blobs,
-          casei.transfer_config.blob_size,
-          casei.transfer_config.concurrency);
-      break;
+      std::nth_element(
+          points.begin(),
+          points.begin() + points.size() / 2,
+          points.end(),
+          [](const sweep_point& lhs, const sweep_point& rhs) {
+            return lhs.bytes_per_second < rhs.bytes_per_second;
+          });
+      return points[points.size() / 2];
+    });
+
+    std::string curve;
+    nlohmann::json record;
+    for (const auto& p : sweep.curve)
+    {
+      curve += fmt::format(
+          "{}{}: {:.0f} bytes/s p99 {}us",
+          curve.empty() ? "" : ", ",
+          p.concurrency,
+          p.bytes_per_second,
+          p.latency_p99.count());
+      record["curve"].push_back(
+          {{"concurrency", p.concurrency},
+           {"bytes_per_second", p.bytes_per_second},
+           {"ops_per_second", p.ops_per_second},
+           {"latency_p99_us", p.latency_p99.count()}});
     }
-    std::this_thread::sleep_for(std::chrono::seconds(delay_seconds_between_tasks));
+    const auto& knee = sweep.curve[sweep.knee];
+    const auto& peak = sweep.curve[sweep.peak];
+    spdlog::info(
+        "{} {} {}-byte blobs: concurrency sweep {}",
+        sweep_case.transport->name,
+        sweep_case.func->name,
+        sweep_case.transfer_config.blob_size,
+        curve);
+    spdlog::info(
+        "{} {} {}-byte blobs: knee at concurrency {} with {:.0f} bytes/s, peak {:.0f} bytes/s at "
+        "concurrency {}, stopped by {}",
+        sweep_case.transport->name,
+        sweep_case.func->name,
+        sweep_case.transfer_config.blob_size,
+        knee.concurrency,
+        knee.bytes_per_second,
+        peak.bytes_per_second,
+        peak.concurrency,
+        sweep.stop_reason);
+
+    record["type"] = "sweep";
+    record["run_id"] = run_id;
+    record["transport"] = sweep_case.transport->name;
+    record["case"] = sweep_case.func->name;
+    record["transfer_config"] = to_json(sweep_case.transfer_config);
+    record["knee_concurrency"] = knee.concurrency;
+    record["peak_concurrency"] = peak.concurrency;
+    record["stop_reason"] = sweep.stop_reason;
+    results.write(std::move(record));
   }
 }
 
-int main()
+int main(int argc, char** argv)
 {
+  try
+  {
+    load_settings(argc, argv);
+  }
+  catch (std::invalid_argument& e)
+  {
+    spdlog::error(e.what());
+    std::cerr << usage();
+    return 1;
+  }
+
+  // cells are expanded by transport name so that --list works without a storage account
+  struct benchmark_cell
+  {
+    transfer_configuration transfer_config;
+    std::string transport_name;
+    std::shared_ptr<case_base> func;
+  };
+  std::vector<benchmark_cell> benchmark_cells;
+  std::vector<transfer_configuration> transfer_configs;
+  std::vector<std::string> transport_names;
+  std::vector<std::shared_ptr<case_base>> case_functions;
+  for (const auto& group : settings().matrix)
+  {
+    std::vector<std::shared_ptr<case_base>> group_case_functions;
+    for (const auto& p : group.cases)
+    {
+      group_case_functions.push_back(make_case(p));
+    }
+    for (const auto& c : group.transfer_configs)
+    {
+      for (const auto& t : settings().transports)
+      {
+        for (auto& f : group_case_functions)
+        {
+          const bool hashed = c.transactional_hash != hash_algorithm::none;
+          if (!settings().matches(t, f->name, c)
+              || (f->requires_async_transport() && !is_async_transport(t))
+              || (f->requires_private_connections() && shares_connections(t))
+              || (hashed && !(f->supports_transactional_hash() && supports_transactional_hash(t)))
+              || (c.verify != verification::none && !f->supports_verification())
+              || (f->requires_async_transport() && settings().network.injects_faults()))
+          {
+            continue;
+          }
+          benchmark_cells.push_back({c, t, f});
+          if (std::find(transfer_configs.begin(), transfer_configs.end(), c)
+              == transfer_configs.end())
+          {
+            transfer_configs.push_back(c);
+          }
+          if (std::find(transport_names.begin(), transport_names.end(), t)
+              == transport_names.end())
+          {
+            transport_names.push_back(t);
+          }
+          if (std::none_of(case_functions.begin(), case_functions.end(), [&f](auto& i) {
+                return i->name == f->name;
+              }))
+          {
+            case_functions.push_back(f);
+          }
+        }
+      }
+    }
+  }
+  if (benchmark_cells.empty())
+  {
+    spdlog::error("no benchmark cell matches the filters");
+    return 1;
+  }
+  // keep the configured transport order, the first one is the baseline
+  std::vector<std::string> ordered_transport_names;
+  for (const auto& t : settings().transports)
+  {
+    if (std::find(transport_names.begin(), transport_names.end(), t) != transport_names.end())
+    {
+      ordered_transport_names.push_back(t);
+    }
+  }
+  transport_names = std::move(ordered_transport_names);
+
+  if (settings().list_only)
+  {
+    for (const auto& cell : benchmark_cells)
+    {
+      spdlog::info(
+          "{} {}: blob size: {} bytes, number of blobs: {}, concurrency: {}",
+          cell.transport_name,
+          cell.func->name,
+          cell.transfer_config.blob_size,
+          cell.transfer_config.num_blobs,
+          cell.transfer_config.concurrency);
+    }
+    return 0;
+  }
+
+  // outlives logger_raii_instance, which uploads it
+  std::unique_ptr<results_writer> results;
+  try
+  {
+    results = std::make_unique<results_writer>(settings().results_path);
+  }
+  catch (std::runtime_error& e)
+  {
+    spdlog::error(e.what());
+    return 1;
+  }
+
   libcurl_raii libcurl_raii_instance;
-  logger_raii logger_raii_instance;
+  logger_raii logger_raii_instance(results.get());
 
   spdlog::info("started");
+  const auto start_time = std::chrono::system_clock::now();
+
+  std::unique_ptr<mock_blob_server> mock_server;
+  if (settings().use_mock_blob_endpoint)
+  {
+    mock_server = std::make_unique<mock_blob_server>();
+    set_connection_string(mock_server->connection_string());
+    spdlog::info("using mock blob endpoint: {}", mock_server->endpoint());
+  }
+
+  std::unique_ptr<network_proxy> proxy;
+  const auto& network = settings().network;
+  if (network.enabled())
+  {
+    try
+    {
+      proxy = std::make_unique<network_proxy>(get_blob_endpoint_from_connection_string(), network);
+    }
+    catch (std::exception& e)
+    {
+      spdlog::error(e.what());
+      return 1;
+    }
+    set_connection_string(
+        "DefaultEndpointsProtocol=http;AccountName=" + get_account_name_from_connection_string()
+        + ";AccountKey=" + get_access_key_from_connection_string()
+        + ";BlobEndpoint=" + proxy->endpoint() + ";");
+    spdlog::info(
+        "using network proxy {}: rtt {}ms, jitter {}ms, bandwidth {} bytes/s, reset probability "
+        "{}, server busy probability {}",
+        proxy->endpoint(),
+        network.rtt_ms,
+        network.jitter_ms,
+        network.bandwidth,
+        network.reset_probability,
+        network.server_busy_probability);
+  }
 
-  if (!is_connection_string_valid(connection_string))
+  if (!is_connection_string_valid(get_connection_string()))
   {
     spdlog::error("invalid connection string");
     return 1;
   }
   spdlog::info("using storage account: {}", get_account_name_from_connection_string());
-  check_build_environment();
-  validate_azure_vm();
-
-  std::vector<transfer_configuration> transfer_configs;
-  transfer_configs.push_back({5, 10000, 32});
-  transfer_configs.push_back({10_KB, 10000, 32});
-  transfer_configs.push_back({10_MB, 1000, 32});
-  transfer_configs.push_back({1_GB, 32, 8});
-  transfer_configs.push_back({1_GB, 128, 32});
+  auto environment = check_build_environment();
+  environment["storage_account"] = get_account_name_from_connection_string();
+  environment["azure_vm"] = mock_server ? std::string() : validate_azure_vm();
+  environment["mock_blob_endpoint"] = mock_server != nullptr;
+  environment["allocations_counted"] = allocations_counted();
+  if (proxy)
+  {
+    environment["network"] = {
+        {"rtt_ms", network.rtt_ms},
+        {"jitter_ms", network.jitter_ms},
+        {"bandwidth", network.bandwidth},
+        {"reset_probability", network.reset_probability},
+        {"server_busy_probability", network.server_busy_probability},
+        {"seed", network.seed},
+        {"max_retries", network.max_retries},
+        {"retry_backoff_ms", network.retry_backoff_ms}};
+  }
 
   std::vector<std::shared_ptr<transport>> transports;
-  transports.push_back(std::make_shared<cpplite_transport>());
-  transports.push_back(std::make_shared<track2_curl_transport>());
-#if defined(_WIN32)
-  transports.push_back(std::make_shared<track2_winhttp_transport>());
-#endif
-
-  std::vector<std::shared_ptr<case_base>> case_functions;
-  case_functions.push_back(std::make_shared<case_download>());
-  case_functions.push_back(std::make_shared<case_upload>());
+  std::map<std::string, std::shared_ptr<transport>> transport_by_name;
+  for (const auto& t : transport_names)
+  {
+    transports.push_back(make_transport(t));
+    transport_by_name[t] = transports.back();
+  }
 
   std::vector<benchmark_case> benchmark_cases;
-  for (const auto& c : transfer_configs)
+  for (const auto& cell : benchmark_cells)
   {
-    for (auto& t : transports)
-    {
-      for (auto& f : case_functions)
-      {
-        benchmark_cases.push_back({c, t, f});
-      }
-    }
+    benchmark_cases.push_back(
+        {cell.transfer_config, transport_by_name.at(cell.transport_name), cell.func});
   }
+
   for (size_t i = 0; i < transfer_configs.size(); ++i)
   {
     const auto& c = transfer_configs[i];
+    std::string details;
+    if (c.target_rate > 0)
+    {
+      details += ", target rate: " + std::to_string(c.target_rate) + "/s (" + to_string(c.arrivals)
+          + ")";
+    }
+    if (c.download_sink != download_sink_type::buffer)
+    {
+      details += ", download sink: " + to_string(c.download_sink) + " "
+          + std::to_string(c.sink_size) + " bytes";
+    }
+    if (c.payload != payload_profile::random)
+    {
+      details += ", payload: " + to_string(c.payload);
+    }
+    if (c.verify != verification::none)
+    {
+      details += ", verification: " + to_string(c.verify);
+    }
+    if (c.transactional_hash != hash_algorithm::none)
+    {
+      details += ", transactional hash: " + to_string(c.transactional_hash);
+    }
     spdlog::info(
-        "transfer config {}: blob size: {} bytes, number of blobs: {}, concurrency: {}",
+        "transfer config {}: blob size: {} bytes, number of blobs: {}, concurrency: {}{}",
         i + 1,
         c.blob_size,
         c.num_blobs,
-        c.concurrency);
+        c.concurrency,
+        details);
   }
   spdlog::info(
       "transports: {}",
@@ -131,10 +673,101 @@ int main()
           [](std::string& lhs, auto& rhs) {
             return lhs.empty() ? rhs->name : lhs + ", " + rhs->name;
           }));
-  spdlog::info("repeat times: {}", repeat);
-  perform(benchmark_cases);
+  if (settings().sweep.enabled)
+  {
+    spdlog::info(
+        "concurrency sweep from {} to {}, {} trials per level",
+        settings().sweep.min_concurrency,
+        settings().sweep.max_concurrency,
+        settings().sweep.trials);
+  }
+  else if (settings().repetition.adaptive)
+  {
+    spdlog::info(
+        "repeat times: {} to {}, until the {:.0f}% confidence interval of throughput is within "
+        "{:.1f}%",
+        settings().repetition.min_trials,
+        settings().repetition.max_trials,
+        settings().repetition.confidence * 100.0,
+        settings().repetition.target_ci * 100.0);
+  }
+  else
+  {
+    spdlog::info("repeat times: {}", settings().repeat);
+  }
+  if (settings().prewarm)
+  {
+    spdlog::info("connections are opened before every case is timed");
+  }
+
+  {
+    nlohmann::json record;
+    record["type"] = "suite";
+    record["run_id"] = logger_raii_instance.run_id();
+    record["start_time"] = to_timestamp(start_time);
+    record["environment"] = environment;
+    for (const auto& t : transports)
+    {
+      record["transports"].push_back(t->name);
+      const auto tuning = settings().transport_tunings.find(t->name);
+      if (tuning != settings().transport_tunings.end())
+      {
+        record["transport_tuning"][t->name] = to_json(tuning->second);
+      }
+    }
+    record["baseline_transport"] = transports[0]->name;
+    for (const auto& f : case_functions)
+    {
+      record["benchmark_cases"].push_back(f->name);
+    }
+    for (const auto& c : transfer_configs)
+    {
+      record["transfer_configs"].push_back(to_json(c));
+    }
+    record["repeat"] = settings().repeat;
+    if (settings().repetition.adaptive)
+    {
+      const auto& repetition = settings().repetition;
+      record["adaptive_repeat"] = {
+          {"min_trials", repetition.min_trials},
+          {"max_trials", repetition.max_trials},
+          {"target_ci", repetition.target_ci},
+          {"confidence", repetition.confidence},
+          {"outlier_threshold", repetition.outlier_threshold}};
+    }
+    record["prewarm"] = settings().prewarm;
+    record["sweep"] = settings().sweep.enabled;
+    results->write(std::move(record));
+  }
+  if (settings().sweep.enabled)
+  {
+    perform_sweeps(benchmark_cases, logger_raii_instance.run_id(), *results);
+  }
+  else
+  {
+    perform(benchmark_cases, logger_raii_instance.run_id(), *results);
+  }
+  nlohmann::json end_record
+      = {{"type", "end"},
+         {"run_id", logger_raii_instance.run_id()},
+         {"end_time", to_timestamp(std::chrono::system_clock::now())}};
+  if (proxy)
+  {
+    const auto stats = proxy->stats();
+    spdlog::info(
+        "network proxy: {} connections, {} requests, {} reset, {} server busy",
+        stats.connections,
+        stats.requests,
+        stats.resets,
+        stats.server_busy);
+    end_record["network"] = {
+        {"connections", stats.connections},
+        {"requests", stats.requests},
+        {"resets", stats.resets},
+        {"server_busy", stats.server_busy}};
+  }
+  results->write(std::move(end_record));
   spdlog::info("exited");
-  logger_raii_instance.should_flush = true;
 
   return 0;
 }
@@ -0,0 +1,306 @@
+#include "memory_usage.hh"
+
+#if defined(_WIN32)
+#include <windows.h>
+
+#include <psapi.h>
+#elif defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace {
+
+thread_local bool thread_allocations_ignored = false;
+
+#if defined(PERF_COUNT_ALLOCATIONS)
+
+/*
+ * Allocations are counted on slots that threads pick round-robin the first time they allocate, so
+ * that threads allocating at the same time rarely share a cache line. Everything here is constant
+ * initialized because allocations start before static constructors run.
+ */
+struct alignas(64) allocation_slot
+{
+  std::atomic<int64_t> allocations{0};
+  std::atomic<int64_t> bytes{0};
+};
+
+constexpr int num_allocation_slots = 64;
+allocation_slot allocation_slots[num_allocation_slots];
+std::atomic<int> next_allocation_slot{0};
+thread_local int thread_allocation_slot = -1;
+
+void count_allocation(size_t size)
+{
+  if (thread_allocations_ignored)
+  {
+    return;
+  }
+  if (thread_allocation_slot < 0)
+  {
+    thread_allocation_slot
+        = next_allocation_slot.fetch_add(1, std::memory_order_relaxed) % num_allocation_slots;
+  }
+  auto& slot = allocation_slots[thread_allocation_slot];
+  slot.allocations.fetch_add(1, std::memory_order_relaxed);
+  slot.bytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+}
+
+#endif
+
+void read_allocations(memory_usage& usage)
+{
+#if defined(PERF_COUNT_ALLOCATIONS)
+  usage.allocations = 0;
+  usage.bytes_allocated = 0;
+  for (const auto& slot : allocation_slots)
+  {
+    usage.allocations += slot.allocations.load(std::memory_order_relaxed);
+    usage.bytes_allocated += slot.bytes.load(std::memory_order_relaxed);
+  }
+#else
+  (void)usage;
+#endif
+}
+
+#if defined(__linux__)
+
+// the value of a "<key>: <n> kB" line of /proc/self/status in bytes, read without allocating so
+// that reading doesn't show up in the counters
+int64_t read_proc_status(const char* key)
+{
+  const int fd = open("/proc/self/status", O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  char buffer[4096];
+  size_t size = 0;
+  ssize_t n;
+  while (size < sizeof(buffer) - 1
+         && (n = ::read(fd, buffer + size, sizeof(buffer) - 1 - size)) > 0)
+  {
+    size += static_cast<size_t>(n);
+  }
+  close(fd);
+  buffer[size] = '\0';
+
+  const size_t key_size = std::strlen(key);
+  for (const char* line = buffer; *line != '\0';)
+  {
+    if (std::strncmp(line, key, key_size) == 0 && line[key_size] == ':')
+    {
+      return std::strtoll(line + key_size + 1, nullptr, 10) * 1024;
+    }
+    const char* end = std::strchr(line, '\n');
+    if (end == nullptr)
+    {
+      break;
+    }
+    line = end + 1;
+  }
+  return -1;
+}
+
+#endif
+
+void read_rss(memory_usage& usage)
+{
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+  {
+    usage.start_rss = static_cast<int64_t>(counters.WorkingSetSize);
+    usage.peak_rss = static_cast<int64_t>(counters.PeakWorkingSetSize);
+  }
+#elif defined(__linux__)
+  usage.start_rss = read_proc_status("VmRSS");
+  usage.peak_rss = read_proc_status("VmHWM");
+#else
+  (void)usage;
+#endif
+}
+
+void reset_peak_rss()
+{
+#if defined(__linux__)
+  // writing 5 resets VmHWM to the current resident set size, since Linux 4.0
+  const int fd = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+  if (fd >= 0)
+  {
+    if (::write(fd, "5", 1) != 1)
+    {
+      // the peak stays the peak since the process started
+    }
+    close(fd);
+  }
+#endif
+}
+
+} // namespace
+
+memory_usage_meter::memory_usage_meter()
+{
+  reset_peak_rss();
+  read_allocations(m_start);
+  read_rss(m_start);
+}
+
+memory_usage memory_usage_meter::read() const
+{
+  memory_usage usage;
+  read_allocations(usage);
+  if (usage.allocations >= 0)
+  {
+    usage.allocations -= m_start.allocations;
+    usage.bytes_allocated -= m_start.bytes_allocated;
+  }
+  read_rss(usage);
+  usage.start_rss = m_start.start_rss;
+  return usage;
+}
+
+bool allocations_counted()
+{
+#if defined(PERF_COUNT_ALLOCATIONS)
+  return true;
+#else
+  return false;
+#endif
+}
+
+void ignore_thread_allocations() { thread_allocations_ignored = true; }
+
+#if defined(PERF_COUNT_ALLOCATIONS)
+
+#if defined(__GLIBC__)
+
+/*
+ * With glibc malloc itself is interposed, which also counts the allocations of libcurl, OpenSSL
+ * and libxml2 underneath the transports, and operator new of libstdc++ calls malloc. The calls
+ * are forwarded to the allocator of glibc, so free() and the functions not interposed here keep
+ * working on the pointers returned.
+ */
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+
+void* malloc(size_t size) noexcept
+{
+  count_allocation(size);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) noexcept
+{
+  count_allocation(count * size);
+  return __libc_calloc(count, size);
+}
+
+// a realloc may move the block, it's counted as an allocation of the new size
+void* realloc(void* ptr, size_t size) noexcept
+{
+  count_allocation(size);
+  return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) noexcept
+{
+  count_allocation(size);
+  return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept
+{
+  count_allocation(size);
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) noexcept
+{
+  if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+  {
+    return EINVAL;
+  }
+  count_allocation(size);
+  void* p = __libc_memalign(alignment, size);
+  if (p == nullptr)
+  {
+    return ENOMEM;
+  }
+  *ptr = p;
+  return 0;
+}
+
+} // extern "C"
+
+#else
+
+/*
+ * Elsewhere only the C++ allocations of this program and the SDKs are counted, the allocations the
+ * C libraries make with malloc aren't.
+ */
+namespace {
+
+void* counted_new(size_t size)
+{
+  count_allocation(size);
+  while (true)
+  {
+    if (void* p = std::malloc(size != 0 ? size : 1))
+    {
+      return p;
+    }
+    const auto handler = std::get_new_handler();
+    if (handler == nullptr)
+    {
+      throw std::bad_alloc();
+    }
+    handler();
+  }
+}
+
+void* counted_new(size_t size, const std::nothrow_t&) noexcept
+{
+  try
+  {
+    return counted_new(size);
+  }
+  catch (std::bad_alloc&)
+  {
+    return nullptr;
+  }
+}
+
+} // namespace
+
+void* operator new(size_t size) { return counted_new(size); }
+void* operator new[](size_t size) { return counted_new(size); }
+void* operator new(size_t size, const std::nothrow_t& tag) noexcept
+{
+  return counted_new(size, tag);
+}
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+  return counted_new(size, tag);
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+
+#endif
+
+#endif
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Memory the process allocates while a case runs. Allocations are only counted in builds with the
+ * PERF_COUNT_ALLOCATIONS CMake option, the counters are -1 otherwise. Counters a platform can't
+ * provide are -1 too.
+ */
+struct memory_usage
+{
+  // calls to malloc and its relatives, operator new included, on threads that aren't ignored
+  int64_t allocations = -1;
+  // bytes requested by these calls, whether or not they are freed again
+  int64_t bytes_allocated = -1;
+  // resident set size when the case started and its peak while the case ran, where the peak
+  // can't be reset (anywhere but Linux) it's the peak since the process started
+  int64_t start_rss = -1;
+  int64_t peak_rss = -1;
+};
+
+// Starts measuring when constructed. Only one meter is to be alive at a time because the peak
+// resident set size is reset for the whole process.
+class memory_usage_meter {
+public:
+  memory_usage_meter();
+  memory_usage_meter(const memory_usage_meter&) = delete;
+  memory_usage_meter& operator=(const memory_usage_meter&) = delete;
+
+  // usage since construction
+  memory_usage read() const;
+
+private:
+  memory_usage m_start;
+};
+
+// whether this build counts allocations
+bool allocations_counted();
+// Stops counting the allocations of the calling thread, for threads that serve the transports
+// in-process such as those of mock_blob_server, which would otherwise be billed to the transport.
+void ignore_thread_allocations();
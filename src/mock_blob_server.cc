@@ -0,0 +1,784 @@
+#include "mock_blob_server.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <ctime>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+#include "cpu_usage.hh"
+#include "memory_usage.hh"
+#include "utilities.hh"
+
+struct mock_blob_server::http_request
+{
+  std::string method;
+  std::string path;
+  std::string query;
+  std::map<std::string, std::string> headers;
+  std::vector<uint8_t> body;
+
+  std::string header(const std::string& name) const
+  {
+    auto ite = headers.find(name);
+    return ite == headers.end() ? std::string() : ite->second;
+  }
+  bool has_query(const std::string& key_value) const
+  {
+    const std::string q = "&" + query + "&";
+    return q.find("&" + key_value + "&") != std::string::npos;
+  }
+  std::string query_value(const std::string& key) const
+  {
+    const std::string q = "&" + query + "&";
+    auto begin = q.find("&" + key + "=");
+    if (begin == std::string::npos)
+    {
+      return std::string();
+    }
+    begin += key.length() + 2;
+    const std::string encoded = q.substr(begin, q.find('&', begin) - begin);
+    std::string value;
+    for (size_t i = 0; i < encoded.length(); ++i)
+    {
+      if (encoded[i] == '%' && i + 2 < encoded.length())
+      {
+        value += static_cast<char>(std::stoi(encoded.substr(i + 1, 2), nullptr, 16));
+        i += 2;
+      }
+      else
+      {
+        value += encoded[i];
+      }
+    }
+    return value;
+  }
+};
+
+namespace {
+
+constexpr size_t max_header_size = 64_KB;
+
+std::string to_lower(std::string str)
+{
+  std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) {
+    return static_cast<char>(std::tolower(c));
+  });
+  return str;
+}
+
+std::string trim(const std::string& str)
+{
+  const auto first = str.find_first_not_of(" \t");
+  if (first == std::string::npos)
+  {
+    return std::string();
+  }
+  const auto last = str.find_last_not_of(" \t");
+  return str.substr(first, last - first + 1);
+}
+
+std::string rfc1123_now()
+{
+  std::time_t t = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+  std::tm tm;
+#if defined(_WIN32)
+  gmtime_s(&tm, &t);
+#else
+  gmtime_r(&t, &tm);
+#endif
+  char buffer[64];
+  std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  return buffer;
+}
+
+// decimal digits only, false if str is empty, has anything else or doesn't fit
+bool parse_size(const std::string& str, uint64_t& value)
+{
+  if (str.empty())
+  {
+    return false;
+  }
+  value = 0;
+  for (char c : str)
+  {
+    if (c < '0' || c > '9' || value > (UINT64_MAX - (c - '0')) / 10)
+    {
+      return false;
+    }
+    value = value * 10 + static_cast<uint64_t>(c - '0');
+  }
+  return true;
+}
+
+/*
+ * Parses the range of a "bytes=<first>-[<last>]" or "bytes=-<suffix length>" header into [begin,
+ * end) of a blob of blob_size bytes, a last byte past the end is clamped to it. Returns false for
+ * a range that is malformed, has several parts or doesn't overlap the blob.
+ */
+bool parse_byte_range(const std::string& range, size_t blob_size, size_t& begin, size_t& end)
+{
+  const auto dash = range.find('-', 6);
+  if (dash == std::string::npos)
+  {
+    return false;
+  }
+  const std::string first = trim(range.substr(6, dash - 6));
+  const std::string last = trim(range.substr(dash + 1));
+  uint64_t first_byte = 0;
+  uint64_t last_byte = 0;
+  if (first.empty())
+  {
+    if (!parse_size(last, last_byte) || last_byte == 0 || blob_size == 0)
+    {
+      return false;
+    }
+    begin = blob_size - static_cast<size_t>(std::min<uint64_t>(last_byte, blob_size));
+    end = blob_size;
+    return true;
+  }
+  if (!parse_size(first, first_byte) || first_byte >= blob_size)
+  {
+    return false;
+  }
+  begin = static_cast<size_t>(first_byte);
+  end = blob_size;
+  if (!last.empty())
+  {
+    if (!parse_size(last, last_byte) || last_byte < first_byte)
+    {
+      return false;
+    }
+    end = static_cast<size_t>(std::min<uint64_t>(last_byte, blob_size - 1)) + 1;
+  }
+  return true;
+}
+
+// Buffered reader over a connection, bytes received past the end of one request belong to the
+// next request on the same keep-alive connection.
+class connection_reader {
+public:
+  explicit connection_reader(tcp_socket& connection) : m_connection(connection) {}
+
+  bool read_line(std::string& line)
+  {
+    while (true)
+    {
+      auto ite = std::search(m_pending.begin(), m_pending.end(), m_crlf, m_crlf + 2);
+      if (ite != m_pending.end())
+      {
+        line.assign(m_pending.begin(), ite);
+        m_pending.erase(m_pending.begin(), ite + 2);
+        return true;
+      }
+      if (m_pending.size() > max_header_size || !fill())
+      {
+        return false;
+      }
+    }
+  }
+
+  bool read_exact(uint8_t* buffer, size_t size)
+  {
+    const size_t from_pending = std::min(size, m_pending.size());
+    std::copy(m_pending.begin(), m_pending.begin() + from_pending, buffer);
+    m_pending.erase(m_pending.begin(), m_pending.begin() + from_pending);
+    buffer += from_pending;
+    size -= from_pending;
+    while (size != 0)
+    {
+      size_t n = m_connection.recv_some(buffer, size);
+      if (n == 0)
+      {
+        return false;
+      }
+      buffer += n;
+      size -= n;
+    }
+    return true;
+  }
+
+private:
+  bool fill()
+  {
+    uint8_t buffer[16_KB];
+    size_t n = m_connection.recv_some(buffer, sizeof(buffer));
+    m_pending.insert(m_pending.end(), buffer, buffer + n);
+    return n != 0;
+  }
+
+  constexpr static const char m_crlf[] = "\r\n";
+  tcp_socket& m_connection;
+  std::vector<char> m_pending;
+};
+
+constexpr const char connection_reader::m_crlf[];
+
+bool read_request_body(
+    tcp_socket& connection,
+    connection_reader& reader,
+    mock_blob_server::http_request& request);
+
+} // namespace
+
+mock_blob_server::mock_blob_server(uint16_t port)
+    : m_listen_socket(tcp_socket::listen_loopback(port))
+{
+  m_port = m_listen_socket.local_port();
+  m_accept_thread = std::thread(&mock_blob_server::accept_loop, this);
+}
+
+mock_blob_server::~mock_blob_server()
+{
+  m_stopped = true;
+  m_listen_socket.shutdown();
+  // accept() doesn't return on every platform when the listening socket is shut down, wake it up
+  // with a connection of our own
+  try
+  {
+    tcp_socket::connect("127.0.0.1", m_port);
+  }
+  catch (std::exception&)
+  {
+  }
+  m_accept_thread.join();
+  m_listen_socket.close();
+
+  {
+    std::lock_guard<std::mutex> guard(m_connections_lock);
+    for (auto& c : m_connections)
+    {
+      c->socket.shutdown();
+    }
+  }
+  // the accept thread, the only one to change m_connections, has ended
+  for (auto& c : m_connections)
+  {
+    c->thread.join();
+  }
+}
+
+std::string mock_blob_server::endpoint() const
+{
+  return "http://127.0.0.1:" + std::to_string(m_port) + "/" + account_name;
+}
+
+std::string mock_blob_server::connection_string() const
+{
+  return std::string("DefaultEndpointsProtocol=http;AccountName=") + account_name
+      + ";AccountKey=" + account_key + ";BlobEndpoint=" + endpoint() + ";";
+}
+
+void mock_blob_server::accept_loop()
+{
+  ignore_thread_allocations();
+  ignore_thread_cpu_usage();
+  while (!m_stopped)
+  {
+    tcp_socket connection;
+    try
+    {
+      connection = m_listen_socket.accept();
+    }
+    catch (std::exception& e)
+    {
+      if (m_stopped)
+      {
+        break;
+      }
+      // e.g. out of file descriptors, which takes connections to close, or an aborted connection,
+      // later requests are still to be served
+      spdlog::error("mock blob server failed to accept connection: {}", e.what());
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      continue;
+    }
+    if (m_stopped)
+    {
+      break;
+    }
+    connection.set_nodelay(true);
+
+    std::lock_guard<std::mutex> guard(m_connections_lock);
+    reap_connections();
+    auto c = std::make_unique<client_connection>();
+    c->socket = std::move(connection);
+    client_connection* served = c.get();
+    c->thread = std::thread([this, served]() {
+      serve_connection(&served->socket);
+      std::lock_guard<std::mutex> guard(m_connections_lock);
+      served->done = true;
+    });
+    m_connections.push_back(std::move(c));
+  }
+}
+
+void mock_blob_server::reap_connections()
+{
+  for (auto ite = m_connections.begin(); ite != m_connections.end();)
+  {
+    if ((*ite)->done)
+    {
+      (*ite)->thread.join();
+      ite = m_connections.erase(ite);
+    }
+    else
+    {
+      ++ite;
+    }
+  }
+}
+
+void mock_blob_server::serve_connection(tcp_socket* connection)
+{
+  ignore_thread_allocations();
+  ignore_thread_cpu_usage();
+  connection_reader reader(*connection);
+  try
+  {
+    while (!m_stopped)
+    {
+      http_request request;
+      std::string line;
+      if (!reader.read_line(line))
+      {
+        break;
+      }
+      {
+        const auto method_end = line.find(' ');
+        const auto target_end = line.find(' ', method_end + 1);
+        if (method_end == std::string::npos || target_end == std::string::npos)
+        {
+          break;
+        }
+        request.method = line.substr(0, method_end);
+        const std::string target = line.substr(method_end + 1, target_end - method_end - 1);
+        const auto query_begin = target.find('?');
+        request.path = target.substr(0, query_begin);
+        if (query_begin != std::string::npos)
+        {
+          request.query = target.substr(query_begin + 1);
+        }
+      }
+      while (true)
+      {
+        if (!reader.read_line(line))
+        {
+          return;
+        }
+        if (line.empty())
+        {
+          break;
+        }
+        const auto colon = line.find(':');
+        if (colon != std::string::npos)
+        {
+          request.headers[to_lower(line.substr(0, colon))] = trim(line.substr(colon + 1));
+        }
+      }
+      if (!read_request_body(*connection, reader, request))
+      {
+        break;
+      }
+      if (!handle_request(*connection, request))
+      {
+        break;
+      }
+    }
+  }
+  catch (std::exception& e)
+  {
+    if (!m_stopped)
+    {
+      spdlog::debug("mock blob server connection closed: {}", e.what());
+    }
+  }
+  connection->shutdown();
+}
+
+namespace {
+
+bool read_request_body(
+    tcp_socket& connection,
+    connection_reader& reader,
+    mock_blob_server::http_request& request)
+{
+  if (to_lower(request.header("expect")) == "100-continue")
+  {
+    connection.send_all("HTTP/1.1 100 Continue\r\n\r\n");
+  }
+
+  if (to_lower(request.header("transfer-encoding")) == "chunked")
+  {
+    std::string line;
+    while (true)
+    {
+      if (!reader.read_line(line))
+      {
+        return false;
+      }
+      const size_t chunk_size = std::stoull(line, nullptr, 16);
+      if (chunk_size != 0)
+      {
+        const size_t offset = request.body.size();
+        request.body.resize(offset + chunk_size);
+        if (!reader.read_exact(request.body.data() + offset, chunk_size))
+        {
+          return false;
+        }
+      }
+      if (!reader.read_line(line))
+      {
+        return false;
+      }
+      if (chunk_size == 0)
+      {
+        // trailers aren't supported, line is the empty line after the last chunk
+        return true;
+      }
+    }
+  }
+
+  const std::string content_length = request.header("content-length");
+  if (!content_length.empty())
+  {
+    request.body.resize(std::stoull(content_length));
+    return reader.read_exact(request.body.data(), request.body.size());
+  }
+  return true;
+}
+
+} // namespace
+
+bool mock_blob_server::handle_request(tcp_socket& connection, http_request& request)
+{
+  const bool keep_alive = to_lower(request.header("connection")) != "close";
+
+  struct http_response
+  {
+    int status_code = 200;
+    std::string reason = "OK";
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::shared_ptr<const std::vector<uint8_t>> body;
+    size_t body_offset = 0;
+    size_t body_length = 0;
+    std::string error_body;
+  } response;
+
+  auto fail = [&response](int status_code, std::string reason, const std::string& error_code) {
+    response.status_code = status_code;
+    response.reason = std::move(reason);
+    response.headers.emplace_back("x-ms-error-code", error_code);
+    response.headers.emplace_back("Content-Type", "application/xml");
+    response.error_body = "<?xml version=\"1.0\" encoding=\"utf-8\"?><Error><Code>" + error_code
+        + "</Code><Message>" + response.reason + "</Message></Error>";
+  };
+  auto add_blob_headers = [&response](const blob_data& blob) {
+    response.headers.emplace_back("ETag", blob.etag);
+    response.headers.emplace_back("Last-Modified", blob.last_modified);
+    response.headers.emplace_back("x-ms-creation-time", blob.last_modified);
+    response.headers.emplace_back("x-ms-blob-type", "BlockBlob");
+    response.headers.emplace_back("x-ms-lease-state", "available");
+    response.headers.emplace_back("x-ms-lease-status", "unlocked");
+    response.headers.emplace_back("x-ms-server-encrypted", "true");
+    response.headers.emplace_back("Accept-Ranges", "bytes");
+    response.headers.emplace_back("Content-Type", "application/octet-stream");
+    for (const auto& m : blob.metadata)
+    {
+      response.headers.emplace_back("x-ms-meta-" + m.first, m.second);
+    }
+  };
+  auto request_metadata = [&request]() {
+    std::map<std::string, std::string> metadata;
+    const std::string prefix = "x-ms-meta-";
+    for (const auto& h : request.headers)
+    {
+      if (h.first.compare(0, prefix.length(), prefix) == 0)
+      {
+        metadata[h.first.substr(prefix.length())] = h.second;
+      }
+    }
+    return metadata;
+  };
+
+  // path is /<account>/<container>[/<blob>]
+  std::string container;
+  std::string blob;
+  {
+    std::string path = request.path;
+    const std::string account_prefix = std::string("/") + account_name;
+    if (path.compare(0, account_prefix.length(), account_prefix) == 0)
+    {
+      path = path.substr(account_prefix.length());
+    }
+    if (!path.empty() && path[0] == '/')
+    {
+      path = path.substr(1);
+    }
+    const auto slash = path.find('/');
+    container = path.substr(0, slash);
+    if (slash != std::string::npos)
+    {
+      blob = path.substr(slash + 1);
+    }
+  }
+
+  if (request.has_query("restype=account") && request.has_query("comp=properties"))
+  {
+    response.headers.emplace_back("x-ms-sku-name", "Standard_LRS");
+    response.headers.emplace_back("x-ms-account-kind", "StorageV2");
+    response.headers.emplace_back("x-ms-is-hns-enabled", "false");
+  }
+  else if (request.method == "PUT" && request.has_query("restype=container") && blob.empty())
+  {
+    std::lock_guard<std::mutex> guard(m_data_lock);
+    if (!m_containers.insert(container).second)
+    {
+      fail(409, "The specified container already exists.", "ContainerAlreadyExists");
+    }
+    else
+    {
+      response.status_code = 201;
+      response.reason = "Created";
+      response.headers.emplace_back("ETag", "\"0x" + std::to_string(++m_etag_counter) + "\"");
+      response.headers.emplace_back("Last-Modified", rfc1123_now());
+    }
+  }
+  else if (request.method == "PUT" && !blob.empty() && request.has_query("comp=block"))
+  {
+    const std::string block_id = request.query_value("blockid");
+    auto content = std::make_shared<const std::vector<uint8_t>>(std::move(request.body));
+    {
+      std::lock_guard<std::mutex> guard(m_data_lock);
+      m_uncommitted_blocks[container + "/" + blob][block_id] = std::move(content);
+    }
+    response.status_code = 201;
+    response.reason = "Created";
+    response.headers.emplace_back("x-ms-request-server-encrypted", "true");
+  }
+  else if (request.method == "PUT" && !blob.empty() && request.has_query("comp=blocklist"))
+  {
+    // <BlockList><Latest>id</Latest>...</BlockList>, committed blocks can't be referenced
+    std::vector<std::string> block_ids;
+    const std::string body(request.body.begin(), request.body.end());
+    for (size_t pos = body.find("<BlockList>"); pos != std::string::npos;)
+    {
+      const auto tag_begin = body.find('<', pos + 1);
+      const auto tag_end = body.find('>', tag_begin);
+      if (tag_begin == std::string::npos || tag_end == std::string::npos
+          || body[tag_begin + 1] == '/')
+      {
+        break;
+      }
+      const auto value_end = body.find('<', tag_end);
+      block_ids.push_back(body.substr(tag_end + 1, value_end - tag_end - 1));
+      pos = body.find('>', value_end);
+    }
+
+    auto content = std::make_shared<std::vector<uint8_t>>();
+    blob_data data;
+    bool valid = true;
+    {
+      std::lock_guard<std::mutex> guard(m_data_lock);
+      auto& blocks = m_uncommitted_blocks[container + "/" + blob];
+      for (const auto& id : block_ids)
+      {
+        auto ite = blocks.find(id);
+        if (ite == blocks.end())
+        {
+          valid = false;
+          break;
+        }
+        content->insert(content->end(), ite->second->begin(), ite->second->end());
+      }
+      if (valid)
+      {
+        m_uncommitted_blocks.erase(container + "/" + blob);
+        data.content = std::move(content);
+        data.metadata = request_metadata();
+        data.etag = "\"0x" + std::to_string(++m_etag_counter) + "\"";
+        data.last_modified = rfc1123_now();
+        m_containers.insert(container);
+        m_blobs[container + "/" + blob] = data;
+      }
+    }
+    if (!valid)
+    {
+      fail(400, "The specified block list is invalid.", "InvalidBlockList");
+    }
+    else
+    {
+      response.status_code = 201;
+      response.reason = "Created";
+      response.headers.emplace_back("ETag", data.etag);
+      response.headers.emplace_back("Last-Modified", data.last_modified);
+      response.headers.emplace_back("x-ms-request-server-encrypted", "true");
+    }
+  }
+  else if (request.method == "PUT" && !blob.empty() && request.query.empty())
+  {
+    blob_data data;
+    data.content = std::make_shared<const std::vector<uint8_t>>(std::move(request.body));
+    data.metadata = request_metadata();
+    data.last_modified = rfc1123_now();
+    {
+      std::lock_guard<std::mutex> guard(m_data_lock);
+      data.etag = "\"0x" + std::to_string(++m_etag_counter) + "\"";
+      m_containers.insert(container);
+      m_blobs[container + "/" + blob] = data;
+    }
+    response.status_code = 201;
+    response.reason = "Created";
+    response.headers.emplace_back("ETag", data.etag);
+    response.headers.emplace_back("Last-Modified", data.last_modified);
+    response.headers.emplace_back("x-ms-request-server-encrypted", "true");
+  }
+  else if (
+      request.method == "GET" && blob.empty() && request.has_query("restype=container")
+      && request.has_query("comp=list"))
+  {
+    // a single page of all blobs, blob names the benchmark uses need no XML escaping
+    const std::string prefix = request.query_value("prefix");
+    const bool include_metadata = request.query_value("include").find("metadata")
+        != std::string::npos;
+    std::string body = "<?xml version=\"1.0\" encoding=\"utf-8\"?><EnumerationResults "
+                       "ServiceEndpoint=\"/\" ContainerName=\""
+        + container + "\"><Prefix>" + prefix + "</Prefix><Blobs>";
+    {
+      std::lock_guard<std::mutex> guard(m_data_lock);
+      const std::string key_prefix = container + "/" + prefix;
+      for (auto ite = m_blobs.lower_bound(key_prefix);
+           ite != m_blobs.end() && ite->first.compare(0, key_prefix.length(), key_prefix) == 0;
+           ++ite)
+      {
+        const blob_data& data = ite->second;
+        body += "<Blob><Name>" + ite->first.substr(container.length() + 1)
+            + "</Name><Properties><Creation-Time>" + data.last_modified
+            + "</Creation-Time><Last-Modified>" + data.last_modified + "</Last-Modified><Etag>"
+            + data.etag.substr(1, data.etag.length() - 2) + "</Etag><Content-Length>"
+            + std::to_string(data.content->size())
+            + "</Content-Length><Content-Type>application/octet-stream</Content-Type>"
+              "<BlobType>BlockBlob</BlobType><LeaseStatus>unlocked</LeaseStatus>"
+              "<LeaseState>available</LeaseState><ServerEncrypted>true</ServerEncrypted>"
+              "</Properties>";
+        if (include_metadata)
+        {
+          body += "<Metadata>";
+          for (const auto& m : data.metadata)
+          {
+            body += "<" + m.first + ">" + m.second + "</" + m.first + ">";
+          }
+          body += "</Metadata>";
+        }
+        body += "</Blob>";
+      }
+    }
+    body += "</Blobs><NextMarker /></EnumerationResults>";
+    response.headers.emplace_back("Content-Type", "application/xml");
+    response.body = std::make_shared<const std::vector<uint8_t>>(body.begin(), body.end());
+    response.body_length = body.length();
+  }
+  else if ((request.method == "GET" || request.method == "HEAD") && !blob.empty())
+  {
+    blob_data data;
+    bool found = false;
+    {
+      std::lock_guard<std::mutex> guard(m_data_lock);
+      auto ite = m_blobs.find(container + "/" + blob);
+      if (ite != m_blobs.end())
+      {
+        data = ite->second;
+        found = true;
+      }
+    }
+    if (!found)
+    {
+      fail(404, "The specified blob does not exist.", "BlobNotFound");
+    }
+    else
+    {
+      const size_t blob_size = data.content->size();
+      std::string range = request.header("x-ms-range");
+      if (range.empty())
+      {
+        range = request.header("range");
+      }
+      size_t range_begin = 0;
+      size_t range_end = blob_size;
+      bool range_valid = true;
+      if (request.method == "GET" && range.compare(0, 6, "bytes=") == 0)
+      {
+        range_valid = parse_byte_range(range, blob_size, range_begin, range_end);
+        if (range_valid)
+        {
+          response.status_code = 206;
+          response.reason = "Partial Content";
+          response.headers.emplace_back(
+              "Content-Range",
+              "bytes " + std::to_string(range_begin) + "-" + std::to_string(range_end - 1) + "/"
+                  + std::to_string(blob_size));
+        }
+      }
+      if (!range_valid)
+      {
+        fail(
+            416,
+            "The range specified is invalid for the current size of the resource.",
+            "InvalidRange");
+      }
+      else
+      {
+        add_blob_headers(data);
+        response.body = data.content;
+        response.body_offset = range_begin;
+        response.body_length = range_end - range_begin;
+      }
+    }
+  }
+  else
+  {
+    fail(
+        400,
+        "The requested operation is not supported by the mock endpoint.",
+        "UnsupportedHttpVerb");
+  }
+
+  std::string head = "HTTP/1.1 " + std::to_string(response.status_code) + " " + response.reason
+      + "\r\n";
+  for (const auto& h : response.headers)
+  {
+    head += h.first + ": " + h.second + "\r\n";
+  }
+  const size_t content_length
+      = response.body ? response.body_length : response.error_body.length();
+  head += "Content-Length: " + std::to_string(content_length) + "\r\n";
+  head += "x-ms-request-id: 00000000-0000-0000-0000-000000000000\r\n";
+  const std::string version = request.header("x-ms-version");
+  if (!version.empty())
+  {
+    head += "x-ms-version: " + version + "\r\n";
+  }
+  head += "Date: " + rfc1123_now() + "\r\n";
+  head += "Server: perftest-mock-blob-server\r\n";
+  if (!keep_alive)
+  {
+    head += "Connection: close\r\n";
+  }
+  head += "\r\n";
+
+  if (request.method == "HEAD")
+  {
+    connection.send_all(head);
+  }
+  else if (response.body)
+  {
+    connection.send_all(head);
+    connection.send_all(response.body->data() + response.body_offset, response.body_length);
+  }
+  else
+  {
+    connection.send_all(head + response.error_body);
+  }
+  return keep_alive;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "socket_utils.hh"
+
+/*
+ * In-memory loopback implementation of the subset of the Blob service REST API the benchmark
+ * uses: Create Container, List Blobs (one page, with metadata), Put Blob, Put Block, Put Block
+ * List, Get Blob (with Range), Get Blob Properties and Get Account Info. Blob metadata is stored
+ * and returned. Requests are not authenticated, shared-key signatures are accepted as is.
+ */
+class mock_blob_server {
+public:
+  constexpr static const char* account_name = "devstoreaccount1";
+  constexpr static const char* account_key
+      = "Eby8vdM02xNOcqFlqUwJPLlmEtlCDXJ1OUzFT50uSRZ6IFsuFq2UVErCz4I6tq/"
+        "K1SZFPTOtr/KBHBeksoGMGw==";
+
+  explicit mock_blob_server(uint16_t port = 0);
+  mock_blob_server(const mock_blob_server&) = delete;
+  mock_blob_server& operator=(const mock_blob_server&) = delete;
+  ~mock_blob_server();
+
+  uint16_t port() const { return m_port; }
+  std::string endpoint() const;
+  std::string connection_string() const;
+
+  struct http_request;
+
+private:
+  struct blob_data
+  {
+    std::shared_ptr<const std::vector<uint8_t>> content;
+    std::string etag;
+    std::string last_modified;
+    // x-ms-meta-* headers, names are lower case
+    std::map<std::string, std::string> metadata;
+  };
+
+  struct client_connection
+  {
+    tcp_socket socket;
+    std::thread thread;
+    // set by thread when it's about to end, guarded by m_connections_lock
+    bool done = false;
+  };
+
+  void accept_loop();
+  // joins and drops the connections that have been served, m_connections_lock must be held
+  void reap_connections();
+  void serve_connection(tcp_socket* connection);
+  bool handle_request(tcp_socket& connection, http_request& request);
+
+  uint16_t m_port = 0;
+  tcp_socket m_listen_socket;
+  std::thread m_accept_thread;
+  std::atomic<bool> m_stopped{false};
+
+  std::mutex m_connections_lock;
+  // connections being served
+  std::vector<std::unique_ptr<client_connection>> m_connections;
+
+  std::mutex m_data_lock;
+  std::set<std::string> m_containers;
+  std::map<std::string, blob_data> m_blobs;
+  std::map<std::string, std::map<std::string, std::shared_ptr<const std::vector<uint8_t>>>>
+      m_uncommitted_blocks;
+  uint64_t m_etag_counter = 0;
+};
@@ -0,0 +1,592 @@
+#include "network_proxy.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <stdexcept>
+
+#include "cpu_usage.hh"
+#include "memory_usage.hh"
+#include "utilities.hh"
+
+namespace {
+
+constexpr size_t max_head_size = 64_KB;
+// like a TCP window, a connection moves at most this much per one-way delay each way
+constexpr size_t max_queued_bytes = 8_MB;
+
+std::string to_lower(std::string str)
+{
+  std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) {
+    return static_cast<char>(std::tolower(c));
+  });
+  return str;
+}
+
+} // namespace
+
+/*
+ * One direction of a connection. Chunks are delivered one-way delay plus jitter after they were
+ * pushed, but never before the chunk pushed ahead of them.
+ */
+class network_proxy::delay_line {
+public:
+  delay_line(std::chrono::nanoseconds delay, std::chrono::nanoseconds jitter, uint64_t seed)
+      : m_delay(delay), m_jitter(jitter), m_random(seed)
+  {
+  }
+
+  // blocks while max_queued_bytes are queued, returns false once the line is closed
+  bool push(std::vector<uint8_t> data)
+  {
+    std::unique_lock<std::mutex> guard(m_lock);
+    m_cv.wait(guard, [&]() { return m_closed || m_queued_bytes < max_queued_bytes; });
+    if (m_closed || m_finished)
+    {
+      return false;
+    }
+    auto deliver_at = std::chrono::steady_clock::now() + m_delay;
+    if (m_jitter.count() > 0)
+    {
+      deliver_at += std::chrono::nanoseconds(std::uniform_int_distribution<int64_t>(
+          0, m_jitter.count())(m_random));
+    }
+    deliver_at = std::max(deliver_at, m_last_delivery);
+    m_last_delivery = deliver_at;
+    m_queued_bytes += data.size();
+    m_chunks.push_back({deliver_at, std::move(data)});
+    m_cv.notify_all();
+    return true;
+  }
+
+  // the stream ends after the chunks queued so far
+  void finish()
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_finished = true;
+    m_cv.notify_all();
+  }
+
+  // drops the queued chunks, the stream ends now
+  void close()
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_closed = true;
+    m_chunks.clear();
+    m_cv.notify_all();
+  }
+
+  // returns false at the end of the stream
+  bool pop(std::vector<uint8_t>& data, std::chrono::steady_clock::time_point& deliver_at)
+  {
+    std::unique_lock<std::mutex> guard(m_lock);
+    m_cv.wait(guard, [&]() { return m_closed || m_finished || !m_chunks.empty(); });
+    if (m_chunks.empty())
+    {
+      return false;
+    }
+    deliver_at = m_chunks.front().deliver_at;
+    data = std::move(m_chunks.front().data);
+    m_chunks.pop_front();
+    m_queued_bytes -= data.size();
+    m_cv.notify_all();
+    return true;
+  }
+
+private:
+  struct chunk
+  {
+    std::chrono::steady_clock::time_point deliver_at;
+    std::vector<uint8_t> data;
+  };
+
+  const std::chrono::nanoseconds m_delay;
+  const std::chrono::nanoseconds m_jitter;
+  std::mt19937_64 m_random;
+  std::mutex m_lock;
+  std::condition_variable m_cv;
+  std::deque<chunk> m_chunks;
+  size_t m_queued_bytes = 0;
+  std::chrono::steady_clock::time_point m_last_delivery;
+  bool m_finished = false;
+  bool m_closed = false;
+};
+
+// Spaces out the chunks all connections send one way to bytes_per_second.
+class network_proxy::pacer {
+public:
+  explicit pacer(int64_t bytes_per_second) : m_bytes_per_second(bytes_per_second) {}
+
+  // the time size more bytes may be sent at
+  std::chrono::steady_clock::time_point reserve(size_t size)
+  {
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> guard(m_lock);
+    // idle time doesn't add up to a burst
+    m_next = std::max(m_next, now);
+    const auto ret = m_next;
+    m_next += std::chrono::nanoseconds(static_cast<int64_t>(
+        static_cast<double>(size) * 1e9 / static_cast<double>(m_bytes_per_second)));
+    return ret;
+  }
+
+private:
+  const int64_t m_bytes_per_second;
+  std::mutex m_lock;
+  std::chrono::steady_clock::time_point m_next;
+};
+
+namespace {
+
+// sends the chunks of line to the socket as they become due
+void forward(network_proxy::delay_line& line, tcp_socket& to, network_proxy::pacer* pacer)
+{
+  std::vector<uint8_t> data;
+  std::chrono::steady_clock::time_point deliver_at;
+  while (line.pop(data, deliver_at))
+  {
+    std::this_thread::sleep_until(deliver_at);
+    if (pacer)
+    {
+      std::this_thread::sleep_until(pacer->reserve(data.size()));
+    }
+    to.send_all(data.data(), data.size());
+  }
+}
+
+std::string server_busy_response(const std::string& head)
+{
+  const std::string body = "<?xml version=\"1.0\" encoding=\"utf-8\"?><Error><Code>ServerBusy"
+                           "</Code><Message>The server is busy.</Message></Error>";
+  std::string ret = "HTTP/1.1 503 Server Busy\r\n"
+                    "Content-Type: application/xml\r\n"
+                    "Content-Length: "
+      + std::to_string(body.length())
+      + "\r\n"
+        "x-ms-error-code: ServerBusy\r\n"
+        "x-ms-request-id: 00000000-0000-0000-0000-000000000000\r\n";
+  const auto version = to_lower(head).find("\r\nx-ms-version:");
+  if (version != std::string::npos)
+  {
+    const auto begin = version + 2;
+    ret += head.substr(begin, head.find("\r\n", begin) + 2 - begin);
+  }
+  return ret + "Connection: close\r\n\r\n" + body;
+}
+
+} // namespace
+
+network_proxy::network_proxy(const std::string& upstream_endpoint, const network_profile& profile)
+    : m_profile(profile), m_random(profile.seed)
+{
+  const std::string scheme = "http://";
+  if (to_lower(upstream_endpoint.substr(0, scheme.length())) != scheme)
+  {
+    throw std::invalid_argument(
+        "the network proxy needs an http endpoint, " + upstream_endpoint
+        + " isn't, use DefaultEndpointsProtocol=http");
+  }
+  const auto authority_end = upstream_endpoint.find('/', scheme.length());
+  const std::string authority
+      = upstream_endpoint.substr(scheme.length(), authority_end - scheme.length());
+  if (authority_end != std::string::npos)
+  {
+    m_upstream_path = upstream_endpoint.substr(authority_end);
+    while (!m_upstream_path.empty() && m_upstream_path.back() == '/')
+    {
+      m_upstream_path.pop_back();
+    }
+  }
+  const auto colon = authority.find(':');
+  m_upstream_host = authority.substr(0, colon);
+  if (colon != std::string::npos)
+  {
+    try
+    {
+      m_upstream_port = static_cast<uint16_t>(std::stoi(authority.substr(colon + 1)));
+    }
+    catch (std::exception&)
+    {
+      throw std::invalid_argument("invalid port in " + upstream_endpoint);
+    }
+  }
+  if (m_upstream_host.empty())
+  {
+    throw std::invalid_argument("invalid endpoint " + upstream_endpoint);
+  }
+  if (m_profile.bandwidth > 0)
+  {
+    m_upstream_pacer = std::make_unique<pacer>(m_profile.bandwidth);
+    m_client_pacer = std::make_unique<pacer>(m_profile.bandwidth);
+  }
+
+  m_listen_socket = tcp_socket::listen_loopback();
+  m_port = m_listen_socket.local_port();
+  m_accept_thread = std::thread(&network_proxy::accept_loop, this);
+}
+
+network_proxy::~network_proxy()
+{
+  m_stopped = true;
+  m_listen_socket.shutdown();
+  // see ~mock_blob_server
+  try
+  {
+    tcp_socket::connect("127.0.0.1", m_port);
+  }
+  catch (std::exception&)
+  {
+  }
+  m_accept_thread.join();
+  m_listen_socket.close();
+
+  {
+    std::lock_guard<std::mutex> guard(m_connections_lock);
+    for (auto& c : m_connections)
+    {
+      c->to_upstream->close();
+      c->to_client->close();
+      c->client.shutdown();
+      c->upstream.shutdown();
+    }
+  }
+  // the accept thread, the only one to change m_connections, has ended
+  for (auto& c : m_connections)
+  {
+    c->thread.join();
+  }
+}
+
+std::string network_proxy::endpoint() const
+{
+  return "http://127.0.0.1:" + std::to_string(m_port) + m_upstream_path;
+}
+
+network_proxy::statistics network_proxy::stats() const
+{
+  statistics ret;
+  {
+    std::lock_guard<std::mutex> guard(m_connections_lock);
+    ret.connections = m_num_connections;
+  }
+  ret.requests = m_num_requests;
+  ret.resets = m_num_resets;
+  ret.server_busy = m_num_server_busy;
+  return ret;
+}
+
+void network_proxy::accept_loop()
+{
+  ignore_thread_allocations();
+  ignore_thread_cpu_usage();
+  const auto one_way_delay = std::chrono::microseconds(m_profile.rtt_ms * 1000 / 2);
+  const auto jitter = std::chrono::milliseconds(m_profile.jitter_ms);
+  while (!m_stopped)
+  {
+    tcp_socket client;
+    try
+    {
+      client = m_listen_socket.accept();
+    }
+    catch (std::exception& e)
+    {
+      if (m_stopped)
+      {
+        break;
+      }
+      // see mock_blob_server::accept_loop
+      spdlog::error("network proxy failed to accept connection: {}", e.what());
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      continue;
+    }
+    if (m_stopped)
+    {
+      break;
+    }
+    client.set_nodelay(true);
+
+    std::lock_guard<std::mutex> guard(m_connections_lock);
+    reap_connections();
+    auto c = std::make_unique<connection>();
+    c->client = std::move(client);
+    const uint64_t seed = m_profile.seed + 2 * static_cast<uint64_t>(m_num_connections++);
+    c->to_upstream = std::make_unique<delay_line>(one_way_delay, jitter, seed);
+    c->to_client = std::make_unique<delay_line>(one_way_delay, jitter, seed + 1);
+    connection* served = c.get();
+    c->thread = std::thread([this, served]() {
+      serve_connection(served);
+      std::lock_guard<std::mutex> guard(m_connections_lock);
+      served->done = true;
+    });
+    m_connections.push_back(std::move(c));
+  }
+}
+
+void network_proxy::reap_connections()
+{
+  for (auto ite = m_connections.begin(); ite != m_connections.end();)
+  {
+    if ((*ite)->done)
+    {
+      (*ite)->thread.join();
+      ite = m_connections.erase(ite);
+    }
+    else
+    {
+      ++ite;
+    }
+  }
+}
+
+void network_proxy::serve_connection(connection* c)
+{
+  ignore_thread_allocations();
+  ignore_thread_cpu_usage();
+  try
+  {
+    auto upstream = tcp_socket::connect(m_upstream_host, m_upstream_port);
+    upstream.set_nodelay(true);
+    std::lock_guard<std::mutex> guard(m_connections_lock);
+    if (m_stopped)
+    {
+      return;
+    }
+    c->upstream = std::move(upstream);
+  }
+  catch (std::exception& e)
+  {
+    spdlog::debug("network proxy failed to connect to {}: {}", m_upstream_host, e.what());
+    std::lock_guard<std::mutex> guard(m_connections_lock);
+    c->client.close();
+    return;
+  }
+
+  // a failed send ends both directions
+  auto tear_down = [this, c]() {
+    c->to_upstream->close();
+    c->to_client->close();
+    std::lock_guard<std::mutex> guard(m_connections_lock);
+    c->client.shutdown();
+    c->upstream.shutdown();
+  };
+  std::thread to_upstream([this, c, &tear_down]() {
+    ignore_thread_allocations();
+    ignore_thread_cpu_usage();
+    try
+    {
+      forward(*c->to_upstream, c->upstream, m_upstream_pacer.get());
+      c->upstream.shutdown();
+    }
+    catch (std::exception& e)
+    {
+      spdlog::debug("network proxy connection closed: {}", e.what());
+      tear_down();
+    }
+  });
+  std::thread from_upstream([c]() {
+    ignore_thread_allocations();
+    ignore_thread_cpu_usage();
+    uint8_t buffer[16_KB];
+    try
+    {
+      size_t n;
+      while ((n = c->upstream.recv_some(buffer, sizeof(buffer))) != 0
+             && c->to_client->push(std::vector<uint8_t>(buffer, buffer + n)))
+      {
+      }
+    }
+    catch (std::exception&)
+    {
+    }
+    c->to_client->finish();
+  });
+  std::thread to_client([this, c, &tear_down]() {
+    ignore_thread_allocations();
+    ignore_thread_cpu_usage();
+    try
+    {
+      forward(*c->to_client, c->client, m_client_pacer.get());
+      c->client.shutdown();
+    }
+    catch (std::exception& e)
+    {
+      spdlog::debug("network proxy connection closed: {}", e.what());
+      tear_down();
+    }
+  });
+
+  bool reset = false;
+  try
+  {
+    reset = forward_requests(*c);
+  }
+  catch (std::exception& e)
+  {
+    spdlog::debug("network proxy connection closed: {}", e.what());
+  }
+  if (reset)
+  {
+    c->to_upstream->close();
+    c->to_client->close();
+    std::lock_guard<std::mutex> guard(m_connections_lock);
+    c->upstream.shutdown();
+  }
+  else
+  {
+    c->to_upstream->finish();
+  }
+  to_upstream.join();
+  from_upstream.join();
+  to_client.join();
+
+  std::lock_guard<std::mutex> guard(m_connections_lock);
+  if (reset)
+  {
+    c->client.abort();
+  }
+  c->client.close();
+  c->upstream.close();
+}
+
+bool network_proxy::forward_requests(connection& c)
+{
+  const char head_end[] = "\r\n\r\n";
+  std::vector<uint8_t> pending;
+  uint64_t body_remaining = 0;
+  // false past a request whose body length isn't known, the rest is forwarded as is
+  bool inspect = true;
+  uint8_t buffer[16_KB];
+  while (true)
+  {
+    const size_t n = c.client.recv_some(buffer, sizeof(buffer));
+    if (n == 0)
+    {
+      return false;
+    }
+    pending.insert(pending.end(), buffer, buffer + n);
+    while (!pending.empty())
+    {
+      if (!inspect || body_remaining > 0)
+      {
+        const size_t length = inspect
+            ? static_cast<size_t>(std::min<uint64_t>(body_remaining, pending.size()))
+            : pending.size();
+        if (!c.to_upstream->push(std::vector<uint8_t>(pending.begin(), pending.begin() + length)))
+        {
+          return false;
+        }
+        pending.erase(pending.begin(), pending.begin() + length);
+        body_remaining -= inspect ? length : 0;
+        continue;
+      }
+
+      const auto end = std::search(pending.begin(), pending.end(), head_end, head_end + 4);
+      if (end == pending.end())
+      {
+        inspect = pending.size() <= max_head_size;
+        if (inspect)
+        {
+          break;
+        }
+        continue;
+      }
+      const std::string head(pending.begin(), end + 4);
+      pending.erase(pending.begin(), end + 4);
+
+      const std::string lower_head = to_lower(head);
+      auto header = [&lower_head](const std::string& name) {
+        const auto begin = lower_head.find("\r\n" + name + ":");
+        if (begin == std::string::npos)
+        {
+          return std::string();
+        }
+        const auto value_begin = lower_head.find_first_not_of(" \t", begin + name.length() + 3);
+        const auto value_end = lower_head.find("\r\n", value_begin);
+        return lower_head.substr(value_begin, value_end - value_begin);
+      };
+      const bool chunked = header("transfer-encoding").find("chunked") != std::string::npos;
+      const std::string content_length = header("content-length");
+      body_remaining = content_length.empty() ? 0 : std::stoull(content_length);
+      inspect = !chunked;
+
+      ++m_num_requests;
+      const auto f = pick_fault();
+      if (f == fault::reset)
+      {
+        ++m_num_resets;
+        return true;
+      }
+      if (f == fault::server_busy)
+      {
+        ++m_num_server_busy;
+        // a client that waits for 100 Continue doesn't send the body after a final response
+        if (header("expect") != "100-continue" && inspect)
+        {
+          const size_t from_pending
+              = static_cast<size_t>(std::min<uint64_t>(body_remaining, pending.size()));
+          body_remaining -= from_pending;
+          while (body_remaining > 0)
+          {
+            const size_t received = c.client.recv_some(
+                buffer, static_cast<size_t>(std::min<uint64_t>(body_remaining, sizeof(buffer))));
+            if (received == 0)
+            {
+              return false;
+            }
+            body_remaining -= received;
+          }
+        }
+        const std::string response = server_busy_response(head);
+        c.to_client->push(std::vector<uint8_t>(response.begin(), response.end()));
+        return false;
+      }
+
+      const std::string rewritten = rewrite_head(head);
+      if (!c.to_upstream->push(std::vector<uint8_t>(rewritten.begin(), rewritten.end())))
+      {
+        return false;
+      }
+    }
+  }
+}
+
+network_proxy::fault network_proxy::pick_fault()
+{
+  if (!m_profile.injects_faults())
+  {
+    return fault::none;
+  }
+  double x;
+  {
+    std::lock_guard<std::mutex> guard(m_random_lock);
+    x = std::uniform_real_distribution<double>(0.0, 1.0)(m_random);
+  }
+  if (x < m_profile.reset_probability)
+  {
+    return fault::reset;
+  }
+  if (x < m_profile.reset_probability + m_profile.server_busy_probability)
+  {
+    return fault::server_busy;
+  }
+  return fault::none;
+}
+
+std::string network_proxy::rewrite_head(const std::string& head) const
+{
+  std::string host = m_upstream_host;
+  if (m_upstream_port != 80)
+  {
+    host += ":" + std::to_string(m_upstream_port);
+  }
+  const auto begin = to_lower(head).find("\r\nhost:");
+  if (begin == std::string::npos)
+  {
+    return head.substr(0, head.length() - 2) + "Host: " + host + "\r\n\r\n";
+  }
+  const auto end = head.find("\r\n", begin + 2);
+  return head.substr(0, begin) + "\r\nHost: " + host + head.substr(end);
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "socket_utils.hh"
+
+// Network conditions network_proxy imposes between the transports and the blob endpoint.
+struct network_profile
+{
+  // added to every round trip, half of it each way
+  int rtt_ms = 0;
+  // every chunk is delayed by up to this much more each way, without reordering the stream
+  int jitter_ms = 0;
+  // bytes per second each way, shared by all connections, 0 for no cap
+  int64_t bandwidth = 0;
+  // probability that the connection of a request is reset instead of the request being forwarded
+  double reset_probability = 0.0;
+  // probability that a request is answered with 503 Server Busy instead of being forwarded
+  double server_busy_probability = 0.0;
+  // of the generator that picks the requests to fail, runs that issue requests in the same order
+  // fail the same ones
+  uint64_t seed = 1;
+  // times an operation that failed is retried when faults are injected, before the trial fails
+  int max_retries = 3;
+  // before the first retry, doubling with every further retry
+  int retry_backoff_ms = 100;
+
+  bool enabled() const
+  {
+    return rtt_ms > 0 || jitter_ms > 0 || bandwidth > 0 || injects_faults();
+  }
+  bool injects_faults() const { return reset_probability > 0.0 || server_busy_probability > 0.0; }
+};
+
+/*
+ * Loopback proxy in front of an http blob endpoint that shapes the traffic to a network_profile.
+ * Every connection is forwarded over a connection of its own to the endpoint. Bytes are delayed and
+ * paced each way, and request heads are parsed to inject faults per request and to rewrite the
+ * Host header, so a real account can be reached over http too. A request answered with Server
+ * Busy closes its connection after the response. TLS can't be looked into, https endpoints aren't
+ * supported, and a request with a chunked body ends fault injection on its connection.
+ */
+class network_proxy {
+public:
+  struct statistics
+  {
+    int64_t connections = 0;
+    int64_t requests = 0;
+    int64_t resets = 0;
+    int64_t server_busy = 0;
+  };
+
+  // throws std::invalid_argument if upstream_endpoint isn't http://host[:port][/path]
+  network_proxy(const std::string& upstream_endpoint, const network_profile& profile);
+  network_proxy(const network_proxy&) = delete;
+  network_proxy& operator=(const network_proxy&) = delete;
+  ~network_proxy();
+
+  uint16_t port() const { return m_port; }
+  // the upstream endpoint with the address of the proxy, e.g. http://127.0.0.1:40000/account
+  std::string endpoint() const;
+  statistics stats() const;
+
+  class delay_line;
+  class pacer;
+
+private:
+  struct connection
+  {
+    tcp_socket client;
+    tcp_socket upstream;
+    std::unique_ptr<delay_line> to_upstream;
+    std::unique_ptr<delay_line> to_client;
+    std::thread thread;
+    // set by thread when it's about to end, guarded by m_connections_lock
+    bool done = false;
+  };
+  enum class fault
+  {
+    none,
+    reset,
+    server_busy,
+  };
+
+  void accept_loop();
+  // joins and drops the connections that have been served, m_connections_lock must be held
+  void reap_connections();
+  void serve_connection(connection* c);
+  // forwards the requests of the client until it closes the connection, returns true if the
+  // connection is to be reset
+  bool forward_requests(connection& c);
+  fault pick_fault();
+  std::string rewrite_head(const std::string& head) const;
+
+  const network_profile m_profile;
+  std::string m_upstream_host;
+  uint16_t m_upstream_port = 80;
+  // the path of the upstream endpoint, e.g. /devstoreaccount1
+  std::string m_upstream_path;
+
+  std::unique_ptr<pacer> m_upstream_pacer;
+  std::unique_ptr<pacer> m_client_pacer;
+  std::mutex m_random_lock;
+  std::mt19937_64 m_random;
+
+  uint16_t m_port = 0;
+  tcp_socket m_listen_socket;
+  std::thread m_accept_thread;
+  std::atomic<bool> m_stopped{false};
+
+  mutable std::mutex m_connections_lock;
+  // connections being served
+  std::vector<std::unique_ptr<connection>> m_connections;
+  int64_t m_num_connections = 0;
+
+  std::atomic<int64_t> m_num_requests{0};
+  std::atomic<int64_t> m_num_resets{0};
+  std::atomic<int64_t> m_num_server_busy{0};
+};
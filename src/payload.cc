@@ -0,0 +1,192 @@
+#include "payload.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "worker_pool.hh"
+
+namespace {
+
+constexpr size_t block_size = 4096;
+// below this a buffer isn't worth splitting over threads
+constexpr size_t min_chunk_size = 16 * 1024 * 1024;
+constexpr uint64_t golden_gamma = 0x9e3779b97f4a7c15;
+
+// SplitMix64 output function, a bijection with good avalanche
+inline uint64_t mix(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+// 64 words so that a word is picked by 6 random bits
+constexpr const char* text_words[64] = {
+    "the",     "of",      "and",    "to",     "in",       "is",      "that",    "for",
+    "it",      "as",      "was",    "with",   "be",       "by",      "on",      "not",
+    "he",      "this",    "are",    "or",     "his",      "from",    "at",      "which",
+    "but",     "have",    "an",     "had",    "they",     "you",     "were",    "their",
+    "one",     "all",     "we",     "can",    "her",      "has",     "there",   "been",
+    "if",      "more",    "when",   "will",   "would",    "who",     "so",      "no",
+    "storage", "account", "blob",   "client", "request",  "response", "service", "transfer",
+    "upload",  "download", "block", "chunk",  "container", "latency", "network", "benchmark",
+};
+
+void fill_random(uint8_t* buffer, size_t begin, size_t end, uint64_t seed)
+{
+  const uint64_t key = mix(seed + golden_gamma);
+  size_t offset = begin;
+  for (; offset + sizeof(uint64_t) <= end; offset += sizeof(uint64_t))
+  {
+    const uint64_t value = mix(key + (offset / sizeof(uint64_t)) * golden_gamma);
+    std::memcpy(buffer + offset, &value, sizeof(value));
+  }
+  if (offset < end)
+  {
+    const uint64_t value = mix(key + (offset / sizeof(uint64_t)) * golden_gamma);
+    std::memcpy(buffer + offset, &value, end - offset);
+  }
+}
+
+// a word followed by a space, padded so that it's copied with a fixed-size memcpy
+struct text_word
+{
+  char bytes[16];
+  size_t length;
+};
+
+const std::vector<text_word>& get_text_words()
+{
+  static const std::vector<text_word> words = []() {
+    std::vector<text_word> ret;
+    for (const char* word : text_words)
+    {
+      text_word w{};
+      w.length = std::strlen(word) + 1;
+      std::memcpy(w.bytes, word, w.length - 1);
+      w.bytes[w.length - 1] = ' ';
+      ret.push_back(w);
+    }
+    return ret;
+  }();
+  return words;
+}
+
+void fill_text_block(uint8_t* buffer, size_t length, uint64_t key)
+{
+  const auto& words = get_text_words();
+  size_t pos = 0;
+  uint64_t counter = key;
+  uint64_t bits = 0;
+  int num_bits = 0;
+  while (pos < length)
+  {
+    if (num_bits < 10)
+    {
+      bits = mix(counter += golden_gamma);
+      num_bits = 64;
+    }
+    const text_word& word = words[bits & 63];
+    if (pos + sizeof(word.bytes) <= length)
+    {
+      std::memcpy(buffer + pos, word.bytes, sizeof(word.bytes));
+    }
+    else
+    {
+      std::memcpy(buffer + pos, word.bytes, std::min(word.length, length - pos));
+    }
+    pos += word.length;
+    // one line break every 16 words on average
+    if ((bits >> 6 & 15) == 0 && pos <= length)
+    {
+      buffer[pos - 1] = '\n';
+    }
+    bits >>= 10;
+    num_bits -= 10;
+  }
+}
+
+// begin is a multiple of block_size
+void fill_range(
+    uint8_t* buffer,
+    size_t begin,
+    size_t end,
+    payload_profile profile,
+    uint64_t seed)
+{
+  switch (profile)
+  {
+    case payload_profile::zeros:
+      std::memset(buffer + begin, 0, end - begin);
+      break;
+    case payload_profile::text:
+    {
+      const uint64_t key = mix(seed);
+      for (size_t offset = begin; offset < end; offset += block_size)
+      {
+        fill_text_block(
+            buffer + offset,
+            std::min(block_size, end - offset),
+            mix(key + (offset / block_size) * golden_gamma));
+      }
+      break;
+    }
+    case payload_profile::random:
+    case payload_profile::unique:
+      fill_random(buffer, begin, end, seed);
+      break;
+  }
+}
+
+} // namespace
+
+std::string to_string(payload_profile profile)
+{
+  switch (profile)
+  {
+    case payload_profile::random:
+      return "random";
+    case payload_profile::text:
+      return "text";
+    case payload_profile::zeros:
+      return "zeros";
+    case payload_profile::unique:
+      return "unique";
+  }
+  return "unknown";
+}
+
+void fill_payload(uint8_t* buffer, size_t size, payload_profile profile, uint64_t seed)
+{
+  fill_range(buffer, 0, size, profile, seed);
+}
+
+void fill_payload_parallel(uint8_t* buffer, size_t size, payload_profile profile, uint64_t seed)
+{
+  const int num_threads = static_cast<int>(std::min<size_t>(
+      size / min_chunk_size, std::max(std::thread::hardware_concurrency(), 1u)));
+  if (num_threads <= 1)
+  {
+    fill_payload(buffer, size, profile, seed);
+    return;
+  }
+  const size_t num_blocks = (size + block_size - 1) / block_size;
+  const size_t chunk_size = (num_blocks + num_threads - 1) / num_threads * block_size;
+  benchmark_worker_pool().run(num_threads, [&](int thread_id) {
+    const size_t begin = std::min(size, thread_id * chunk_size);
+    const size_t end = std::min(size, begin + chunk_size);
+    fill_range(buffer, begin, end, profile, seed);
+  });
+}
+
+void stamp_payload(uint8_t* buffer, size_t size, uint64_t id)
+{
+  const uint64_t key = mix(id ^ golden_gamma);
+  for (size_t offset = 0; offset < size; offset += block_size)
+  {
+    const uint64_t value = mix(key + (offset / block_size) * golden_gamma);
+    std::memcpy(buffer + offset, &value, std::min(sizeof(value), size - offset));
+  }
+}
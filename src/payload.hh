@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum class payload_profile
+{
+  // incompressible pseudo-random bytes
+  random,
+  // English-like words, compresses about as well as plain text
+  text,
+  zeros,
+  // random, and every uploaded blob differs from every other in each 4KB block
+  unique,
+};
+
+std::string to_string(payload_profile profile);
+
+/*
+ * Fills size bytes with content of the given profile, the same seed always produces the same
+ * content. Every 8-byte word (every 4KB block for text) is computed from its position alone, so
+ * the loop has no carried dependency and vectorizes, and any split of the buffer produces the same
+ * content as a single pass.
+ */
+void fill_payload(uint8_t* buffer, size_t size, payload_profile profile, uint64_t seed = 0);
+// Same content as fill_payload, large buffers are split over the benchmark worker pool. Must not be
+// called from a worker.
+void fill_payload_parallel(
+    uint8_t* buffer,
+    size_t size,
+    payload_profile profile,
+    uint64_t seed = 0);
+// Overwrites the first 8 bytes of every 4KB block with a value derived from id, so that contents
+// stamped with different ids share no block.
+void stamp_payload(uint8_t* buffer, size_t size, uint64_t id);
+
+// Version of the content fill_payload and stamp_payload produce, bump it whenever it changes so
+// test blobs uploaded by earlier builds are recognised as stale.
+constexpr int payload_version = 1;
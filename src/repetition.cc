@@ -0,0 +1,139 @@
+#include "repetition.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+// two-sided quantiles for 1 to 30 degrees of freedom
+constexpr size_t t_table_size = 30;
+constexpr double t_90[t_table_size]
+    = {6.314, 2.920, 2.353, 2.132, 2.015, 1.943, 1.895, 1.860, 1.833, 1.812,
+       1.796, 1.782, 1.771, 1.761, 1.753, 1.746, 1.740, 1.734, 1.729, 1.725,
+       1.721, 1.717, 1.714, 1.711, 1.708, 1.706, 1.703, 1.701, 1.699, 1.697};
+constexpr double t_95[t_table_size]
+    = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+       2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+       2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+constexpr double t_99[t_table_size]
+    = {63.657, 9.925, 5.841, 4.604, 4.032, 3.707, 3.499, 3.355, 3.250, 3.169,
+       3.106,  3.055, 3.012, 2.977, 2.947, 2.921, 2.898, 2.878, 2.861, 2.845,
+       2.831,  2.819, 2.807, 2.797, 2.787, 2.779, 2.771, 2.763, 2.756, 2.750};
+
+double median(std::vector<double> values)
+{
+  const size_t mid = values.size() / 2;
+  std::nth_element(values.begin(), values.begin() + mid, values.end());
+  if (values.size() % 2 == 1)
+  {
+    return values[mid];
+  }
+  return (values[mid] + *std::max_element(values.begin(), values.begin() + mid)) / 2.0;
+}
+
+} // namespace
+
+double student_t_quantile(double confidence, size_t degrees_of_freedom)
+{
+  const double* table;
+  double z;
+  if (std::abs(confidence - 0.9) < 1e-9)
+  {
+    table = t_90;
+    z = 1.645;
+  }
+  else if (std::abs(confidence - 0.95) < 1e-9)
+  {
+    table = t_95;
+    z = 1.960;
+  }
+  else if (std::abs(confidence - 0.99) < 1e-9)
+  {
+    table = t_99;
+    z = 2.576;
+  }
+  else
+  {
+    throw std::invalid_argument("confidence must be 0.9, 0.95 or 0.99");
+  }
+  if (degrees_of_freedom == 0)
+  {
+    return std::numeric_limits<double>::infinity();
+  }
+  if (degrees_of_freedom <= t_table_size)
+  {
+    return table[degrees_of_freedom - 1];
+  }
+  // first terms of the Cornish-Fisher expansion, within 0.1% of the exact quantile from here on
+  const double df = static_cast<double>(degrees_of_freedom);
+  const double z3 = z * z * z;
+  const double z5 = z3 * z * z;
+  return z + (z3 + z) / (4.0 * df) + (5.0 * z5 + 16.0 * z3 + 3.0 * z) / (96.0 * df * df);
+}
+
+throughput_estimate estimate_throughput(
+    const std::vector<double>& bytes_per_second,
+    const repetition_settings& settings)
+{
+  throughput_estimate ret;
+  if (bytes_per_second.empty())
+  {
+    ret.ci_half_width = std::numeric_limits<double>::infinity();
+    return ret;
+  }
+
+  std::vector<double> kept;
+  const double m = median(bytes_per_second);
+  std::vector<double> deviations;
+  for (double x : bytes_per_second)
+  {
+    deviations.push_back(std::abs(x - m));
+  }
+  const double mad = median(deviations);
+  for (size_t i = 0; i < bytes_per_second.size(); ++i)
+  {
+    // with a MAD of 0 most trials are identical and nothing stands out reliably
+    if (bytes_per_second.size() >= 3 && mad > 0.0
+        && 0.6745 * deviations[i] / mad > settings.outlier_threshold)
+    {
+      ret.outliers.push_back(i);
+    }
+    else
+    {
+      kept.push_back(bytes_per_second[i]);
+    }
+  }
+
+  double sum = 0.0;
+  for (double x : kept)
+  {
+    sum += x;
+  }
+  const double n = static_cast<double>(kept.size());
+  ret.mean = sum / n;
+  if (kept.size() < 2)
+  {
+    ret.ci_half_width = std::numeric_limits<double>::infinity();
+    return ret;
+  }
+  double variance = 0.0;
+  for (double x : kept)
+  {
+    variance += (x - ret.mean) * (x - ret.mean);
+  }
+  variance /= n - 1.0;
+  ret.ci_half_width
+      = student_t_quantile(settings.confidence, kept.size() - 1) * std::sqrt(variance / n);
+  return ret;
+}
+
+bool is_converged(
+    const throughput_estimate& estimate,
+    size_t trials,
+    const repetition_settings& settings)
+{
+  return trials >= static_cast<size_t>(settings.min_trials)
+      && estimate.relative_ci() <= settings.target_ci;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+struct repetition_settings
+{
+  // repeat a cell until its throughput is known precisely enough instead of repeat times
+  bool adaptive = false;
+  int min_trials = 3;
+  int max_trials = 15;
+  // a cell is done once the confidence interval of its mean throughput is within this fraction of
+  // the mean
+  double target_ci = 0.05;
+  // 0.9, 0.95 or 0.99
+  double confidence = 0.95;
+  // trials whose modified z-score exceeds this are outliers and left out of the estimate
+  double outlier_threshold = 3.5;
+};
+
+struct throughput_estimate
+{
+  // mean bytes/s of the trials that aren't outliers
+  double mean = 0.0;
+  // half width of the confidence interval of mean, infinite with less than two trials
+  double ci_half_width = 0.0;
+  // indexes of the trials left out
+  std::vector<size_t> outliers;
+
+  double relative_ci() const { return mean > 0.0 ? ci_half_width / mean : ci_half_width; }
+};
+
+// throws std::invalid_argument if confidence isn't one of the supported levels
+double student_t_quantile(double confidence, size_t degrees_of_freedom);
+/*
+ * Mean and Student t confidence interval of the throughput of the trials of a cell. Outliers are
+ * found with the modified z-score, 0.6745 * |x - median| / MAD. A single slow trial inflates the
+ * standard deviation enough to hide from a plain z-score, but barely moves the MAD.
+ */
+throughput_estimate estimate_throughput(
+    const std::vector<double>& bytes_per_second,
+    const repetition_settings& settings);
+bool is_converged(
+    const throughput_estimate& estimate,
+    size_t trials,
+    const repetition_settings& settings);
@@ -0,0 +1,113 @@
+#include "request_timing.hh"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+constexpr size_t num_request_phases = static_cast<size_t>(request_phase::body) + 1;
+
+/*
+ * Every thread records into histograms of its own so that workers don't contend while a case
+ * runs, the lock of a thread's histograms is only ever contended by take_request_phases().
+ */
+struct thread_phases
+{
+  std::mutex lock;
+  latency_histogram histograms[num_request_phases];
+};
+
+struct phase_registry
+{
+  std::mutex lock;
+  std::vector<thread_phases*> threads;
+  // recorded by threads that have exited since the previous take_request_phases()
+  request_phase_histograms retired;
+};
+
+phase_registry& registry()
+{
+  static phase_registry registry;
+  return registry;
+}
+
+// moves what t recorded into histograms, t.lock has to be held
+void take_thread_phases(thread_phases& t, request_phase_histograms& histograms)
+{
+  for (size_t i = 0; i < num_request_phases; ++i)
+  {
+    if (t.histograms[i].count() != 0)
+    {
+      histograms[static_cast<request_phase>(i)].merge(t.histograms[i]);
+      t.histograms[i].reset();
+    }
+  }
+}
+
+class registered_thread_phases {
+public:
+  registered_thread_phases()
+  {
+    auto& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.threads.push_back(&m_phases);
+  }
+  ~registered_thread_phases()
+  {
+    auto& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.threads.erase(std::find(r.threads.begin(), r.threads.end(), &m_phases));
+    std::lock_guard<std::mutex> phases_guard(m_phases.lock);
+    take_thread_phases(m_phases, r.retired);
+  }
+
+  thread_phases& get() { return m_phases; }
+
+private:
+  thread_phases m_phases;
+};
+
+} // namespace
+
+std::string to_string(request_phase phase)
+{
+  switch (phase)
+  {
+    case request_phase::build:
+      return "build";
+    case request_phase::sign:
+      return "sign";
+    case request_phase::connect:
+      return "connect";
+    case request_phase::tls:
+      return "tls";
+    case request_phase::first_byte:
+      return "first_byte";
+    case request_phase::body:
+      return "body";
+  }
+  return "unknown";
+}
+
+void record_request_phase(request_phase phase, std::chrono::nanoseconds duration)
+{
+  thread_local registered_thread_phases phases;
+  auto& t = phases.get();
+  std::lock_guard<std::mutex> guard(t.lock);
+  t.histograms[static_cast<size_t>(phase)].record(duration);
+}
+
+request_phase_histograms take_request_phases()
+{
+  request_phase_histograms ret;
+  auto& r = registry();
+  std::lock_guard<std::mutex> guard(r.lock);
+  ret.swap(r.retired);
+  for (auto* t : r.threads)
+  {
+    std::lock_guard<std::mutex> phases_guard(t->lock);
+    take_thread_phases(*t, ret);
+  }
+  return ret;
+}
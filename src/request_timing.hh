@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <string>
+
+#include "histogram.hh"
+
+/*
+ * Phases of a single HTTP request. Transports report the phases they can observe, a phase that a
+ * transport can't separate from the next one is counted in the next one.
+ */
+enum class request_phase
+{
+  // from the call into the client library until its request is ready to be signed
+  build,
+  // authorization, for Track2 every per-retry policy of the pipeline
+  sign,
+  // TCP connect of a new connection
+  connect,
+  // TLS handshake of a new connection
+  tls,
+  // from handing the request to the HTTP stack until the response headers or, for responses
+  // without body, until the end of the response; includes connect and TLS where they aren't
+  // reported on their own
+  first_byte,
+  // receiving the response body
+  body,
+};
+
+std::string to_string(request_phase phase);
+
+using request_phase_histograms = std::map<request_phase, latency_histogram>;
+
+// Can be called from any thread, records into histograms of the calling thread.
+void record_request_phase(request_phase phase, std::chrono::nanoseconds duration);
+// Returns what has been recorded since the previous call.
+request_phase_histograms take_request_phases();
@@ -0,0 +1,192 @@
+#include "results.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <azure/core/datetime.hpp>
+
+results_writer::results_writer(const std::string& path)
+{
+  if (!path.empty())
+  {
+    m_file.open(path, std::ios::out | std::ios::app);
+    if (!m_file)
+    {
+      throw std::runtime_error("cannot open results file " + path);
+    }
+  }
+}
+
+void results_writer::write(nlohmann::json record)
+{
+  const std::string line = record.dump() + "\n";
+  std::lock_guard<std::mutex> guard(m_lock);
+  m_content += line;
+  if (m_file.is_open())
+  {
+    m_file << line;
+    m_file.flush();
+  }
+}
+
+std::string results_writer::content(size_t offset) const
+{
+  std::lock_guard<std::mutex> guard(m_lock);
+  return m_content.substr(std::min(offset, m_content.length()));
+}
+
+nlohmann::json to_json(const transfer_configuration& transfer_config)
+{
+  nlohmann::json j;
+  j["blob_size"] = transfer_config.blob_size;
+  j["num_blobs"] = transfer_config.num_blobs;
+  j["concurrency"] = transfer_config.concurrency;
+  j["target_rate"] = transfer_config.target_rate;
+  j["arrivals"] = to_string(transfer_config.arrivals);
+  j["download_sink"] = to_string(transfer_config.download_sink);
+  j["sink_size"] = transfer_config.sink_size;
+  j["payload"] = to_string(transfer_config.payload);
+  j["verify"] = to_string(transfer_config.verify);
+  j["transactional_hash"] = to_string(transfer_config.transactional_hash);
+  return j;
+}
+
+nlohmann::json to_json(const transport_tuning& tuning)
+{
+  auto or_null = [](bool is_set, nlohmann::json value) { return is_set ? value : nullptr; };
+  nlohmann::json j;
+  j["connection_pool_size"]
+      = or_null(tuning.connection_pool_size > 0, tuning.connection_pool_size);
+  j["tcp_nodelay"] = or_null(tuning.tcp_nodelay >= 0, tuning.tcp_nodelay == 1);
+  j["socket_send_buffer"] = or_null(tuning.socket_send_buffer > 0, tuning.socket_send_buffer);
+  j["socket_receive_buffer"]
+      = or_null(tuning.socket_receive_buffer > 0, tuning.socket_receive_buffer);
+  j["http_version"] = or_null(!tuning.http_version.empty(), tuning.http_version);
+  j["tls_session_reuse"] = or_null(tuning.tls_session_reuse >= 0, tuning.tls_session_reuse == 1);
+  j["receive_buffer"] = or_null(tuning.receive_buffer > 0, tuning.receive_buffer);
+  return j;
+}
+
+nlohmann::json to_json(const transfer_result& result)
+{
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+
+  nlohmann::json j;
+  j["total_time_ms"] = result.total_time_ms.count();
+  j["operations"] = result.latency.count();
+  j["ops_per_second"] = result.ops_per_second;
+  j["bytes_per_second"] = result.bytes_per_second;
+  j["retried_operations"] = result.retried_operations;
+  j["latency_us"] = {
+      {"min", duration_cast<microseconds>(result.latency.min()).count()},
+      {"mean", duration_cast<microseconds>(result.latency.mean()).count()},
+      {"p50", result.latency_percentiles.p50.count()},
+      {"p90", result.latency_percentiles.p90.count()},
+      {"p99", result.latency_percentiles.p99.count()},
+      {"p999", result.latency_percentiles.p999.count()},
+      {"max", result.latency_percentiles.max.count()},
+  };
+  const double operations = static_cast<double>(result.latency.count());
+  nlohmann::json cpu = {
+      {"user_us", result.cpu.user_time.count()},
+      {"system_us", result.cpu.system_time.count()},
+      {"worker_us", result.cpu.worker_time.count()},
+      {"us_per_operation",
+       operations > 0 ? static_cast<double>(result.cpu.total_time().count()) / operations : 0.0},
+  };
+  if (result.cpu.voluntary_context_switches >= 0)
+  {
+    cpu["voluntary_context_switches"] = result.cpu.voluntary_context_switches;
+    cpu["involuntary_context_switches"] = result.cpu.involuntary_context_switches;
+  }
+  if (result.cpu.cycles >= 0)
+  {
+    cpu["cycles"] = result.cpu.cycles;
+    cpu["cycles_per_byte"] = result.bytes_transferred > 0
+        ? static_cast<double>(result.cpu.cycles) / static_cast<double>(result.bytes_transferred)
+        : 0.0;
+  }
+  if (result.cpu.instructions >= 0)
+  {
+    cpu["instructions"] = result.cpu.instructions;
+  }
+  if (result.cpu.cache_misses >= 0)
+  {
+    cpu["cache_misses"] = result.cpu.cache_misses;
+  }
+  j["cpu"] = std::move(cpu);
+  nlohmann::json memory;
+  if (result.memory.allocations >= 0)
+  {
+    memory["allocations"] = result.memory.allocations;
+    memory["bytes_allocated"] = result.memory.bytes_allocated;
+    memory["allocations_per_operation"] = operations > 0
+        ? static_cast<double>(result.memory.allocations) / operations
+        : 0.0;
+    memory["bytes_allocated_per_operation"] = operations > 0
+        ? static_cast<double>(result.memory.bytes_allocated) / operations
+        : 0.0;
+  }
+  if (result.memory.peak_rss >= 0)
+  {
+    memory["start_rss"] = result.memory.start_rss;
+    memory["peak_rss"] = result.memory.peak_rss;
+  }
+  if (!memory.is_null())
+  {
+    j["memory"] = std::move(memory);
+  }
+  if (!result.request_phases.empty())
+  {
+    nlohmann::json phases;
+    for (const auto& p : result.request_phases)
+    {
+      const auto summary = latency_summary::from(p.second);
+      phases[to_string(p.first)] = {
+          {"count", p.second.count()},
+          {"mean", duration_cast<microseconds>(p.second.mean()).count()},
+          {"p50", summary.p50.count()},
+          {"p90", summary.p90.count()},
+          {"p99", summary.p99.count()},
+          {"max", summary.max.count()},
+      };
+    }
+    j["request_phases_us"] = std::move(phases);
+  }
+  if (!result.stages.empty())
+  {
+    nlohmann::json stages;
+    for (const auto& p : result.stages)
+    {
+      const auto summary = latency_summary::from(p.second);
+      stages[p.first] = {
+          {"count", p.second.count()},
+          {"mean", duration_cast<microseconds>(p.second.mean()).count()},
+          {"p50", summary.p50.count()},
+          {"p90", summary.p90.count()},
+          {"p99", summary.p99.count()},
+          {"max", summary.max.count()},
+      };
+    }
+    j["stages_us"] = std::move(stages);
+  }
+  if (!result.timeline.empty())
+  {
+    nlohmann::json timeline = {{"interval_ms", result.sample_interval.count()}};
+    for (const auto& s : result.timeline)
+    {
+      timeline["bytes"].push_back(s.bytes);
+      timeline["operations"].push_back(s.operations);
+      timeline["in_flight"].push_back(s.in_flight);
+    }
+    j["timeline"] = std::move(timeline);
+  }
+  return j;
+}
+
+std::string to_timestamp(std::chrono::system_clock::time_point time)
+{
+  return Azure::DateTime(time).ToString(
+      Azure::DateTime::DateFormat::Rfc3339, Azure::DateTime::TimeFractionFormat::AllDigits);
+}
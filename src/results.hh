@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include "cases.hh"
+
+/*
+ * Machine-readable results of a run, one JSON object per line. A run writes one "suite" record
+ * describing the environment and the matrix, one "trial" record per finished trial and an "end"
+ * record. Records are appended to a local file if a path is given and kept in memory so that they
+ * can be uploaded next to the log.
+ */
+class results_writer {
+public:
+  // empty path keeps the records in memory only
+  explicit results_writer(const std::string& path);
+
+  void write(nlohmann::json record);
+  // records written so far, starting at byte offset of the content
+  std::string content(size_t offset = 0) const;
+
+private:
+  mutable std::mutex m_lock;
+  std::ofstream m_file;
+  std::string m_content;
+};
+
+nlohmann::json to_json(const transfer_configuration& transfer_config);
+// knobs at their defaults are null
+nlohmann::json to_json(const transport_tuning& tuning);
+// everything measured in a trial except what identifies it
+nlohmann::json to_json(const transfer_result& result);
+// RFC 3339 with fractional seconds, in UTC
+std::string to_timestamp(std::chrono::system_clock::time_point time);
@@ -0,0 +1,1242 @@
+#include "settings.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+
+#include <nlohmann/json.hpp>
+
+#include "constants.hh"
+#include "transport.hh"
+#include "utilities.hh"
+
+namespace {
+
+benchmark_settings& mutable_settings()
+{
+  static benchmark_settings s;
+  return s;
+}
+
+std::vector<benchmark_settings::matrix_group> default_matrix()
+{
+  std::vector<benchmark_settings::matrix_group> matrix;
+
+  benchmark_settings::matrix_group transfer_group;
+  transfer_group.cases.push_back({"download"});
+  transfer_group.cases.push_back({"upload"});
+  transfer_group.transfer_configs.push_back({5, 10000, 32});
+  transfer_group.transfer_configs.push_back({10_KB, 10000, 32});
+  transfer_group.transfer_configs.push_back({10_MB, 1000, 32});
+  transfer_group.transfer_configs.push_back({1_GB, 32, 8});
+  transfer_group.transfer_configs.push_back({1_GB, 128, 32});
+  for (auto& c : transfer_group.transfer_configs)
+  {
+    // a full-size sink per thread doesn't fit in memory for large blobs
+    if (c.blob_size > static_cast<int64_t>(64_MB))
+    {
+      c.download_sink = download_sink_type::ring_buffer;
+    }
+  }
+  matrix.push_back(std::move(transfer_group));
+
+  // single-blob throughput of chunked transfers against chunk size and per-blob concurrency
+  benchmark_settings::matrix_group parallel_group;
+  for (size_t chunk_size : {4_MB, 16_MB, 64_MB})
+  {
+    for (int per_blob_concurrency : {4, 16, 32})
+    {
+      parallel_group.cases.push_back({"parallel_download", chunk_size, per_blob_concurrency});
+      parallel_group.cases.push_back({"parallel_upload", chunk_size, per_blob_concurrency});
+    }
+  }
+  parallel_group.transfer_configs.push_back({1_GB, 4, 1});
+  matrix.push_back(std::move(parallel_group));
+
+  return matrix;
+}
+
+// "4MB", "10KB", "1GB" or a number of bytes
+int64_t parse_size(const std::string& str)
+{
+  size_t pos = 0;
+  int64_t value;
+  try
+  {
+    value = std::stoll(str, &pos);
+  }
+  catch (std::exception&)
+  {
+    throw std::invalid_argument("invalid size " + str);
+  }
+  std::string unit = str.substr(pos);
+  std::transform(unit.begin(), unit.end(), unit.begin(), [](unsigned char c) {
+    return static_cast<char>(std::toupper(c));
+  });
+  if (unit.empty() || unit == "B")
+  {
+    return value;
+  }
+  else if (unit == "KB")
+  {
+    return value * static_cast<int64_t>(1_KB);
+  }
+  else if (unit == "MB")
+  {
+    return value * static_cast<int64_t>(1_MB);
+  }
+  else if (unit == "GB")
+  {
+    return value * static_cast<int64_t>(1_GB);
+  }
+  throw std::invalid_argument("invalid size " + str);
+}
+
+int64_t parse_size(const nlohmann::json& j)
+{
+  return j.is_string() ? parse_size(j.get<std::string>()) : j.get<int64_t>();
+}
+
+arrival_process parse_arrival_process(const std::string& str)
+{
+  if (str == "constant")
+  {
+    return arrival_process::constant;
+  }
+  else if (str == "poisson")
+  {
+    return arrival_process::poisson;
+  }
+  throw std::invalid_argument("invalid arrival process " + str);
+}
+
+affinity_policy parse_cpu_affinity(const std::string& str)
+{
+  for (auto affinity :
+       {affinity_policy::none, affinity_policy::compact, affinity_policy::scatter})
+  {
+    if (str == to_string(affinity))
+    {
+      return affinity;
+    }
+  }
+  throw std::invalid_argument("invalid CPU affinity " + str);
+}
+
+payload_profile parse_payload_profile(const std::string& str)
+{
+  for (auto profile : {payload_profile::random,
+                       payload_profile::text,
+                       payload_profile::zeros,
+                       payload_profile::unique})
+  {
+    if (str == to_string(profile))
+    {
+      return profile;
+    }
+  }
+  throw std::invalid_argument("invalid payload " + str);
+}
+
+verification parse_verification(const std::string& str)
+{
+  for (auto method :
+       {verification::none, verification::compare, verification::crc64, verification::md5})
+  {
+    if (str == to_string(method))
+    {
+      return method;
+    }
+  }
+  throw std::invalid_argument("invalid verification " + str);
+}
+
+hash_algorithm parse_transactional_hash(const std::string& str)
+{
+  for (auto hash : {hash_algorithm::none, hash_algorithm::md5, hash_algorithm::crc64})
+  {
+    if (str == to_string(hash))
+    {
+      return hash;
+    }
+  }
+  throw std::invalid_argument("invalid transactional hash " + str);
+}
+
+download_sink_type parse_download_sink(const std::string& str)
+{
+  if (str == "buffer")
+  {
+    return download_sink_type::buffer;
+  }
+  else if (str == "ring_buffer")
+  {
+    return download_sink_type::ring_buffer;
+  }
+  else if (str == "discard")
+  {
+    return download_sink_type::discard;
+  }
+  throw std::invalid_argument("invalid download sink " + str);
+}
+
+void check_keys(const nlohmann::json& j, const std::vector<std::string>& keys, const char* what)
+{
+  if (!j.is_object())
+  {
+    throw std::invalid_argument(std::string(what) + " must be an object");
+  }
+  for (const auto& item : j.items())
+  {
+    if (std::find(keys.begin(), keys.end(), item.key()) == keys.end())
+    {
+      throw std::invalid_argument(std::string("unknown key ") + item.key() + " in " + what);
+    }
+  }
+}
+
+transfer_configuration parse_transfer_config(const nlohmann::json& j)
+{
+  check_keys(
+      j,
+      {"blob_size",
+       "num_blobs",
+       "concurrency",
+       "target_rate",
+       "arrivals",
+       "download_sink",
+       "sink_size",
+       "payload",
+       "verify",
+       "transactional_hash"},
+      "transfer config");
+  transfer_configuration c{
+      parse_size(j.at("blob_size")),
+      j.at("num_blobs").get<int>(),
+      j.at("concurrency").get<int>()};
+  if (j.contains("target_rate"))
+  {
+    c.target_rate = j["target_rate"].get<double>();
+  }
+  if (j.contains("arrivals"))
+  {
+    c.arrivals = parse_arrival_process(j["arrivals"].get<std::string>());
+  }
+  if (j.contains("download_sink"))
+  {
+    c.download_sink = parse_download_sink(j["download_sink"].get<std::string>());
+  }
+  else if (c.blob_size > static_cast<int64_t>(64_MB))
+  {
+    // as in the default matrix, a full-size sink per thread doesn't fit in memory for large blobs
+    c.download_sink = download_sink_type::ring_buffer;
+  }
+  if (j.contains("sink_size"))
+  {
+    const int64_t sink_size = parse_size(j["sink_size"]);
+    if (sink_size <= 0)
+    {
+      throw std::invalid_argument("sink_size must be positive");
+    }
+    c.sink_size = static_cast<size_t>(sink_size);
+  }
+  if (j.contains("payload"))
+  {
+    c.payload = parse_payload_profile(j["payload"].get<std::string>());
+  }
+  if (j.contains("verify"))
+  {
+    c.verify = parse_verification(j["verify"].get<std::string>());
+  }
+  if (j.contains("transactional_hash"))
+  {
+    c.transactional_hash = parse_transactional_hash(j["transactional_hash"].get<std::string>());
+  }
+  if (c.blob_size <= 0 || c.num_blobs <= 0 || c.concurrency <= 0)
+  {
+    throw std::invalid_argument("blob_size, num_blobs and concurrency must be positive");
+  }
+  return c;
+}
+
+// true or false, or an object of repetition_settings that turns adaptive repetition on
+repetition_settings parse_repetition_settings(const nlohmann::json& j, repetition_settings ret)
+{
+  if (j.is_boolean())
+  {
+    ret.adaptive = j.get<bool>();
+    return ret;
+  }
+  check_keys(
+      j,
+      {"min_trials", "max_trials", "target_ci", "confidence", "outlier_threshold"},
+      "adaptive_repeat");
+  ret.adaptive = true;
+  ret.min_trials = j.value("min_trials", ret.min_trials);
+  ret.max_trials = j.value("max_trials", ret.max_trials);
+  ret.target_ci = j.value("target_ci", ret.target_ci);
+  ret.confidence = j.value("confidence", ret.confidence);
+  ret.outlier_threshold = j.value("outlier_threshold", ret.outlier_threshold);
+  return ret;
+}
+
+sweep_settings parse_sweep_settings(const nlohmann::json& j)
+{
+  check_keys(
+      j,
+      {"min_concurrency",
+       "max_concurrency",
+       "growth",
+       "trials",
+       "plateau_gain",
+       "plateau_levels",
+       "latency_blowup",
+       "knee_tolerance"},
+      "sweep");
+  sweep_settings ret;
+  ret.enabled = true;
+  ret.min_concurrency = j.value("min_concurrency", ret.min_concurrency);
+  ret.max_concurrency = j.value("max_concurrency", ret.max_concurrency);
+  ret.growth = j.value("growth", ret.growth);
+  ret.trials = j.value("trials", ret.trials);
+  ret.plateau_gain = j.value("plateau_gain", ret.plateau_gain);
+  ret.plateau_levels = j.value("plateau_levels", ret.plateau_levels);
+  ret.latency_blowup = j.value("latency_blowup", ret.latency_blowup);
+  ret.knee_tolerance = j.value("knee_tolerance", ret.knee_tolerance);
+  return ret;
+}
+
+network_profile parse_network_profile(const nlohmann::json& j)
+{
+  check_keys(
+      j,
+      {"rtt_ms",
+       "jitter_ms",
+       "bandwidth",
+       "reset_probability",
+       "server_busy_probability",
+       "seed",
+       "max_retries",
+       "retry_backoff_ms"},
+      "network");
+  network_profile ret;
+  ret.rtt_ms = j.value("rtt_ms", ret.rtt_ms);
+  ret.jitter_ms = j.value("jitter_ms", ret.jitter_ms);
+  if (j.contains("bandwidth"))
+  {
+    ret.bandwidth = parse_size(j["bandwidth"]);
+  }
+  ret.reset_probability = j.value("reset_probability", ret.reset_probability);
+  ret.server_busy_probability = j.value("server_busy_probability", ret.server_busy_probability);
+  ret.seed = j.value("seed", ret.seed);
+  ret.max_retries = j.value("max_retries", ret.max_retries);
+  ret.retry_backoff_ms = j.value("retry_backoff_ms", ret.retry_backoff_ms);
+  return ret;
+}
+
+// every combination of the values listed per knob, null stands for the transport's default
+std::vector<transport_tuning> parse_tuning_grid(const nlohmann::json& j)
+{
+  check_keys(
+      j,
+      {"connection_pool_size",
+       "tcp_nodelay",
+       "socket_send_buffer",
+       "socket_receive_buffer",
+       "http_version",
+       "tls_session_reuse",
+       "receive_buffer"},
+      "transport_tuning");
+  std::vector<transport_tuning> ret(1);
+  auto expand = [&ret, &j](
+                    const std::string& key,
+                    const std::function<void(transport_tuning&, const nlohmann::json&)>& set) {
+    if (!j.contains(key))
+    {
+      return;
+    }
+    if (!j[key].is_array() || j[key].empty())
+    {
+      throw std::invalid_argument("transport_tuning " + key + " must be a non-empty list");
+    }
+    std::vector<transport_tuning> expanded;
+    for (const auto& tuning : ret)
+    {
+      for (const auto& value : j[key])
+      {
+        expanded.push_back(tuning);
+        if (!value.is_null())
+        {
+          set(expanded.back(), value);
+        }
+      }
+    }
+    ret = std::move(expanded);
+  };
+  auto positive_size = [](const nlohmann::json& value) {
+    const int64_t size = parse_size(value);
+    if (size <= 0)
+    {
+      throw std::invalid_argument("transport_tuning sizes must be positive");
+    }
+    return size;
+  };
+  expand("connection_pool_size", [](transport_tuning& t, const nlohmann::json& value) {
+    t.connection_pool_size = value.get<int>();
+    if (t.connection_pool_size <= 0)
+    {
+      throw std::invalid_argument("transport_tuning connection_pool_size must be positive");
+    }
+  });
+  expand("tcp_nodelay", [](transport_tuning& t, const nlohmann::json& value) {
+    t.tcp_nodelay = value.get<bool>() ? 1 : 0;
+  });
+  expand("socket_send_buffer", [&](transport_tuning& t, const nlohmann::json& value) {
+    t.socket_send_buffer = positive_size(value);
+  });
+  expand("socket_receive_buffer", [&](transport_tuning& t, const nlohmann::json& value) {
+    t.socket_receive_buffer = positive_size(value);
+  });
+  expand("http_version", [](transport_tuning& t, const nlohmann::json& value) {
+    t.http_version = value.get<std::string>();
+    if (t.http_version != "1.1" && t.http_version != "2")
+    {
+      throw std::invalid_argument("transport_tuning http_version must be \"1.1\" or \"2\"");
+    }
+  });
+  expand("tls_session_reuse", [](transport_tuning& t, const nlohmann::json& value) {
+    t.tls_session_reuse = value.get<bool>() ? 1 : 0;
+  });
+  expand("receive_buffer", [&](transport_tuning& t, const nlohmann::json& value) {
+    t.receive_buffer = positive_size(value);
+  });
+  return ret;
+}
+
+// "<size> <weight>" per line, e.g. "4KB 0.25", blank lines and lines starting with # are skipped
+std::vector<std::pair<int64_t, double>> load_size_histogram(const std::string& path)
+{
+  std::ifstream file(path);
+  if (!file)
+  {
+    throw std::invalid_argument("cannot open size histogram " + path);
+  }
+  std::vector<std::pair<int64_t, double>> ret;
+  std::string line;
+  while (std::getline(file, line))
+  {
+    std::istringstream fields(line);
+    std::string size;
+    double weight;
+    if (!(fields >> size) || size[0] == '#')
+    {
+      continue;
+    }
+    if (!(fields >> weight) || weight < 0.0)
+    {
+      throw std::invalid_argument("invalid line in size histogram " + path + ": " + line);
+    }
+    ret.emplace_back(parse_size(size), weight);
+    if (ret.back().first <= 0)
+    {
+      throw std::invalid_argument("invalid size in size histogram " + path + ": " + line);
+    }
+  }
+  if (std::none_of(ret.begin(), ret.end(), [](const std::pair<int64_t, double>& bucket) {
+        return bucket.second > 0.0;
+      }))
+  {
+    throw std::invalid_argument("size histogram " + path + " has no positive weight");
+  }
+  return ret;
+}
+
+mixed_workload parse_mixed_workload(const nlohmann::json& j)
+{
+  check_keys(
+      j,
+      {"read_ratio", "sizes", "size_sigma", "size_histogram", "popularity", "zipf_exponent",
+       "key_space"},
+      "mixed workload");
+  mixed_workload ret;
+  ret.read_ratio = j.value("read_ratio", ret.read_ratio);
+  const std::string sizes = j.value("sizes", to_string(ret.sizes));
+  if (sizes == "fixed")
+  {
+    ret.sizes = size_distribution::fixed;
+  }
+  else if (sizes == "lognormal")
+  {
+    ret.sizes = size_distribution::log_normal;
+  }
+  else if (sizes == "histogram")
+  {
+    ret.sizes = size_distribution::histogram;
+    const std::string path = j.at("size_histogram").get<std::string>();
+    ret.size_histogram = load_size_histogram(path);
+    const size_t begin = path.find_last_of("/\\") + 1;
+    size_t end = path.find_last_of('.');
+    if (end == std::string::npos || end < begin)
+    {
+      end = path.size();
+    }
+    ret.size_histogram_name = path.substr(begin, end - begin);
+  }
+  else
+  {
+    throw std::invalid_argument("invalid size distribution " + sizes);
+  }
+  ret.size_sigma = j.value("size_sigma", ret.size_sigma);
+  const std::string popularity = j.value("popularity", to_string(ret.popularity));
+  if (popularity == "uniform")
+  {
+    ret.popularity = key_popularity::uniform;
+  }
+  else if (popularity == "zipf")
+  {
+    ret.popularity = key_popularity::zipf;
+  }
+  else
+  {
+    throw std::invalid_argument("invalid key popularity " + popularity);
+  }
+  ret.zipf_exponent = j.value("zipf_exponent", ret.zipf_exponent);
+  ret.key_space = j.value("key_space", ret.key_space);
+  if (ret.read_ratio < 0.0 || ret.read_ratio > 1.0 || ret.size_sigma < 0.0
+      || ret.zipf_exponent < 0.0 || ret.key_space <= 0)
+  {
+    throw std::invalid_argument(
+        "read_ratio must be in [0, 1], size_sigma and zipf_exponent must not be negative and "
+        "key_space must be positive");
+  }
+  return ret;
+}
+
+benchmark_settings::matrix_group parse_matrix_group(const nlohmann::json& j)
+{
+  check_keys(
+      j,
+      {"cases",
+       "transfer_configs",
+       "chunk_sizes",
+       "per_blob_concurrency",
+       "mixed_workloads",
+       "range_sizes",
+       "range_access"},
+      "matrix");
+
+  std::vector<size_t> chunk_sizes;
+  for (const auto& i : j.value("chunk_sizes", nlohmann::json::array()))
+  {
+    const int64_t chunk_size = parse_size(i);
+    if (chunk_size <= 0)
+    {
+      throw std::invalid_argument("chunk sizes must be positive");
+    }
+    chunk_sizes.push_back(static_cast<size_t>(chunk_size));
+  }
+  std::vector<int> per_blob_concurrency
+      = j.value("per_blob_concurrency", nlohmann::json::array()).get<std::vector<int>>();
+  for (int concurrency : per_blob_concurrency)
+  {
+    if (concurrency <= 0)
+    {
+      throw std::invalid_argument("per_blob_concurrency must be positive");
+    }
+  }
+
+  std::vector<mixed_workload> mixed_workloads;
+  for (const auto& i : j.value("mixed_workloads", nlohmann::json::array()))
+  {
+    mixed_workloads.push_back(parse_mixed_workload(i));
+  }
+
+  std::vector<size_t> range_sizes;
+  for (const auto& i : j.value("range_sizes", nlohmann::json::array()))
+  {
+    range_sizes.push_back(static_cast<size_t>(parse_size(i)));
+    if (range_sizes.back() == 0)
+    {
+      throw std::invalid_argument("range sizes must be positive");
+    }
+  }
+  // "random", "sequential" or a stride, 0 stands for random and the range size for sequential
+  std::vector<std::string> range_access
+      = j.value("range_access", nlohmann::json::array({"random"})).get<std::vector<std::string>>();
+
+  benchmark_settings::matrix_group group;
+  for (const auto& i : j.at("cases"))
+  {
+    const std::string type = i.get<std::string>();
+    if (type == "parallel_download" || type == "parallel_upload" || type == "staged_upload")
+    {
+      if (chunk_sizes.empty() || per_blob_concurrency.empty())
+      {
+        throw std::invalid_argument(type + " needs chunk_sizes and per_blob_concurrency");
+      }
+      for (auto chunk_size : chunk_sizes)
+      {
+        for (auto concurrency : per_blob_concurrency)
+        {
+          group.cases.push_back({type, chunk_size, concurrency});
+        }
+      }
+    }
+    else if (type == "range_read")
+    {
+      if (range_sizes.empty())
+      {
+        throw std::invalid_argument(type + " needs range_sizes");
+      }
+      for (auto range_size : range_sizes)
+      {
+        for (const auto& access : range_access)
+        {
+          case_parameters parameters{type};
+          parameters.range_size = range_size;
+          parameters.range_stride = access == "random" ? 0
+              : access == "sequential"                 ? range_size
+                                                       : static_cast<size_t>(parse_size(access));
+          group.cases.push_back(parameters);
+        }
+      }
+    }
+    else if (type == "mixed")
+    {
+      if (mixed_workloads.empty())
+      {
+        throw std::invalid_argument(type + " needs mixed_workloads");
+      }
+      for (const auto& workload : mixed_workloads)
+      {
+        case_parameters parameters{type};
+        parameters.workload = workload;
+        group.cases.push_back(parameters);
+      }
+    }
+    else
+    {
+      group.cases.push_back({type});
+    }
+    if (!make_case(group.cases.back()))
+    {
+      throw std::invalid_argument("unknown case " + type);
+    }
+  }
+  for (const auto& i : j.at("transfer_configs"))
+  {
+    group.transfer_configs.push_back(parse_transfer_config(i));
+    // expected content is made per size class, not per key
+    const auto& c = group.transfer_configs.back();
+    for (const auto& p : group.cases)
+    {
+      if (p.type == "range_read" && static_cast<size_t>(c.blob_size) < p.range_size)
+      {
+        throw std::invalid_argument("range sizes must not exceed the blob size");
+      }
+      // the service takes at most 50000 blocks per blob
+      if (p.type == "staged_upload"
+          && (static_cast<size_t>(c.blob_size) + p.chunk_size - 1) / p.chunk_size > 50000)
+      {
+        throw std::invalid_argument("staged uploads can't commit more than 50000 blocks");
+      }
+    }
+    const bool mixed = std::any_of(group.cases.begin(), group.cases.end(), [](const auto& p) {
+      return p.type == "mixed";
+    });
+    if (mixed && c.payload == payload_profile::unique && c.verify != verification::none)
+    {
+      throw std::invalid_argument("mixed workloads can't verify the unique payload");
+    }
+  }
+  return group;
+}
+
+void load_config_file(const std::string& path, benchmark_settings& s)
+{
+  std::ifstream file(path);
+  if (!file)
+  {
+    throw std::invalid_argument("cannot open config file " + path);
+  }
+  nlohmann::json j;
+  try
+  {
+    j = nlohmann::json::parse(file);
+  }
+  catch (nlohmann::json::exception& e)
+  {
+    throw std::invalid_argument("failed to parse " + path + ": " + e.what());
+  }
+  check_keys(
+      j,
+      {"connection_string",
+       "log_connection_string",
+       "container_name",
+       "results_path",
+       "use_mock_blob_endpoint",
+       "repeat",
+       "adaptive_repeat",
+       "exception_sleep_seconds",
+       "delay_seconds_between_tasks",
+       "cpu_affinity",
+       "cpus",
+       "event_loop_threads",
+       "hardware_counters",
+       "prewarm",
+       "sample_interval_ms",
+       "sweep",
+       "network",
+       "transports",
+       "transport_tuning",
+       "matrix"},
+      "config file");
+  try
+  {
+    s.connection_string = j.value("connection_string", s.connection_string);
+    s.log_connection_string = j.value("log_connection_string", s.log_connection_string);
+    s.container_name = j.value("container_name", s.container_name);
+    s.results_path = j.value("results_path", s.results_path);
+    s.use_mock_blob_endpoint = j.value("use_mock_blob_endpoint", s.use_mock_blob_endpoint);
+    if (j.contains("repeat"))
+    {
+      // like --repeat, a fixed number of trials, unless adaptive_repeat turns it back on
+      s.repeat = j["repeat"].get<int>();
+      s.repetition.adaptive = false;
+    }
+    if (j.contains("adaptive_repeat"))
+    {
+      s.repetition = parse_repetition_settings(j["adaptive_repeat"], s.repetition);
+    }
+    s.exception_sleep_seconds = j.value("exception_sleep_seconds", s.exception_sleep_seconds);
+    s.delay_seconds_between_tasks
+        = j.value("delay_seconds_between_tasks", s.delay_seconds_between_tasks);
+    if (j.contains("cpu_affinity"))
+    {
+      s.cpu_affinity = parse_cpu_affinity(j["cpu_affinity"].get<std::string>());
+    }
+    if (j.contains("cpus"))
+    {
+      s.cpus = parse_cpu_list(j["cpus"].get<std::string>());
+    }
+    s.event_loop_threads = j.value("event_loop_threads", s.event_loop_threads);
+    s.hardware_counters = j.value("hardware_counters", s.hardware_counters);
+    s.prewarm = j.value("prewarm", s.prewarm);
+    s.sample_interval_ms = j.value("sample_interval_ms", s.sample_interval_ms);
+    if (j.contains("sweep"))
+    {
+      s.sweep = parse_sweep_settings(j["sweep"]);
+    }
+    if (j.contains("network"))
+    {
+      s.network = parse_network_profile(j["network"]);
+    }
+    if (j.contains("transports"))
+    {
+      s.transports = j["transports"].get<std::vector<std::string>>();
+    }
+    if (j.contains("transport_tuning"))
+    {
+      s.tuning_grid = parse_tuning_grid(j["transport_tuning"]);
+    }
+    if (j.contains("matrix"))
+    {
+      s.matrix.clear();
+      for (const auto& i : j["matrix"])
+      {
+        s.matrix.push_back(parse_matrix_group(i));
+      }
+    }
+  }
+  catch (nlohmann::json::exception& e)
+  {
+    throw std::invalid_argument("invalid config file " + path + ": " + e.what());
+  }
+}
+
+int parse_int(const std::string& option, const std::string& value)
+{
+  try
+  {
+    size_t pos = 0;
+    int ret = std::stoi(value, &pos);
+    if (pos == value.length())
+    {
+      return ret;
+    }
+  }
+  catch (std::exception&)
+  {
+  }
+  throw std::invalid_argument("invalid value " + value + " for " + option);
+}
+
+double parse_double(const std::string& option, const std::string& value)
+{
+  try
+  {
+    size_t pos = 0;
+    double ret = std::stod(value, &pos);
+    if (pos == value.length())
+    {
+      return ret;
+    }
+  }
+  catch (std::exception&)
+  {
+  }
+  throw std::invalid_argument("invalid value " + value + " for " + option);
+}
+
+} // namespace
+
+bool benchmark_settings::matches(
+    const std::string& transport_name,
+    const std::string& case_name,
+    const transfer_configuration& transfer_config) const
+{
+  auto match = [](const auto& filter, const auto& value) {
+    return filter.empty() || std::find(filter.begin(), filter.end(), value) != filter.end();
+  };
+  // a case filter matches every case whose name starts with it, parallel_download matches
+  // parallel_download_4MBx16
+  const bool case_matches = case_filter.empty()
+      || std::any_of(case_filter.begin(), case_filter.end(), [&case_name](const std::string& f) {
+           return case_name.compare(0, f.length(), f) == 0;
+         });
+  // and a transport filter matches the variants of the transport too
+  const bool transport_matches = match(transport_filter, transport_name)
+      || match(transport_filter, base_transport_name(transport_name));
+  return case_matches && transport_matches
+      && match(blob_size_filter, transfer_config.blob_size)
+      && match(num_blobs_filter, transfer_config.num_blobs)
+      && match(concurrency_filter, transfer_config.concurrency);
+}
+
+const benchmark_settings& settings() { return mutable_settings(); }
+
+void load_settings(int argc, char** argv)
+{
+  benchmark_settings& s = mutable_settings();
+  s.connection_string = connection_string;
+  s.log_connection_string = log_connection_string;
+  s.container_name = container_name;
+  s.results_path = results_path;
+  s.use_mock_blob_endpoint = use_mock_blob_endpoint;
+  s.repeat = repeat;
+  s.repetition.adaptive = adaptive_repeat;
+  s.exception_sleep_seconds = exception_sleep_seconds;
+  s.delay_seconds_between_tasks = delay_seconds_between_tasks;
+  s.cpu_affinity = parse_cpu_affinity(cpu_affinity);
+  s.event_loop_threads = event_loop_threads;
+  s.hardware_counters = hardware_counters;
+  s.prewarm = prewarm;
+  s.sample_interval_ms = sample_interval_ms;
+  s.sweep.enabled = concurrency_sweep;
+  s.transports = default_transports();
+  s.tuning_grid = {transport_tuning()};
+  s.matrix = default_matrix();
+
+  std::vector<std::string> args(argv + 1, argv + argc);
+  // the config file is loaded first so that other options override it wherever they appear
+  for (size_t i = 0; i + 1 < args.size(); ++i)
+  {
+    if (args[i] == "--config")
+    {
+      load_config_file(args[i + 1], s);
+    }
+  }
+  for (size_t i = 0; i < args.size(); ++i)
+  {
+    const std::string& option = args[i];
+    if (option == "--mock")
+    {
+      s.use_mock_blob_endpoint = true;
+      continue;
+    }
+    else if (option == "--hardware-counters")
+    {
+      s.hardware_counters = true;
+      continue;
+    }
+    else if (option == "--prewarm")
+    {
+      s.prewarm = true;
+      continue;
+    }
+    else if (option == "--adaptive-repeat")
+    {
+      s.repetition.adaptive = true;
+      continue;
+    }
+    else if (option == "--sweep")
+    {
+      s.sweep.enabled = true;
+      continue;
+    }
+    else if (option == "--list")
+    {
+      s.list_only = true;
+      continue;
+    }
+    if (i + 1 == args.size())
+    {
+      throw std::invalid_argument("unknown option or missing value: " + option);
+    }
+    const std::string& value = args[++i];
+    if (option == "--config")
+    {
+    }
+    else if (option == "--connection-string")
+    {
+      s.connection_string = value;
+    }
+    else if (option == "--log-connection-string")
+    {
+      s.log_connection_string = value;
+    }
+    else if (option == "--container")
+    {
+      s.container_name = value;
+    }
+    else if (option == "--results")
+    {
+      s.results_path = value;
+    }
+    else if (option == "--repeat")
+    {
+      s.repeat = parse_int(option, value);
+      s.repetition.adaptive = false;
+    }
+    else if (option == "--max-repeat")
+    {
+      s.repetition.adaptive = true;
+      s.repetition.max_trials = parse_int(option, value);
+    }
+    else if (option == "--target-ci")
+    {
+      s.repetition.adaptive = true;
+      s.repetition.target_ci = parse_double(option, value);
+    }
+    else if (option == "--delay-seconds")
+    {
+      s.delay_seconds_between_tasks = parse_int(option, value);
+    }
+    else if (option == "--exception-sleep-seconds")
+    {
+      s.exception_sleep_seconds = parse_int(option, value);
+    }
+    else if (option == "--cpu-affinity")
+    {
+      s.cpu_affinity = parse_cpu_affinity(value);
+    }
+    else if (option == "--cpus")
+    {
+      s.cpus = parse_cpu_list(value);
+    }
+    else if (option == "--event-loop-threads")
+    {
+      s.event_loop_threads = parse_int(option, value);
+    }
+    else if (option == "--sample-interval-ms")
+    {
+      s.sample_interval_ms = parse_int(option, value);
+    }
+    else if (option == "--sweep-max-concurrency")
+    {
+      s.sweep.enabled = true;
+      s.sweep.max_concurrency = parse_int(option, value);
+    }
+    else if (option == "--rtt-ms")
+    {
+      s.network.rtt_ms = parse_int(option, value);
+    }
+    else if (option == "--bandwidth")
+    {
+      s.network.bandwidth = parse_size(value);
+    }
+    else if (option == "--reset-probability")
+    {
+      s.network.reset_probability = parse_double(option, value);
+    }
+    else if (option == "--server-busy-probability")
+    {
+      s.network.server_busy_probability = parse_double(option, value);
+    }
+    else if (option == "--transport")
+    {
+      s.transport_filter.push_back(value);
+    }
+    else if (option == "--case")
+    {
+      s.case_filter.push_back(value);
+    }
+    else if (option == "--blob-size")
+    {
+      s.blob_size_filter.push_back(parse_size(value));
+    }
+    else if (option == "--num-blobs")
+    {
+      s.num_blobs_filter.push_back(parse_int(option, value));
+    }
+    else if (option == "--concurrency")
+    {
+      s.concurrency_filter.push_back(parse_int(option, value));
+    }
+    else
+    {
+      throw std::invalid_argument("unknown option " + option);
+    }
+  }
+
+  // a transport that isn't run by default is run when --transport names it
+  for (const auto& f : s.transport_filter)
+  {
+    const auto t = base_transport_name(f);
+    if (std::find(s.transports.begin(), s.transports.end(), t) == s.transports.end())
+    {
+      s.transports.push_back(t);
+    }
+  }
+  for (const auto& t : s.transports)
+  {
+    const auto available = available_transports();
+    if (std::find(available.begin(), available.end(), t) == available.end())
+    {
+      throw std::invalid_argument("unknown transport " + t);
+    }
+  }
+  if (s.event_loop_threads <= 0)
+  {
+    throw std::invalid_argument("event_loop_threads must be positive");
+  }
+  std::vector<std::string> variants;
+  s.transport_tunings.clear();
+  for (const auto& t : s.transports)
+  {
+    for (const auto& tuning : s.tuning_grid)
+    {
+      const auto supported = supported_tuning(t, tuning);
+      // curl-multi splits the pool evenly between its event loops, the variant is named after the
+      // whole of it
+      if (t == "curl-multi" && supported.connection_pool_size > 0
+          && supported.connection_pool_size % s.event_loop_threads != 0)
+      {
+        throw std::invalid_argument(
+            "transport_tuning connection_pool_size "
+            + std::to_string(supported.connection_pool_size)
+            + " isn't a multiple of event_loop_threads " + std::to_string(s.event_loop_threads));
+      }
+      const std::string name = t + to_string(supported);
+      if (std::find(variants.begin(), variants.end(), name) == variants.end())
+      {
+        variants.push_back(name);
+        if (name != t)
+        {
+          s.transport_tunings[name] = supported;
+        }
+      }
+    }
+  }
+  s.transports = std::move(variants);
+  if (s.repeat <= 0)
+  {
+    throw std::invalid_argument("repeat must be positive");
+  }
+  if (s.repetition.min_trials < 2 || s.repetition.max_trials < s.repetition.min_trials
+      || s.repetition.target_ci <= 0.0 || s.repetition.outlier_threshold <= 0.0)
+  {
+    throw std::invalid_argument(
+        "adaptive_repeat min_trials must be at least 2, max_trials at least min_trials, target_ci "
+        "and outlier_threshold positive");
+  }
+  // throws on an unsupported confidence
+  student_t_quantile(s.repetition.confidence, 1);
+  if (s.sample_interval_ms < 0)
+  {
+    throw std::invalid_argument("sample_interval_ms must not be negative");
+  }
+  if (s.sweep.min_concurrency <= 0 || s.sweep.max_concurrency < s.sweep.min_concurrency
+      || s.sweep.trials <= 0 || s.sweep.plateau_levels <= 0)
+  {
+    throw std::invalid_argument(
+        "sweep min_concurrency, trials and plateau_levels must be positive and max_concurrency "
+        "at least min_concurrency");
+  }
+  if (s.sweep.growth <= 1.0 || s.sweep.latency_blowup <= 1.0 || s.sweep.plateau_gain < 0.0
+      || s.sweep.knee_tolerance < 0.0 || s.sweep.knee_tolerance >= 1.0)
+  {
+    throw std::invalid_argument(
+        "sweep growth and latency_blowup must be greater than 1, plateau_gain must not be "
+        "negative and knee_tolerance must be in [0, 1)");
+  }
+  const auto& network = s.network;
+  if (network.rtt_ms < 0 || network.jitter_ms < 0 || network.bandwidth < 0
+      || network.max_retries < 0 || network.retry_backoff_ms < 0)
+  {
+    throw std::invalid_argument(
+        "network rtt_ms, jitter_ms, bandwidth, max_retries and retry_backoff_ms must not be "
+        "negative");
+  }
+  if (network.reset_probability < 0.0 || network.server_busy_probability < 0.0
+      || network.reset_probability + network.server_busy_probability > 1.0)
+  {
+    throw std::invalid_argument(
+        "network reset_probability and server_busy_probability must not be negative and add up "
+        "to at most 1");
+  }
+  if (network.injects_faults())
+  {
+    for (const auto& group : s.matrix)
+    {
+      for (const auto& c : group.transfer_configs)
+      {
+        if (c.verify != verification::none)
+        {
+          throw std::invalid_argument(
+              "downloads can't be verified with injected faults, a retried download would be "
+              "verified twice");
+        }
+      }
+    }
+  }
+}
+
+std::string usage()
+{
+  return R"usage(usage: perftest [options]
+
+  --config FILE                 load settings and the benchmark matrix from a JSON file
+  --mock                        run against the in-process loopback blob endpoint
+  --connection-string STR       storage account to benchmark
+  --log-connection-string STR   storage account the log is uploaded to
+  --container NAME              container the test blobs are created in
+  --results FILE                append one JSON record per trial to FILE
+  --repeat N                    times each cell is run, turns adaptive repetition off
+  --adaptive-repeat             repeat each cell until the confidence interval of its throughput
+                                is narrow enough, between min_trials and max_trials times
+  --max-repeat N                most times a cell is run adaptively, implies --adaptive-repeat
+  --target-ci F                 relative half width of the confidence interval a cell is repeated
+                                to, e.g. 0.05, implies --adaptive-repeat
+  --delay-seconds N             sleep between two cells
+  --exception-sleep-seconds N   back-off after a failed trial
+  --cpu-affinity MODE           pin worker threads: none, compact (fill a NUMA node first) or
+                                scatter (round-robin over NUMA nodes)
+  --cpus LIST                   CPUs workers may be pinned to, e.g. 0-15,32-47
+  --event-loop-threads N        threads driving the requests of the curl-multi transport, its
+                                connection_pool_size values must be multiples of N
+  --hardware-counters           count CPU cycles, instructions and cache misses (Linux)
+  --prewarm                     open the connections of a case before it's timed
+  --sample-interval-ms N        interval of the throughput timeline of a trial, 0 to disable
+  --sweep                       run every cell at growing concurrency until throughput stops
+                                growing and report the knee, instead of repeating it
+  --sweep-max-concurrency N     highest concurrency a sweep tries, implies --sweep
+  --rtt-ms N                    run through a local proxy that adds N ms to every round trip
+  --bandwidth SIZE              run through a local proxy that caps traffic each way to SIZE per
+                                second, e.g. 100MB
+  --reset-probability F         run through a local proxy that resets the connection of a
+                                fraction F of requests
+  --server-busy-probability F   run through a local proxy that answers a fraction F of requests
+                                with 503 Server Busy
+  --list                        print the cells that would run and exit
+
+Filters, each can be given multiple times, a cell runs if it matches every kind of filter:
+  --transport NAME              e.g. cpplite, Track2(curl), curl-multi, matches its variants
+                                too, or a variant, e.g. curl-multi{nodelay=off}; curl-multi
+                                only runs when named here or in the config's transports
+  --case NAME                   e.g. download, parallel_upload, parallel_upload_4MBx16,
+                                staged_upload_4MBx16, async_download (curl-multi only),
+                                cold_start, mixed, range_read_64KB_random
+                                transfer configs with a transactional_hash only run download
+                                and upload with Track2
+  --blob-size SIZE              e.g. 5, 10KB, 1GB
+  --num-blobs N
+  --concurrency N               with --sweep, selects the transfer configs but not the levels
+
+Config file, every key is optional:
+  {
+    "connection_string": "...", "log_connection_string": "...", "container_name": "perf-test",
+    "results_path": "results.jsonl", "use_mock_blob_endpoint": false, "repeat": 7,
+    "adaptive_repeat": {"min_trials": 3, "max_trials": 15, "target_ci": 0.05,
+                        "confidence": 0.95, "outlier_threshold": 3.5},
+    "exception_sleep_seconds": 60, "delay_seconds_between_tasks": 5,
+    "cpu_affinity": "scatter", "cpus": "0-15,32-47", "event_loop_threads": 1,
+    "hardware_counters": false, "prewarm": true, "sample_interval_ms": 100,
+    "sweep": {"min_concurrency": 1, "max_concurrency": 256, "growth": 2, "trials": 3,
+              "plateau_gain": 0.05, "plateau_levels": 2, "latency_blowup": 4,
+              "knee_tolerance": 0.05},
+    "network": {"rtt_ms": 0, "jitter_ms": 0, "bandwidth": "1GB", "reset_probability": 0.001,
+                "server_busy_probability": 0.01, "seed": 1, "max_retries": 3,
+                "retry_backoff_ms": 100},
+    "transports": ["cpplite", "Track2(curl)", "curl-multi"],
+    "transport_tuning": {"connection_pool_size": [null, 16], "tcp_nodelay": [true, false],
+                         "socket_send_buffer": [null, "4MB"],
+                         "socket_receive_buffer": [null, "4MB"], "http_version": ["1.1", "2"],
+                         "tls_session_reuse": [null, false], "receive_buffer": [null, "512KB"]},
+    "matrix": [
+      {
+        "cases": ["download", "upload"],
+        "transfer_configs": [
+          {"blob_size": "10KB", "num_blobs": 10000, "concurrency": 32},
+          {"blob_size": "10KB", "num_blobs": 10000, "concurrency": 32, "payload": "text"},
+          {"blob_size": "4MB", "num_blobs": 1000, "concurrency": 16, "verify": "crc64",
+           "transactional_hash": "md5"},
+          {"blob_size": "1GB", "num_blobs": 32, "concurrency": 8, "download_sink": "ring_buffer",
+           "sink_size": "8MB", "target_rate": 4, "arrivals": "poisson"}
+        ]
+      },
+      {
+        "cases": ["mixed"],
+        "mixed_workloads": [
+          {"read_ratio": 0.9, "sizes": "lognormal", "size_sigma": 1.0, "popularity": "zipf",
+           "zipf_exponent": 0.99, "key_space": 100000},
+          {"read_ratio": 0.5, "sizes": "histogram", "size_histogram": "sizes.txt",
+           "popularity": "uniform", "key_space": 10000}
+        ],
+        "transfer_configs": [{"blob_size": "64KB", "num_blobs": 100000, "concurrency": 64}]
+      },
+      {
+        "cases": ["range_read"],
+        "range_sizes": ["4KB", "64KB", "1MB", "8MB"],
+        "range_access": ["random", "sequential", "16MB"],
+        "transfer_configs": [{"blob_size": "4GB", "num_blobs": 10000, "concurrency": 32}]
+      },
+      {
+        "cases": ["cold_start"],
+        "transfer_configs": [{"blob_size": "10KB", "num_blobs": 100, "concurrency": 1}]
+      },
+      {
+        "cases": ["async_download", "async_upload"],
+        "transfer_configs": [{"blob_size": "10KB", "num_blobs": 10000, "concurrency": 256}]
+      },
+      {
+        "cases": ["parallel_download", "parallel_upload", "staged_upload"],
+        "chunk_sizes": ["4MB", "16MB"], "per_blob_concurrency": [4, 16],
+        "transfer_configs": [{"blob_size": "1GB", "num_blobs": 4, "concurrency": 1}]
+      }
+    ]
+  }
+
+Like --repeat, "repeat" turns adaptive repetition off, unless "adaptive_repeat" is given too.
+Every transport runs once per combination of the transport_tuning values it supports, null
+keeps its default: cpplite sizes its connection pool, curl-multi supports every knob and
+Track2 none. Variants are named after the knobs they set, e.g. curl-multi{pool=16,http=2}.
+The network proxy needs an http endpoint, the mock or an account with
+DefaultEndpointsProtocol=http. With injected faults a failed operation is retried max_retries
+times with exponential back-off, async cases, which don't retry, are skipped, and downloads
+can't be verified.
+cold_start builds a client per operation and isn't run with Track2(curl), whose clients share
+libcurl's process-wide connection pool, so a new client wouldn't have to connect.
+Staged uploads put every blob as blocks of each chunk size, even one that fits in a single
+block, and time staging and committing the block list separately.
+Blobs over 64MB are downloaded into a ring_buffer sink unless a download_sink is given.
+Range reads read a range of every size at random offsets, one after the other (sequential) or
+a stride apart, they don't verify content.
+A mixed workload runs num_blobs operations of its transfer config over key_space blobs, sizes
+are "fixed" (blob_size), "lognormal" (median blob_size) or "histogram", a file with a
+"<size> <weight>" line per size, e.g. "4KB 0.25". Popularity is "uniform" or "zipf".
+)usage";
+}
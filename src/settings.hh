@@ -0,0 +1,74 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "cases.hh"
+#include "concurrency_sweep.hh"
+#include "network_proxy.hh"
+#include "repetition.hh"
+#include "worker_pool.hh"
+
+/*
+ * Everything that describes a benchmark run. Defaults come from constants.hh and the built-in
+ * matrix, a JSON file given with --config replaces them, and command line options override both.
+ * See usage() for the options and the JSON layout.
+ */
+struct benchmark_settings
+{
+  // every case in a group runs with every transfer config of the group and every transport
+  struct matrix_group
+  {
+    std::vector<case_parameters> cases;
+    std::vector<transfer_configuration> transfer_configs;
+  };
+
+  std::string connection_string;
+  std::string log_connection_string;
+  std::string container_name;
+  std::string results_path;
+  bool use_mock_blob_endpoint = false;
+  // times every cell runs unless repetition is adaptive
+  int repeat = 0;
+  repetition_settings repetition;
+  int exception_sleep_seconds = 0;
+  int delay_seconds_between_tasks = 0;
+  // pinning of the benchmark worker threads, cpus restricts the CPUs used if not empty
+  affinity_policy cpu_affinity = affinity_policy::none;
+  std::vector<int> cpus;
+  int event_loop_threads = 1;
+  bool hardware_counters = false;
+  // open as many connections as a case uses before timing it
+  bool prewarm = false;
+  int sample_interval_ms = 0;
+  sweep_settings sweep;
+  // traffic goes through a network_proxy if enabled
+  network_profile network;
+  // after loading, every transport once per combination of the tuning knobs it exposes
+  std::vector<std::string> transports;
+  // the combinations of transport tuning knobs to run, a single default one unless configured
+  std::vector<transport_tuning> tuning_grid;
+  // tuning of every variant in transports that isn't the transport itself
+  std::map<std::string, transport_tuning> transport_tunings;
+  std::vector<matrix_group> matrix;
+
+  // Only cells matching all filters run, an empty filter matches everything.
+  std::vector<std::string> transport_filter;
+  std::vector<std::string> case_filter;
+  std::vector<int64_t> blob_size_filter;
+  std::vector<int> num_blobs_filter;
+  std::vector<int> concurrency_filter;
+  // print the cells that would run and exit
+  bool list_only = false;
+
+  bool matches(
+      const std::string& transport_name,
+      const std::string& case_name,
+      const transfer_configuration& transfer_config) const;
+};
+
+const benchmark_settings& settings();
+// throws std::invalid_argument on malformed options or config file
+void load_settings(int argc, char** argv);
+std::string usage();
@@ -0,0 +1,271 @@
+#include "socket_utils.hh"
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+
+#if defined(_WIN32)
+int last_socket_error() { return WSAGetLastError(); }
+#else
+int last_socket_error() { return errno; }
+#endif
+
+[[noreturn]] void throw_socket_error(const std::string& what)
+{
+  throw std::runtime_error(what + " failed, error " + std::to_string(last_socket_error()));
+}
+
+void init_socket_library()
+{
+#if defined(_WIN32)
+  static std::once_flag flag;
+  std::call_once(flag, []() {
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+    {
+      throw std::runtime_error("WSAStartup failed");
+    }
+  });
+#endif
+}
+
+} // namespace
+
+native_socket tcp_socket::invalid_socket()
+{
+#if defined(_WIN32)
+  return static_cast<native_socket>(INVALID_SOCKET);
+#else
+  return -1;
+#endif
+}
+
+tcp_socket::tcp_socket(tcp_socket&& other) noexcept : m_socket(other.m_socket)
+{
+  other.m_socket = invalid_socket();
+}
+
+tcp_socket& tcp_socket::operator=(tcp_socket&& other) noexcept
+{
+  if (this != &other)
+  {
+    close();
+    m_socket = other.m_socket;
+    other.m_socket = invalid_socket();
+  }
+  return *this;
+}
+
+tcp_socket::~tcp_socket() { close(); }
+
+tcp_socket tcp_socket::listen_loopback(uint16_t port)
+{
+  init_socket_library();
+
+  tcp_socket s(static_cast<native_socket>(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)));
+  if (!s.valid())
+  {
+    throw_socket_error("socket");
+  }
+  int reuse = 1;
+  ::setsockopt(
+      s.m_socket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+  sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (::bind(s.m_socket, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0)
+  {
+    throw_socket_error("bind");
+  }
+  if (::listen(s.m_socket, SOMAXCONN) != 0)
+  {
+    throw_socket_error("listen");
+  }
+  return s;
+}
+
+tcp_socket tcp_socket::connect(const std::string& host, uint16_t port)
+{
+  init_socket_library();
+
+  addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* result = nullptr;
+  if (::getaddrinfo(host.data(), std::to_string(port).data(), &hints, &result) != 0)
+  {
+    throw std::runtime_error("failed to resolve " + host);
+  }
+  tcp_socket s;
+  for (addrinfo* ai = result; ai != nullptr; ai = ai->ai_next)
+  {
+    tcp_socket candidate(
+        static_cast<native_socket>(::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)));
+    if (!candidate.valid())
+    {
+      continue;
+    }
+    if (::connect(candidate.m_socket, ai->ai_addr, static_cast<int>(ai->ai_addrlen)) == 0)
+    {
+      s = std::move(candidate);
+      break;
+    }
+  }
+  ::freeaddrinfo(result);
+  if (!s.valid())
+  {
+    throw_socket_error("connect to " + host + ":" + std::to_string(port));
+  }
+  return s;
+}
+
+bool tcp_socket::valid() const { return m_socket != invalid_socket(); }
+
+uint16_t tcp_socket::local_port() const
+{
+  sockaddr_in addr;
+  socklen_t addr_len = sizeof(addr);
+  if (::getsockname(m_socket, reinterpret_cast<sockaddr*>(&addr), &addr_len) != 0)
+  {
+    throw_socket_error("getsockname");
+  }
+  return ntohs(addr.sin_port);
+}
+
+tcp_socket tcp_socket::accept()
+{
+  while (true)
+  {
+    tcp_socket s(static_cast<native_socket>(::accept(m_socket, nullptr, nullptr)));
+    if (s.valid())
+    {
+      return s;
+    }
+#if !defined(_WIN32)
+    if (errno == EINTR)
+    {
+      continue;
+    }
+#endif
+    throw_socket_error("accept");
+  }
+}
+
+size_t tcp_socket::recv_some(uint8_t* buffer, size_t size)
+{
+  while (true)
+  {
+    auto ret = ::recv(
+        m_socket,
+        reinterpret_cast<char*>(buffer),
+        static_cast<int>(std::min<size_t>(size, 1 << 30)),
+        0);
+    if (ret >= 0)
+    {
+      return static_cast<size_t>(ret);
+    }
+#if !defined(_WIN32)
+    if (errno == EINTR)
+    {
+      continue;
+    }
+#endif
+    throw_socket_error("recv");
+  }
+}
+
+void tcp_socket::send_all(const uint8_t* buffer, size_t size)
+{
+#if defined(MSG_NOSIGNAL)
+  constexpr int flags = MSG_NOSIGNAL;
+#else
+  constexpr int flags = 0;
+#endif
+  while (size != 0)
+  {
+    auto ret = ::send(
+        m_socket,
+        reinterpret_cast<const char*>(buffer),
+        static_cast<int>(std::min<size_t>(size, 1 << 30)),
+        flags);
+    if (ret < 0)
+    {
+#if !defined(_WIN32)
+      if (errno == EINTR)
+      {
+        continue;
+      }
+#endif
+      throw_socket_error("send");
+    }
+    buffer += ret;
+    size -= static_cast<size_t>(ret);
+  }
+}
+
+void tcp_socket::set_nodelay(bool enabled)
+{
+  int value = enabled ? 1 : 0;
+  ::setsockopt(
+      m_socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void tcp_socket::abort()
+{
+  if (!valid())
+  {
+    return;
+  }
+  linger l;
+  l.l_onoff = 1;
+  l.l_linger = 0;
+  ::setsockopt(m_socket, SOL_SOCKET, SO_LINGER, reinterpret_cast<const char*>(&l), sizeof(l));
+  close();
+}
+
+void tcp_socket::shutdown()
+{
+  if (!valid())
+  {
+    return;
+  }
+#if defined(_WIN32)
+  ::shutdown(m_socket, SD_BOTH);
+#else
+  ::shutdown(m_socket, SHUT_RDWR);
+#endif
+}
+
+void tcp_socket::close()
+{
+  if (!valid())
+  {
+    return;
+  }
+#if defined(_WIN32)
+  ::closesocket(m_socket);
+#else
+  ::close(m_socket);
+#endif
+  m_socket = invalid_socket();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if defined(_WIN32)
+using native_socket = uintptr_t;
+#else
+using native_socket = int;
+#endif
+
+class tcp_socket {
+public:
+  tcp_socket() = default;
+  explicit tcp_socket(native_socket s) : m_socket(s) {}
+  tcp_socket(const tcp_socket&) = delete;
+  tcp_socket& operator=(const tcp_socket&) = delete;
+  tcp_socket(tcp_socket&& other) noexcept;
+  tcp_socket& operator=(tcp_socket&& other) noexcept;
+  ~tcp_socket();
+
+  static tcp_socket listen_loopback(uint16_t port = 0);
+  static tcp_socket connect(const std::string& host, uint16_t port);
+
+  bool valid() const;
+  native_socket native() const { return m_socket; }
+  uint16_t local_port() const;
+
+  tcp_socket accept();
+  // returns 0 when the peer has closed the connection
+  size_t recv_some(uint8_t* buffer, size_t size);
+  void send_all(const uint8_t* buffer, size_t size);
+  void send_all(const std::string& data)
+  {
+    send_all(reinterpret_cast<const uint8_t*>(data.data()), data.length());
+  }
+  void set_nodelay(bool enabled);
+  // hard close, the peer observes a connection reset
+  void abort();
+  void shutdown();
+  void close();
+
+private:
+  native_socket m_socket = invalid_socket();
+
+  static native_socket invalid_socket();
+};
@@ -0,0 +1,77 @@
+#include "throughput_sampler.hh"
+
+#include "cpu_usage.hh"
+#include "memory_usage.hh"
+
+throughput_sampler::throughput_sampler(std::chrono::milliseconds interval, int num_slots)
+    : m_interval(interval), m_num_slots(num_slots), m_slots(new slot_counters[num_slots])
+{
+  if (m_interval.count() > 0)
+  {
+    m_thread = std::thread(&throughput_sampler::sampler_loop, this);
+  }
+}
+
+throughput_sampler::~throughput_sampler() { stop(); }
+
+void throughput_sampler::start(std::chrono::steady_clock::time_point start)
+{
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_start = start;
+    m_started = true;
+  }
+  m_cv.notify_one();
+}
+
+std::vector<throughput_sample> throughput_sampler::stop()
+{
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_stopped = true;
+  }
+  m_cv.notify_one();
+  if (m_thread.joinable())
+  {
+    m_thread.join();
+  }
+  return std::move(m_samples);
+}
+
+void throughput_sampler::sampler_loop()
+{
+  ignore_thread_allocations();
+  ignore_thread_cpu_usage();
+  std::unique_lock<std::mutex> guard(m_lock);
+  m_cv.wait(guard, [this]() { return m_started || m_stopped; });
+  if (!m_started)
+  {
+    return;
+  }
+  auto next = m_start + m_interval;
+  while (!m_cv.wait_until(guard, next, [this]() { return m_stopped; }))
+  {
+    take_sample();
+    next += m_interval;
+  }
+  take_sample();
+}
+
+void throughput_sampler::take_sample()
+{
+  throughput_sample sample;
+  int64_t bytes = 0;
+  int64_t operations = 0;
+  for (int i = 0; i < m_num_slots; ++i)
+  {
+    const auto& s = m_slots[i];
+    bytes += s.bytes.load(std::memory_order_relaxed);
+    operations += s.operations.load(std::memory_order_relaxed);
+    sample.in_flight += s.in_flight.load(std::memory_order_relaxed);
+  }
+  sample.bytes = bytes - m_last_bytes;
+  sample.operations = operations - m_last_operations;
+  m_last_bytes = bytes;
+  m_last_operations = operations;
+  m_samples.push_back(sample);
+}
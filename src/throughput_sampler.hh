@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct throughput_sample
+{
+  // completed in the interval
+  int64_t bytes = 0;
+  int64_t operations = 0;
+  // operations in flight at the end of the interval
+  int64_t in_flight = 0;
+};
+
+/*
+ * Progress of a trial over time. Operations are reported on one of num_slots counters, a worker
+ * reports on the slot of its thread id, so that workers don't share the cache line they update.
+ * A background thread sums the slots every interval from start() on. An operation's bytes count
+ * in the interval it completes in.
+ */
+class throughput_sampler {
+public:
+  // an interval of 0 doesn't sample
+  throughput_sampler(std::chrono::milliseconds interval, int num_slots);
+  throughput_sampler(const throughput_sampler&) = delete;
+  throughput_sampler& operator=(const throughput_sampler&) = delete;
+  ~throughput_sampler();
+
+  void start(std::chrono::steady_clock::time_point start);
+  // an operation is finished or failed on the slot it was started on
+  void operation_started(int slot)
+  {
+    m_slots[slot].in_flight.fetch_add(1, std::memory_order_relaxed);
+  }
+  void operation_finished(int slot, int64_t bytes)
+  {
+    auto& s = m_slots[slot];
+    s.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    s.operations.fetch_add(1, std::memory_order_relaxed);
+    s.in_flight.fetch_sub(1, std::memory_order_relaxed);
+  }
+  void operation_failed(int slot)
+  {
+    m_slots[slot].in_flight.fetch_sub(1, std::memory_order_relaxed);
+  }
+  // The last sample covers the time since the previous one, it's shorter than an interval.
+  std::vector<throughput_sample> stop();
+
+  std::chrono::milliseconds interval() const { return m_interval; }
+
+private:
+  void sampler_loop();
+  void take_sample();
+
+  struct slot_counters
+  {
+    std::atomic<int64_t> bytes{0};
+    std::atomic<int64_t> operations{0};
+    std::atomic<int64_t> in_flight{0};
+    // two cache lines per slot keep the counters of neighbouring slots apart however the array
+    // is aligned, C++14 can't allocate over-aligned types
+    char padding[128 - 3 * sizeof(std::atomic<int64_t>)];
+  };
+
+  std::chrono::milliseconds m_interval;
+  int m_num_slots;
+  std::unique_ptr<slot_counters[]> m_slots;
+
+  std::mutex m_lock;
+  std::condition_variable m_cv;
+  std::chrono::steady_clock::time_point m_start;
+  bool m_started = false;
+  bool m_stopped = false;
+  std::thread m_thread;
+
+  // only used by the sampling thread until it's joined
+  std::vector<throughput_sample> m_samples;
+  int64_t m_last_bytes = 0;
+  int64_t m_last_operations = 0;
+};
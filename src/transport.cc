@@ -3,42 +3,567 @@
 #if defined(_WIN32)
 #include <azure/core/http/win_http_transport.hpp>
 #endif
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <streambuf>
+#include <thread>
+
 #include <azure/core/http/curl_transport.hpp>
+#include <azure/core/http/policies/policy.hpp>
+#include <azure/core/io/body_stream.hpp>
 #include <azure/storage/blobs.hpp>
 #include <blob/blob_client.h>
 #include <mstream.h>
 
-#include "constants.hh"
+#include "curl_multi_transport.hh"
+#include "request_timing.hh"
+#include "settings.hh"
 #include "utilities.hh"
+#include "worker_pool.hh"
+
+void download_sink::write(const uint8_t* data, size_t size)
+{
+  while (size != 0)
+  {
+    size_t chunk_size;
+    uint8_t* buffer = prepare(chunk_size);
+    if (chunk_size == 0)
+    {
+      throw std::runtime_error("download sink returned an empty chunk");
+    }
+    chunk_size = std::min(chunk_size, size);
+    std::memcpy(buffer, data, chunk_size);
+    commit(chunk_size);
+    data += chunk_size;
+    size -= chunk_size;
+  }
+}
+
+ring_buffer_sink::ring_buffer_sink(size_t capacity)
+    : m_buffer(allocate_worker_buffer(capacity)), m_capacity(capacity)
+{
+}
+
+uint8_t* ring_buffer_sink::contiguous_buffer(size_t blob_size)
+{
+  return blob_size <= m_capacity && m_offset == 0 ? m_buffer.get() : nullptr;
+}
+
+uint8_t* ring_buffer_sink::prepare(size_t& size)
+{
+  size = m_capacity - m_offset;
+  return m_buffer.get() + m_offset;
+}
+
+void ring_buffer_sink::commit(size_t size)
+{
+  m_offset += size;
+  if (m_offset == m_capacity)
+  {
+    m_offset = 0;
+  }
+}
+
+discard_sink::discard_sink(size_t scratch_size)
+    : m_scratch(allocate_worker_buffer(scratch_size)), m_scratch_size(scratch_size)
+{
+}
+
+uint8_t* discard_sink::prepare(size_t& size)
+{
+  size = m_scratch_size;
+  return m_scratch.get();
+}
+
+void transport::set_transactional_hash(hash_algorithm hash)
+{
+  if (hash != hash_algorithm::none)
+  {
+    throw std::invalid_argument(name + " doesn't support transactional hashes");
+  }
+}
+
+namespace {
+
+// Adapts a download_sink to the std::ostream cpplite downloads into.
+class sink_streambuf : public std::streambuf {
+public:
+  explicit sink_streambuf(download_sink& sink) : m_sink(sink) {}
+
+protected:
+  std::streamsize xsputn(const char* s, std::streamsize n) override
+  {
+    m_sink.write(reinterpret_cast<const uint8_t*>(s), static_cast<size_t>(n));
+    m_written += n;
+    return n;
+  }
+  int_type overflow(int_type ch) override
+  {
+    if (!traits_type::eq_int_type(ch, traits_type::eof()))
+    {
+      const uint8_t c = static_cast<uint8_t>(ch);
+      m_sink.write(&c, 1);
+      ++m_written;
+    }
+    return traits_type::not_eof(ch);
+  }
+  // content can't be rewound, only report the current position
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) override
+  {
+    const off_type target = dir == std::ios_base::beg ? off : m_written + off;
+    return target == m_written && dir != std::ios_base::end ? pos_type(m_written)
+                                                             : pos_type(off_type(-1));
+  }
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+  {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+  }
+
+private:
+  download_sink& m_sink;
+  off_type m_written = 0;
+};
+
+// Tells when the first byte is written into the wrapped stream buffer.
+class first_write_streambuf : public std::streambuf {
+public:
+  explicit first_write_streambuf(std::streambuf* target) : m_target(target) {}
+
+  std::chrono::steady_clock::time_point first_write() const { return m_first_write; }
+
+protected:
+  std::streamsize xsputn(const char* s, std::streamsize n) override
+  {
+    mark();
+    return m_target->sputn(s, n);
+  }
+  int_type overflow(int_type ch) override
+  {
+    mark();
+    return traits_type::eq_int_type(ch, traits_type::eof()) ? traits_type::not_eof(ch)
+                                                            : m_target->sputc(char_type(ch));
+  }
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+      override
+  {
+    return m_target->pubseekoff(off, dir, which);
+  }
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+  {
+    return m_target->pubseekpos(pos, which);
+  }
+
+private:
+  void mark()
+  {
+    if (m_first_write == std::chrono::steady_clock::time_point())
+    {
+      m_first_write = std::chrono::steady_clock::now();
+    }
+  }
+
+  std::streambuf* m_target;
+  std::chrono::steady_clock::time_point m_first_write;
+};
+
+// cpplite builds and signs a request on the thread that calls into blob_client, so the times
+// around signing are passed between cpplite_transport and the credential in thread locals.
+// Set by cpplite_transport before calling into the client, cleared once the build time is taken.
+thread_local std::chrono::steady_clock::time_point cpplite_operation_start;
+// when the most recent request of this thread was signed
+thread_local std::chrono::steady_clock::time_point cpplite_request_signed;
+
+// cpplite has no pipeline to hook into, signing is the only step it hands to user code.
+class timed_shared_key_credential : public azure::storage_lite::storage_credential {
+public:
+  timed_shared_key_credential(const std::string& account_name, const std::string& account_key)
+      : m_credential(account_name, account_key)
+  {
+  }
+
+  void sign_request(
+      const azure::storage_lite::storage_request_base& request,
+      azure::storage_lite::http_base& http,
+      const azure::storage_lite::storage_url& url,
+      azure::storage_lite::storage_headers& headers) const override
+  {
+    const auto start = std::chrono::steady_clock::now();
+    if (cpplite_operation_start != std::chrono::steady_clock::time_point())
+    {
+      record_request_phase(request_phase::build, start - cpplite_operation_start);
+      cpplite_operation_start = std::chrono::steady_clock::time_point();
+    }
+    m_credential.sign_request(request, http, url, headers);
+    cpplite_request_signed = std::chrono::steady_clock::now();
+    record_request_phase(request_phase::sign, cpplite_request_signed - start);
+  }
+
+  std::string transform_url(std::string url) const override
+  {
+    return m_credential.transform_url(std::move(url));
+  }
+
+private:
+  azure::storage_lite::shared_key_credential m_credential;
+};
+
+[[noreturn]] void throw_storage_exception(const azure::storage_lite::storage_error& error)
+{
+  throw azure::storage_lite::storage_exception(
+      std::stoi(error.code), error.code_name, error.message);
+}
+
+// Keeps up to concurrency cpplite requests in flight. launch(i, stream) starts the i-th request
+// and creates the stream it reads from or writes to, which is kept alive until it completes. The
+// first error stops launching requests and is rethrown once all requests in flight completed,
+// cpplite's futures don't wait for their request when destroyed.
+template <class Stream, class Launch>
+void cpplite_pipeline(size_t num_requests, int concurrency, Launch launch)
+{
+  using namespace azure::storage_lite;
+
+  struct pending_request
+  {
+    std::unique_ptr<Stream> stream;
+    std::future<storage_outcome<void>> outcome;
+  };
+  std::deque<pending_request> pending;
+  std::exception_ptr exception;
+  auto wait_oldest = [&pending, &exception]() {
+    try
+    {
+      auto ret = pending.front().outcome.get();
+      if (!ret.success())
+      {
+        throw_storage_exception(ret.error());
+      }
+    }
+    catch (...)
+    {
+      if (!exception)
+      {
+        exception = std::current_exception();
+      }
+    }
+    pending.pop_front();
+  };
+  for (size_t i = 0; i < num_requests && !exception; ++i)
+  {
+    if (pending.size() >= static_cast<size_t>(std::max(concurrency, 1)))
+    {
+      wait_oldest();
+      if (exception)
+      {
+        break;
+      }
+    }
+    pending_request r;
+    try
+    {
+      r.outcome = launch(i, r.stream);
+    }
+    catch (...)
+    {
+      exception = std::current_exception();
+      break;
+    }
+    pending.push_back(std::move(r));
+  }
+  while (!pending.empty())
+  {
+    wait_oldest();
+  }
+  if (exception)
+  {
+    std::rethrow_exception(exception);
+  }
+}
+
+/*
+ * Runs request(i) for i in [0, num_requests) on up to concurrency threads, the way Track2's own
+ * concurrent transfers do, and rethrows the first exception once all threads are done.
+ */
+void track2_pipeline(
+    size_t num_requests,
+    int concurrency,
+    const std::function<void(size_t)>& request)
+{
+  std::atomic<size_t> next(0);
+  std::mutex lock;
+  std::exception_ptr exception;
+  auto run = [&]() {
+    for (size_t i = next++; i < num_requests; i = next++)
+    {
+      try
+      {
+        request(i);
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!exception)
+        {
+          exception = std::current_exception();
+        }
+        next = num_requests;
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < std::min(num_requests, static_cast<size_t>(std::max(concurrency, 1)));
+       ++i)
+  {
+    threads.emplace_back(run);
+  }
+  run();
+  for (auto& t : threads)
+  {
+    t.join();
+  }
+  if (exception)
+  {
+    std::rethrow_exception(exception);
+  }
+}
+
+/*
+ * Track2 instrumentation. The pipeline of a blob client runs the per-operation policies, the retry
+ * policy, the per-retry policies followed by the shared key policy the client appends, and the
+ * transport. Time before the first per-operation policy is spent building the request, time from
+ * the per-retry policy to the transport is spent signing it. Azure's transports manage their own
+ * connections and don't report connect or TLS time, so these are part of first_byte.
+ */
+struct track2_operation
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  // operations split into several requests report the build time of the first one only
+  std::atomic<bool> build_recorded{false};
+};
+
+const Azure::Core::Context::Key& track2_operation_key()
+{
+  static const Azure::Core::Context::Key key;
+  return key;
+}
+
+const Azure::Core::Context::Key& track2_policies_start_key()
+{
+  static const Azure::Core::Context::Key key;
+  return key;
+}
+
+Azure::Core::Context track2_context(track2_operation& operation)
+{
+  return Azure::Core::Context().WithValue(track2_operation_key(), &operation);
+}
+
+class track2_build_timing_policy : public Azure::Core::Http::Policies::HttpPolicy {
+public:
+  std::unique_ptr<Azure::Core::Http::RawResponse> Send(
+      Azure::Core::Http::Request& request,
+      Azure::Core::Http::Policies::NextHttpPolicy next_policy,
+      const Azure::Core::Context& context) const override
+  {
+    track2_operation* operation = nullptr;
+    if (context.TryGetValue(track2_operation_key(), operation) && operation
+        && !operation->build_recorded.exchange(true))
+    {
+      record_request_phase(
+          request_phase::build, std::chrono::steady_clock::now() - operation->start);
+    }
+    return next_policy.Send(request, context);
+  }
+
+  std::unique_ptr<Azure::Core::Http::Policies::HttpPolicy> Clone() const override
+  {
+    return std::make_unique<track2_build_timing_policy>(*this);
+  }
+};
+
+class track2_sign_timing_policy : public Azure::Core::Http::Policies::HttpPolicy {
+public:
+  std::unique_ptr<Azure::Core::Http::RawResponse> Send(
+      Azure::Core::Http::Request& request,
+      Azure::Core::Http::Policies::NextHttpPolicy next_policy,
+      const Azure::Core::Context& context) const override
+  {
+    return next_policy.Send(
+        request, context.WithValue(track2_policies_start_key(), std::chrono::steady_clock::now()));
+  }
+
+  std::unique_ptr<Azure::Core::Http::Policies::HttpPolicy> Clone() const override
+  {
+    return std::make_unique<track2_sign_timing_policy>(*this);
+  }
+};
+
+// Records the body phase once the body has been read to the end or is dropped.
+class track2_timed_body_stream : public Azure::Core::IO::BodyStream {
+public:
+  track2_timed_body_stream(
+      std::unique_ptr<Azure::Core::IO::BodyStream> body,
+      std::chrono::steady_clock::time_point headers_received)
+      : m_body(std::move(body)), m_headers_received(headers_received)
+  {
+  }
+  ~track2_timed_body_stream() override { finish(); }
+
+  int64_t Length() const override { return m_body->Length(); }
+  void Rewind() override { m_body->Rewind(); }
+
+private:
+  size_t OnRead(uint8_t* buffer, size_t count, const Azure::Core::Context& context) override
+  {
+    const size_t read = m_body->Read(buffer, count, context);
+    m_read += read;
+    if ((read == 0 && count != 0) || m_read == m_body->Length())
+    {
+      finish();
+    }
+    return read;
+  }
+
+  void finish()
+  {
+    if (!m_finished)
+    {
+      m_finished = true;
+      record_request_phase(
+          request_phase::body, std::chrono::steady_clock::now() - m_headers_received);
+    }
+  }
+
+  std::unique_ptr<Azure::Core::IO::BodyStream> m_body;
+  std::chrono::steady_clock::time_point m_headers_received;
+  int64_t m_read = 0;
+  bool m_finished = false;
+};
+
+class track2_timed_transport : public Azure::Core::Http::HttpTransport {
+public:
+  explicit track2_timed_transport(std::shared_ptr<Azure::Core::Http::HttpTransport> transport)
+      : m_transport(std::move(transport))
+  {
+  }
+
+  std::unique_ptr<Azure::Core::Http::RawResponse> Send(
+      Azure::Core::Http::Request& request,
+      const Azure::Core::Context& context) override
+  {
+    const auto start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point policies_start;
+    if (context.TryGetValue(track2_policies_start_key(), policies_start))
+    {
+      record_request_phase(request_phase::sign, start - policies_start);
+    }
+    auto response = m_transport->Send(request, context);
+    const auto headers_received = std::chrono::steady_clock::now();
+    record_request_phase(request_phase::first_byte, headers_received - start);
+    if (auto body = response->ExtractBodyStream())
+    {
+      response->SetBodyStream(
+          std::make_unique<track2_timed_body_stream>(std::move(body), headers_received));
+    }
+    return response;
+  }
+
+private:
+  std::shared_ptr<Azure::Core::Http::HttpTransport> m_transport;
+};
+
+Azure::Storage::HashAlgorithm to_azure_hash_algorithm(hash_algorithm hash)
+{
+  return hash == hash_algorithm::md5 ? Azure::Storage::HashAlgorithm::Md5
+                                     : Azure::Storage::HashAlgorithm::Crc64;
+}
+
+Azure::Storage::Blobs::BlobClientOptions track2_client_options(
+    std::shared_ptr<Azure::Core::Http::HttpTransport> transport)
+{
+  Azure::Storage::Blobs::BlobClientOptions options;
+  options.Retry.MaxRetries = 0;
+  options.Transport.Transport = std::make_shared<track2_timed_transport>(std::move(transport));
+  options.PerOperationPolicies.push_back(std::make_unique<track2_build_timing_policy>());
+  options.PerRetryPolicies.push_back(std::make_unique<track2_sign_timing_policy>());
+  return options;
+}
+
+} // namespace
 
 void cpplite_transport::reset(int concurrency)
 {
   using namespace azure::storage_lite;
-  auto cred = std::make_shared<shared_key_credential>(
+  auto cred = std::make_shared<timed_shared_key_credential>(
       get_account_name_from_connection_string(), get_access_key_from_connection_string());
+  // cpplite takes the endpoint without scheme, e.g. 127.0.0.1:10000/devstoreaccount1
+  std::string blob_endpoint = get_blob_endpoint_from_connection_string();
+  const bool use_https = blob_endpoint.compare(0, 7, "http://") != 0;
+  const auto scheme_end = blob_endpoint.find("://");
+  if (scheme_end != std::string::npos)
+  {
+    blob_endpoint = blob_endpoint.substr(scheme_end + 3);
+  }
   auto account = std::make_shared<storage_account>(
-      get_account_name_from_connection_string(), cred, /* use_https */ true);
-  auto blob_service_client = std::make_shared<blob_client>(account, concurrency);
+      get_account_name_from_connection_string(), cred, use_https, blob_endpoint);
+  auto blob_service_client = std::make_shared<blob_client>(
+      account, m_tuning.connection_pool_size > 0 ? m_tuning.connection_pool_size : concurrency);
   blob_service_client->context()->set_retry_policy(std::make_shared<no_retry_policy>());
   m_blob_service_client = blob_service_client;
 }
 
 void cpplite_transport::download_blob(
     const std::string& blob_name,
-    uint8_t* buffer,
+    download_sink& sink,
     size_t blob_size)
+{
+  download_range(blob_name, sink, 0, blob_size);
+}
+
+void cpplite_transport::download_range(
+    const std::string& blob_name,
+    download_sink& sink,
+    size_t offset,
+    size_t length)
 {
   using namespace azure::storage_lite;
 
   auto blob_service_client = std::static_pointer_cast<blob_client>(m_blob_service_client);
-  omstream os(reinterpret_cast<char*>(buffer), blob_size);
-  auto ret
-      = blob_service_client->download_blob_to_stream(container_name, blob_name, 0, blob_size, os)
-            .get();
-  if (!ret.success())
+  auto download_to = [&](std::ostream& target) {
+    first_write_streambuf streambuf(target.rdbuf());
+    std::ostream os(&streambuf);
+    cpplite_operation_start = std::chrono::steady_clock::now();
+    auto ret = blob_service_client
+                   ->download_blob_to_stream(
+                       settings().container_name, blob_name, offset, length, os)
+                   .get();
+    if (!ret.success())
+    {
+      throw_storage_exception(ret.error());
+    }
+    const auto first_write = streambuf.first_write();
+    if (first_write != std::chrono::steady_clock::time_point())
+    {
+      record_request_phase(request_phase::first_byte, first_write - cpplite_request_signed);
+      record_request_phase(request_phase::body, std::chrono::steady_clock::now() - first_write);
+    }
+  };
+  if (uint8_t* buffer = sink.contiguous_buffer(length))
   {
-    throw storage_exception(
-        std::stoi(ret.error().code), ret.error().code_name, ret.error().message);
+    omstream os(reinterpret_cast<char*>(buffer), length);
+    download_to(os);
+  }
+  else
+  {
+    sink_streambuf streambuf(sink);
+    std::ostream os(&streambuf);
+    download_to(os);
   }
 }
 
@@ -51,29 +576,211 @@ void cpplite_transport::upload_blob(
 
   auto blob_service_client = std::static_pointer_cast<blob_client>(m_blob_service_client);
   imstream is(reinterpret_cast<const char*>(buffer), blob_size);
+  const std::vector<std::pair<std::string, std::string>> metadata(
+      m_upload_metadata.begin(), m_upload_metadata.end());
+  cpplite_operation_start = std::chrono::steady_clock::now();
+  auto ret = blob_service_client
+                 ->upload_block_blob_from_stream(settings().container_name, blob_name, is, metadata)
+                 .get();
+  if (!ret.success())
+  {
+    throw_storage_exception(ret.error());
+  }
+  record_request_phase(
+      request_phase::first_byte, std::chrono::steady_clock::now() - cpplite_request_signed);
+}
+
+void cpplite_transport::get_blob_properties(const std::string& blob_name)
+{
+  using namespace azure::storage_lite;
+
+  auto blob_service_client = std::static_pointer_cast<blob_client>(m_blob_service_client);
+  cpplite_operation_start = std::chrono::steady_clock::now();
   auto ret
-      = blob_service_client->upload_block_blob_from_stream(container_name, blob_name, is, {}).get();
+      = blob_service_client->get_blob_properties(settings().container_name, blob_name).get();
   if (!ret.success())
   {
-    throw storage_exception(
-        std::stoi(ret.error().code), ret.error().code_name, ret.error().message);
+    throw_storage_exception(ret.error());
   }
+  record_request_phase(
+      request_phase::first_byte, std::chrono::steady_clock::now() - cpplite_request_signed);
 }
 
-void track2_transport::download_blob(
+void cpplite_transport::download_blob_parallel(
     const std::string& blob_name,
     uint8_t* buffer,
+    size_t blob_size,
+    size_t chunk_size,
+    int concurrency)
+{
+  using namespace azure::storage_lite;
+
+  auto blob_service_client = std::static_pointer_cast<blob_client>(m_blob_service_client);
+  const size_t num_chunks = (blob_size + chunk_size - 1) / chunk_size;
+  cpplite_pipeline<omstream>(num_chunks, concurrency, [&](size_t i, std::unique_ptr<omstream>& os) {
+    const size_t offset = i * chunk_size;
+    const size_t length = std::min(chunk_size, blob_size - offset);
+    os = std::make_unique<omstream>(reinterpret_cast<char*>(buffer + offset), length);
+    cpplite_operation_start = std::chrono::steady_clock::now();
+    return blob_service_client->download_blob_to_stream(
+        settings().container_name, blob_name, offset, length, *os);
+  });
+}
+
+void cpplite_transport::upload_blob_parallel(
+    const std::string& blob_name,
+    const uint8_t* buffer,
+    size_t blob_size,
+    size_t chunk_size,
+    int concurrency)
+{
+  if (blob_size <= chunk_size)
+  {
+    upload_blob(blob_name, buffer, blob_size);
+    return;
+  }
+
+  stage_blocks(blob_name, buffer, blob_size, chunk_size, concurrency);
+  commit_blocks(blob_name, (blob_size + chunk_size - 1) / chunk_size);
+}
+
+void cpplite_transport::stage_blocks(
+    const std::string& blob_name,
+    const uint8_t* buffer,
+    size_t blob_size,
+    size_t block_size,
+    int concurrency)
+{
+  using namespace azure::storage_lite;
+
+  auto blob_service_client = std::static_pointer_cast<blob_client>(m_blob_service_client);
+  const size_t num_blocks = (blob_size + block_size - 1) / block_size;
+  cpplite_pipeline<imstream>(num_blocks, concurrency, [&](size_t i, std::unique_ptr<imstream>& is) {
+    const size_t offset = i * block_size;
+    const size_t length = std::min(block_size, blob_size - offset);
+    is = std::make_unique<imstream>(reinterpret_cast<const char*>(buffer + offset), length);
+    cpplite_operation_start = std::chrono::steady_clock::now();
+    return blob_service_client->upload_block_from_stream(
+        settings().container_name, blob_name, get_block_id(static_cast<int>(i)), *is);
+  });
+}
+
+void cpplite_transport::commit_blocks(const std::string& blob_name, size_t num_blocks)
+{
+  using namespace azure::storage_lite;
+
+  auto blob_service_client = std::static_pointer_cast<blob_client>(m_blob_service_client);
+  std::vector<put_block_list_request_base::block_item> block_list;
+  for (size_t i = 0; i < num_blocks; ++i)
+  {
+    put_block_list_request_base::block_item block;
+    block.id = get_block_id(static_cast<int>(i));
+    block.type = put_block_list_request_base::block_type::uncommitted;
+    block_list.push_back(std::move(block));
+  }
+  cpplite_operation_start = std::chrono::steady_clock::now();
+  auto ret = blob_service_client
+                 ->put_block_list(settings().container_name, blob_name, block_list, {})
+                 .get();
+  if (!ret.success())
+  {
+    throw_storage_exception(ret.error());
+  }
+}
+
+void track2_transport::download_blob(
+    const std::string& blob_name,
+    download_sink& sink,
     size_t blob_size)
+{
+  download(blob_name, sink, 0, blob_size, true);
+}
+
+void track2_transport::download_range(
+    const std::string& blob_name,
+    download_sink& sink,
+    size_t offset,
+    size_t length)
+{
+  download(blob_name, sink, offset, length, false);
+}
+
+void track2_transport::download(
+    const std::string& blob_name,
+    download_sink& sink,
+    size_t offset,
+    size_t length,
+    bool whole_blob)
 {
   using namespace Azure::Storage::Blobs;
 
   auto container_client = std::static_pointer_cast<BlobContainerClient>(m_container_client);
   auto blob_client = container_client->GetBlobClient(blob_name);
-  DownloadBlobToOptions options;
-  options.TransferOptions.InitialChunkSize = blob_size;
-  options.TransferOptions.ChunkSize = blob_size;
-  options.TransferOptions.Concurrency = 1;
-  blob_client.DownloadTo(buffer, blob_size, options);
+  uint8_t* buffer
+      = m_transactional_hash == hash_algorithm::none ? sink.contiguous_buffer(length) : nullptr;
+  if (buffer)
+  {
+    DownloadBlobToOptions options;
+    options.TransferOptions.InitialChunkSize = length;
+    options.TransferOptions.ChunkSize = length;
+    options.TransferOptions.Concurrency = 1;
+    if (!whole_blob)
+    {
+      options.Range = Azure::Core::Http::HttpRange();
+      options.Range.Value().Offset = offset;
+      options.Range.Value().Length = length;
+    }
+    track2_operation operation;
+    blob_client.DownloadTo(buffer, length, options, track2_context(operation));
+    return;
+  }
+
+  // the service computes transactional hashes of ranges up to 4MB only
+  const size_t range_size = m_transactional_hash == hash_algorithm::none ? length : size_t(4_MB);
+  const size_t end = offset + length;
+  track2_operation operation;
+  for (size_t range_offset = offset; range_offset < end; range_offset += range_size)
+  {
+    const size_t range_length = std::min(range_size, end - range_offset);
+    DownloadBlobOptions options;
+    options.Range = Azure::Core::Http::HttpRange();
+    options.Range.Value().Offset = range_offset;
+    options.Range.Value().Length = range_length;
+    auto hash = make_hash(m_transactional_hash);
+    if (hash)
+    {
+      options.RangeHashAlgorithm = to_azure_hash_algorithm(m_transactional_hash);
+    }
+    auto response = blob_client.Download(options, track2_context(operation));
+    auto& body_stream = response.Value.BodyStream;
+    size_t remaining = range_length;
+    while (remaining != 0)
+    {
+      size_t chunk_size;
+      uint8_t* chunk = sink.prepare(chunk_size);
+      chunk_size = body_stream->Read(chunk, std::min(chunk_size, remaining));
+      if (chunk_size == 0)
+      {
+        throw std::runtime_error("unexpected end of stream when downloading " + blob_name);
+      }
+      if (hash)
+      {
+        hash->Append(chunk, chunk_size);
+      }
+      sink.commit(chunk_size);
+      remaining -= chunk_size;
+    }
+    if (hash)
+    {
+      const auto& expected = response.Value.TransactionalContentHash;
+      if (!expected.HasValue() || expected.Value().Value != hash->Final())
+      {
+        throw std::runtime_error(
+            "transactional " + to_string(m_transactional_hash) + " mismatch when downloading "
+            + blob_name);
+      }
+    }
+  }
 }
 
 void track2_transport::upload_blob(
@@ -85,21 +792,129 @@ void track2_transport::upload_blob(
 
   auto container_client = std::static_pointer_cast<BlobContainerClient>(m_container_client);
   auto blob_client = container_client->GetBlockBlobClient(blob_name);
+  if (m_transactional_hash != hash_algorithm::none)
+  {
+    // UploadFrom takes no hash, a single Put Blob does
+    UploadBlockBlobOptions options;
+    Azure::Storage::ContentHash hash;
+    hash.Algorithm = to_azure_hash_algorithm(m_transactional_hash);
+    hash.Value = make_hash(m_transactional_hash)->Final(buffer, blob_size);
+    options.TransactionalContentHash = hash;
+    for (const auto& m : m_upload_metadata)
+    {
+      options.Metadata[m.first] = m.second;
+    }
+    Azure::Core::IO::MemoryBodyStream stream(buffer, blob_size);
+    track2_operation operation;
+    blob_client.Upload(stream, options, track2_context(operation));
+    return;
+  }
+
   UploadBlockBlobFromOptions options;
   options.TransferOptions.ChunkSize = blob_size;
   options.TransferOptions.Concurrency = 1;
-  blob_client.UploadFrom(buffer, blob_size, options);
+  for (const auto& m : m_upload_metadata)
+  {
+    options.Metadata[m.first] = m.second;
+  }
+  track2_operation operation;
+  blob_client.UploadFrom(buffer, blob_size, options, track2_context(operation));
+}
+
+void track2_transport::get_blob_properties(const std::string& blob_name)
+{
+  using namespace Azure::Storage::Blobs;
+
+  auto container_client = std::static_pointer_cast<BlobContainerClient>(m_container_client);
+  track2_operation operation;
+  container_client->GetBlobClient(blob_name).GetProperties(
+      GetBlobPropertiesOptions(), track2_context(operation));
+}
+
+void track2_transport::download_blob_parallel(
+    const std::string& blob_name,
+    uint8_t* buffer,
+    size_t blob_size,
+    size_t chunk_size,
+    int concurrency)
+{
+  using namespace Azure::Storage::Blobs;
+
+  auto container_client = std::static_pointer_cast<BlobContainerClient>(m_container_client);
+  auto blob_client = container_client->GetBlobClient(blob_name);
+  DownloadBlobToOptions options;
+  options.TransferOptions.InitialChunkSize = chunk_size;
+  options.TransferOptions.ChunkSize = chunk_size;
+  options.TransferOptions.Concurrency = concurrency;
+  track2_operation operation;
+  blob_client.DownloadTo(buffer, blob_size, options, track2_context(operation));
+}
+
+void track2_transport::upload_blob_parallel(
+    const std::string& blob_name,
+    const uint8_t* buffer,
+    size_t blob_size,
+    size_t chunk_size,
+    int concurrency)
+{
+  using namespace Azure::Storage::Blobs;
+
+  auto container_client = std::static_pointer_cast<BlobContainerClient>(m_container_client);
+  auto blob_client = container_client->GetBlockBlobClient(blob_name);
+  UploadBlockBlobFromOptions options;
+  // blobs up to one chunk are uploaded with a single Put Blob, like cpplite_transport does
+  options.TransferOptions.SingleUploadThreshold = chunk_size;
+  options.TransferOptions.ChunkSize = chunk_size;
+  options.TransferOptions.Concurrency = concurrency;
+  track2_operation operation;
+  blob_client.UploadFrom(buffer, blob_size, options, track2_context(operation));
+}
+
+void track2_transport::stage_blocks(
+    const std::string& blob_name,
+    const uint8_t* buffer,
+    size_t blob_size,
+    size_t block_size,
+    int concurrency)
+{
+  using namespace Azure::Storage::Blobs;
+
+  auto container_client = std::static_pointer_cast<BlobContainerClient>(m_container_client);
+  auto blob_client = container_client->GetBlockBlobClient(blob_name);
+  const size_t num_blocks = (blob_size + block_size - 1) / block_size;
+  track2_operation operation;
+  track2_pipeline(num_blocks, concurrency, [&](size_t i) {
+    const size_t offset = i * block_size;
+    Azure::Core::IO::MemoryBodyStream body(
+        buffer + offset, std::min(block_size, blob_size - offset));
+    blob_client.StageBlock(
+        get_block_id(static_cast<int>(i)), body, StageBlockOptions(), track2_context(operation));
+  });
+}
+
+void track2_transport::commit_blocks(const std::string& blob_name, size_t num_blocks)
+{
+  using namespace Azure::Storage::Blobs;
+
+  auto container_client = std::static_pointer_cast<BlobContainerClient>(m_container_client);
+  auto blob_client = container_client->GetBlockBlobClient(blob_name);
+  std::vector<std::string> block_ids;
+  for (size_t i = 0; i < num_blocks; ++i)
+  {
+    block_ids.push_back(get_block_id(static_cast<int>(i)));
+  }
+  track2_operation operation;
+  blob_client.CommitBlockList(block_ids, CommitBlockListOptions(), track2_context(operation));
 }
 
 track2_curl_transport::track2_curl_transport() : track2_transport("Track2(curl)")
 {
   using namespace Azure::Storage::Blobs;
 
-  BlobClientOptions clientOptions;
-  clientOptions.Retry.MaxRetries = 0;
-  clientOptions.Transport.Transport = std::make_shared<Azure::Core::Http::CurlTransport>();
+  auto clientOptions
+      = track2_client_options(std::make_shared<Azure::Core::Http::CurlTransport>());
   auto container_client = BlobContainerClient::CreateFromConnectionString(
-      connection_string, container_name, clientOptions);
+      get_connection_string(), settings().container_name, clientOptions);
   m_container_client = std::make_shared<BlobContainerClient>(std::move(container_client));
 }
 
@@ -109,12 +924,131 @@ track2_winhttp_transport::track2_winhttp_transport() : track2_transport("Track2(
 {
   using namespace Azure::Storage::Blobs;
 
-  BlobClientOptions clientOptions;
-  clientOptions.Retry.MaxRetries = 0;
-  clientOptions.Transport.Transport = std::make_shared<Azure::Core::Http::WinHttpTransport>();
+  auto clientOptions
+      = track2_client_options(std::make_shared<Azure::Core::Http::WinHttpTransport>());
   auto container_client = BlobContainerClient::CreateFromConnectionString(
-      connection_string, container_name, clientOptions);
+      get_connection_string(), settings().container_name, clientOptions);
   m_container_client = std::make_shared<BlobContainerClient>(std::move(container_client));
 }
 
-#endif
\ No newline at end of file
+#endif
+
+std::string to_string(const transport_tuning& tuning)
+{
+  std::string knobs;
+  auto add = [&knobs](const std::string& knob) { knobs += (knobs.empty() ? "" : ",") + knob; };
+  auto on_off = [](int enabled) { return std::string(enabled ? "on" : "off"); };
+  if (tuning.connection_pool_size > 0)
+  {
+    add("pool=" + std::to_string(tuning.connection_pool_size));
+  }
+  if (tuning.tcp_nodelay >= 0)
+  {
+    add("nodelay=" + on_off(tuning.tcp_nodelay));
+  }
+  if (tuning.socket_send_buffer > 0)
+  {
+    add("sndbuf=" + size_to_string(static_cast<uint64_t>(tuning.socket_send_buffer)));
+  }
+  if (tuning.socket_receive_buffer > 0)
+  {
+    add("rcvbuf=" + size_to_string(static_cast<uint64_t>(tuning.socket_receive_buffer)));
+  }
+  if (!tuning.http_version.empty())
+  {
+    add("http=" + tuning.http_version);
+  }
+  if (tuning.tls_session_reuse >= 0)
+  {
+    add("tls_reuse=" + on_off(tuning.tls_session_reuse));
+  }
+  if (tuning.receive_buffer > 0)
+  {
+    add("bufsize=" + size_to_string(static_cast<uint64_t>(tuning.receive_buffer)));
+  }
+  return knobs.empty() ? knobs : "{" + knobs + "}";
+}
+
+std::shared_ptr<transport> make_transport(const std::string& name)
+{
+  const std::string base_name = base_transport_name(name);
+  transport_tuning tuning;
+  if (name != base_name)
+  {
+    // a variant is looked up rather than parsed from its name
+    const auto ite = settings().transport_tunings.find(name);
+    if (ite == settings().transport_tunings.end())
+    {
+      return nullptr;
+    }
+    tuning = ite->second;
+  }
+  if (base_name == "cpplite")
+  {
+    return std::make_shared<cpplite_transport>(tuning);
+  }
+  else if (base_name == "Track2(curl)")
+  {
+    return std::make_shared<track2_curl_transport>();
+  }
+#if defined(_WIN32)
+  else if (base_name == "Track2(WinHTTP)")
+  {
+    return std::make_shared<track2_winhttp_transport>();
+  }
+#endif
+  else if (base_name == "curl-multi")
+  {
+    return std::make_shared<curl_multi_transport>(settings().event_loop_threads, tuning);
+  }
+  return nullptr;
+}
+
+std::vector<std::string> available_transports()
+{
+  std::vector<std::string> names = {"cpplite", "Track2(curl)"};
+#if defined(_WIN32)
+  names.push_back("Track2(WinHTTP)");
+#endif
+  names.push_back("curl-multi");
+  return names;
+}
+
+std::vector<std::string> default_transports()
+{
+  auto names = available_transports();
+  names.erase(std::remove(names.begin(), names.end(), "curl-multi"), names.end());
+  return names;
+}
+
+std::string base_transport_name(const std::string& name) { return name.substr(0, name.find('{')); }
+
+transport_tuning supported_tuning(const std::string& base_name, const transport_tuning& tuning)
+{
+  if (base_name == "curl-multi")
+  {
+    return tuning;
+  }
+  transport_tuning ret;
+  if (base_name == "cpplite")
+  {
+    ret.connection_pool_size = tuning.connection_pool_size;
+  }
+  return ret;
+}
+
+bool is_async_transport(const std::string& name)
+{
+  return base_transport_name(name) == "curl-multi";
+}
+
+bool shares_connections(const std::string& name)
+{
+  return base_transport_name(name) == "Track2(curl)";
+}
+
+bool supports_transactional_hash(const std::string& name)
+{
+  const std::string base_name = base_transport_name(name);
+  return base_name == "Track2(curl)" || base_name == "Track2(WinHTTP)";
+}
@@ -1,42 +1,261 @@
 #pragma once
 
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "integrity.hh"
+
+/*
+ * Destination of downloaded blob content. Transports either download straight into
+ * contiguous_buffer(), or deliver the content in order in chunks, receiving into the memory
+ * returned by prepare() and handing it back with commit(), or pushing it with write().
+ */
+class download_sink {
+public:
+  // Memory to download a whole blob of blob_size bytes into, nullptr if it doesn't fit. A
+  // transport that asks for it downloads the blob into it.
+  virtual uint8_t* contiguous_buffer(size_t /* blob_size */) { return nullptr; }
+  // Returns memory for the next chunk, size is set to its length, which is never 0.
+  virtual uint8_t* prepare(size_t& size) = 0;
+  virtual void commit(size_t size) = 0;
+  virtual void write(const uint8_t* data, size_t size);
+  virtual ~download_sink() {}
+};
+
+// Keeps the most recent capacity bytes of downloaded content, a ring buffer of the blob size
+// holds the whole blob. Memory comes from allocate_worker_buffer(), it's placed on the NUMA node of
+// the constructing thread when workers are pinned.
+class ring_buffer_sink : public download_sink {
+public:
+  explicit ring_buffer_sink(size_t capacity);
+
+  // only available while the ring is at offset 0, i.e. before anything is committed or after the
+  // ring wrapped around exactly, so that a blob downloaded into it starts at the same place as
+  // one written in chunks
+  uint8_t* contiguous_buffer(size_t blob_size) override;
+  uint8_t* prepare(size_t& size) override;
+  void commit(size_t size) override;
+
+private:
+  std::unique_ptr<uint8_t[]> m_buffer;
+  size_t m_capacity;
+  size_t m_offset = 0;
+};
+
+// Drops downloaded content, scratch_size bytes are used to receive chunks from pull-style
+// transports.
+class discard_sink : public download_sink {
+public:
+  explicit discard_sink(size_t scratch_size);
+
+  uint8_t* prepare(size_t& size) override;
+  void commit(size_t) override {}
+  void write(const uint8_t*, size_t) override {}
+
+private:
+  std::unique_ptr<uint8_t[]> m_scratch;
+  size_t m_scratch_size;
+};
+
+/*
+ * Knobs that make a variant of a transport. A knob left at its default keeps the transport's own
+ * setting, and a transport ignores the knobs it doesn't expose, see supported_tuning().
+ */
+struct transport_tuning
+{
+  // connections a client keeps, 0 for as many as requests in flight
+  int connection_pool_size = 0;
+  // TCP_NODELAY, -1 for the transport's default
+  int tcp_nodelay = -1;
+  // SO_SNDBUF and SO_RCVBUF of every connection, 0 for the system default
+  int64_t socket_send_buffer = 0;
+  int64_t socket_receive_buffer = 0;
+  // "1.1" or "2", HTTP/2 is negotiated over TLS and falls back to 1.1, empty for the default
+  std::string http_version;
+  // reuse TLS sessions when connecting again, -1 for the transport's default
+  int tls_session_reuse = -1;
+  // bytes libcurl receives at once, 0 for its default
+  int64_t receive_buffer = 0;
+};
+
+// the knobs that aren't at their defaults, e.g. "{nodelay=off,rcvbuf=4MB}", empty if none is
+std::string to_string(const transport_tuning& tuning);
+
 class transport {
 public:
   const std::string name;
 
   virtual void reset(int /* concurrency */) {}
-  virtual void download_blob(const std::string& blob_name, uint8_t* buffer, size_t blob_size) = 0;
+  // Sends a checksum with every request of download_blob and upload_blob for the service to
+  // check, throws std::invalid_argument if the transport doesn't support hash.
+  virtual void set_transactional_hash(hash_algorithm hash);
+  // Metadata upload_blob sets on the blobs it writes from now on, names without the x-ms-meta-
+  // prefix. Cases that overwrite provisioned blobs keep them recognisable to init_blobs with it.
+  void set_upload_metadata(std::map<std::string, std::string> metadata)
+  {
+    m_upload_metadata = std::move(metadata);
+  }
+  virtual void download_blob(const std::string& blob_name, download_sink& sink, size_t blob_size)
+      = 0;
   virtual void upload_blob(const std::string& blob_name, const uint8_t* buffer, size_t blob_size)
       = 0;
+  // Get Blob of length bytes from offset in a single request.
+  virtual void download_range(
+      const std::string& blob_name,
+      download_sink& sink,
+      size_t offset,
+      size_t length)
+      = 0;
+  // Get Blob Properties, a cheap request that opens a connection if none is idle
+  virtual void get_blob_properties(const std::string& blob_name) = 0;
+  // Transfer a single blob in chunk_size pieces, with up to concurrency pieces in flight.
+  virtual void download_blob_parallel(
+      const std::string& blob_name,
+      uint8_t* buffer,
+      size_t blob_size,
+      size_t chunk_size,
+      int concurrency)
+      = 0;
+  virtual void upload_blob_parallel(
+      const std::string& blob_name,
+      const uint8_t* buffer,
+      size_t blob_size,
+      size_t chunk_size,
+      int concurrency)
+      = 0;
+  // Put Block of every block_size piece of the blob with up to concurrency requests in flight,
+  // block i gets the ID get_block_id(i). Nothing is committed.
+  virtual void stage_blocks(
+      const std::string& blob_name,
+      const uint8_t* buffer,
+      size_t blob_size,
+      size_t block_size,
+      int concurrency)
+      = 0;
+  // Put Block List of the uncommitted blocks 0 to num_blocks - 1
+  virtual void commit_blocks(const std::string& blob_name, size_t num_blocks) = 0;
   virtual ~transport() {}
 
 protected:
   transport(std::string name) : name(std::move(name)) {}
+
+  std::map<std::string, std::string> m_upload_metadata;
+};
+
+/*
+ * Transport that keeps requests in flight without a thread each. on_done is called on a transport
+ * thread once a request completes, with nullptr or the exception that failed it. It must not
+ * block, it may issue further requests.
+ */
+class async_transport : public transport {
+public:
+  using completion_handler = std::function<void(std::exception_ptr)>;
+
+  virtual void download_blob_async(
+      const std::string& blob_name,
+      download_sink& sink,
+      size_t blob_size,
+      completion_handler on_done)
+      = 0;
+  virtual void upload_blob_async(
+      const std::string& blob_name,
+      const uint8_t* buffer,
+      size_t blob_size,
+      completion_handler on_done)
+      = 0;
+
+protected:
+  async_transport(std::string name) : transport(std::move(name)) {}
 };
 
 class cpplite_transport : public transport {
 public:
-  cpplite_transport() : transport("cpplite") {}
+  explicit cpplite_transport(const transport_tuning& tuning = transport_tuning())
+      : transport("cpplite" + to_string(tuning)), m_tuning(tuning)
+  {
+  }
 
 private:
   void reset(int concurrency) override;
-  void download_blob(const std::string& blob_name, uint8_t* buffer, size_t blob_size) override;
+  void download_blob(const std::string& blob_name, download_sink& sink, size_t blob_size) override;
   void upload_blob(const std::string& blob_name, const uint8_t* buffer, size_t blob_size) override;
+  void download_range(
+      const std::string& blob_name,
+      download_sink& sink,
+      size_t offset,
+      size_t length) override;
+  void get_blob_properties(const std::string& blob_name) override;
+  void download_blob_parallel(
+      const std::string& blob_name,
+      uint8_t* buffer,
+      size_t blob_size,
+      size_t chunk_size,
+      int concurrency) override;
+  void upload_blob_parallel(
+      const std::string& blob_name,
+      const uint8_t* buffer,
+      size_t blob_size,
+      size_t chunk_size,
+      int concurrency) override;
+  void stage_blocks(
+      const std::string& blob_name,
+      const uint8_t* buffer,
+      size_t blob_size,
+      size_t block_size,
+      int concurrency) override;
+  void commit_blocks(const std::string& blob_name, size_t num_blocks) override;
+  transport_tuning m_tuning;
   std::shared_ptr<void> m_blob_service_client;
 };
 
 class track2_transport : public transport {
 public:
-  void download_blob(const std::string& blob_name, uint8_t* buffer, size_t blob_size) override;
+  void set_transactional_hash(hash_algorithm hash) override { m_transactional_hash = hash; }
+  void download_blob(const std::string& blob_name, download_sink& sink, size_t blob_size) override;
   void upload_blob(const std::string& blob_name, const uint8_t* buffer, size_t blob_size) override;
+  void download_range(
+      const std::string& blob_name,
+      download_sink& sink,
+      size_t offset,
+      size_t length) override;
+  void get_blob_properties(const std::string& blob_name) override;
+  void download_blob_parallel(
+      const std::string& blob_name,
+      uint8_t* buffer,
+      size_t blob_size,
+      size_t chunk_size,
+      int concurrency) override;
+  void upload_blob_parallel(
+      const std::string& blob_name,
+      const uint8_t* buffer,
+      size_t blob_size,
+      size_t chunk_size,
+      int concurrency) override;
+  void stage_blocks(
+      const std::string& blob_name,
+      const uint8_t* buffer,
+      size_t blob_size,
+      size_t block_size,
+      int concurrency) override;
+  void commit_blocks(const std::string& blob_name, size_t num_blocks) override;
 
 protected:
   track2_transport(std::string name) : transport(std::move(name)) {}
+  // whole_blob downloads without a range where the request can do without one
+  void download(
+      const std::string& blob_name,
+      download_sink& sink,
+      size_t offset,
+      size_t length,
+      bool whole_blob);
+
   std::shared_ptr<void> m_container_client;
+  hash_algorithm m_transactional_hash = hash_algorithm::none;
 };
 
 class track2_curl_transport : public track2_transport {
@@ -52,3 +271,23 @@ public:
 };
 
 #endif
+
+// cpplite, Track2(curl), Track2(WinHTTP) or curl-multi, or a variant of one of them in
+// settings().transport_tunings, returns nullptr for an unknown name
+std::shared_ptr<transport> make_transport(const std::string& name);
+std::vector<std::string> available_transports();
+// the transports run unless the config or --transport names others, curl-multi is opt-in
+std::vector<std::string> default_transports();
+// the transport a variant is made of, curl-multi for curl-multi{nodelay=off}
+std::string base_transport_name(const std::string& name);
+// The knobs of tuning the transport exposes, the others at their defaults. cpplite only sizes its
+// connection pool, Track2's transport options expose none of the knobs, curl-multi exposes all.
+transport_tuning supported_tuning(const std::string& base_name, const transport_tuning& tuning);
+// whether make_transport(name) returns an async_transport
+bool is_async_transport(const std::string& name);
+// whether make_transport(name) supports set_transactional_hash()
+bool supports_transactional_hash(const std::string& name);
+// Whether clients made by make_transport(name) share their connections, so that a new client may
+// reuse a connection an earlier one opened. Track2(curl) keeps libcurl connections in a
+// process-wide pool that can't be turned off.
+bool shares_connections(const std::string& name);
@@ -1,9 +1,5 @@
 #include "utilities.hh"
 
-#ifdef _WIN32
-#include <intrin.h>
-#endif
-
 #include <algorithm>
 #include <atomic>
 #include <cctype>
@@ -18,6 +14,7 @@
 #include <type_traits>
 #include <vector>
 
+#include <azure/core/base64.hpp>
 #include <azure/core/http/curl_transport.hpp>
 #include <azure/core/http/http.hpp>
 #include <azure/storage/blobs.hpp>
@@ -26,51 +23,25 @@
 #include <cryptopp/sha.h>
 #include <curl/curl.h>
 #include <nlohmann/json.hpp>
-#include <spdlog/sinks/base_sink.h>
-
-#include "constants.hh"
-
-namespace {
-
-uint64_t rand_int(uint64_t offset)
-{
-#ifdef _WIN32
-  uint64_t high_part = 0x12e15e35b500f16e;
-  uint64_t low_part = 0x2e714eb2b37916a5;
-  return __umulh(low_part, offset) + high_part * offset;
-#else
-  using uint128_t = __uint128_t;
-  constexpr uint128_t mult = static_cast<uint128_t>(0x12e15e35b500f16e) << 64 | 0x2e714eb2b37916a5;
-  uint128_t product = offset * mult;
-  return product >> 64;
-#endif
-}
-} // namespace
+#include "async_log_sink.hh"
+#include "results.hh"
+#include "settings.hh"
+#include "worker_pool.hh"
 
-void fill_buffer(uint8_t* buffer, size_t size)
-{
-  constexpr size_t int_size = sizeof(uint64_t);
-
-  while (size >= int_size)
-  {
-    *(reinterpret_cast<uint64_t*>(buffer)) = rand_int(size);
-    size -= int_size;
-    buffer += int_size;
-  }
-  if (size)
-  {
-    uint64_t r = rand_int(size);
-    std::memcpy(buffer, &r, size);
-  }
-}
-
-void check_build_environment()
+nlohmann::json check_build_environment()
 {
   spdlog::info("OS: {}", BUILD_OS_VERSION);
   spdlog::info("compiler: {}", BUILD_COMPILER_VERSION);
   spdlog::info("azure-core-cpp version: {}", AZURE_CORE_GIT_VERSION);
   spdlog::info("azure-storage-common-cpp version: {}", AZURE_STORAGE_COMMON_GIT_VERSION);
   spdlog::info("azure-storage-blobs-cpp version: {}", AZURE_STORAGE_BLOBS_GIT_VERSION);
+  return {
+      {"os", BUILD_OS_VERSION},
+      {"compiler", BUILD_COMPILER_VERSION},
+      {"azure_core_version", AZURE_CORE_GIT_VERSION},
+      {"azure_storage_common_version", AZURE_STORAGE_COMMON_GIT_VERSION},
+      {"azure_storage_blobs_version", AZURE_STORAGE_BLOBS_GIT_VERSION},
+  };
 }
 
 bool is_connection_string_valid(const std::string& str)
@@ -92,7 +63,7 @@ bool is_connection_string_valid(const std::string& str)
   return true;
 }
 
-void validate_azure_vm()
+std::string validate_azure_vm()
 {
   try
   {
@@ -121,53 +92,62 @@ void validate_azure_vm()
     auto json_object = nlohmann::json::parse(json_body);
     std::string resource_id = json_object["compute"]["resourceId"];
     spdlog::info("Azure VM resource ID: {}", resource_id);
+    return resource_id;
   }
   catch (std::exception& e)
   {
     spdlog::error("failed to detect Azure VM resource ID");
     spdlog::error(e.what());
   }
+  return std::string();
 }
 
 namespace {
-const std::map<std::string, std::string>& connecetion_string_to_map()
+std::string& current_connection_string()
+{
+  static std::string str(settings().connection_string);
+  return str;
+}
+
+std::map<std::string, std::string> connecetion_string_to_map()
 {
-  static std::map<std::string, std::string> connection_string_map = []() {
-    std::map<std::string, std::string> m;
-    const std::string str(connection_string);
-    std::string::const_iterator cur = str.begin();
+  std::map<std::string, std::string> m;
+  const std::string& str = current_connection_string();
+  std::string::const_iterator cur = str.begin();
 
-    while (cur != str.end())
+  while (cur != str.end())
+  {
+    auto key_begin = cur;
+    auto key_end = std::find(cur, str.end(), '=');
+    std::string key = std::string(key_begin, key_end);
+    cur = key_end;
+    if (cur != str.end())
     {
-      auto key_begin = cur;
-      auto key_end = std::find(cur, str.end(), '=');
-      std::string key = std::string(key_begin, key_end);
-      cur = key_end;
-      if (cur != str.end())
-      {
-        ++cur;
-      }
+      ++cur;
+    }
 
-      auto value_begin = cur;
-      auto value_end = std::find(cur, str.end(), ';');
-      std::string value = std::string(value_begin, value_end);
-      cur = value_end;
-      if (cur != str.end())
-      {
-        ++cur;
-      }
+    auto value_begin = cur;
+    auto value_end = std::find(cur, str.end(), ';');
+    std::string value = std::string(value_begin, value_end);
+    cur = value_end;
+    if (cur != str.end())
+    {
+      ++cur;
+    }
 
-      if (!key.empty() || !value.empty())
-      {
-        m[std::move(key)] = std::move(value);
-      }
+    if (!key.empty() || !value.empty())
+    {
+      m[std::move(key)] = std::move(value);
     }
-    return m;
-  }();
-  return connection_string_map;
+  }
+  return m;
 }
 } // namespace
 
+const std::string& get_connection_string() { return current_connection_string(); }
+
+void set_connection_string(std::string str) { current_connection_string() = std::move(str); }
+
 std::string get_account_name_from_connection_string()
 {
   return connecetion_string_to_map().at("AccountName");
@@ -178,43 +158,154 @@ std::string get_access_key_from_connection_string()
   return connecetion_string_to_map().at("AccountKey");
 }
 
-std::string get_blob_name(size_t blob_size, int index)
+std::string get_blob_endpoint_from_connection_string()
+{
+  auto m = connecetion_string_to_map();
+  auto ite = m.find("BlobEndpoint");
+  if (ite != m.end())
+  {
+    return ite->second;
+  }
+  auto protocol = m.find("DefaultEndpointsProtocol");
+  auto suffix = m.find("EndpointSuffix");
+  return (protocol == m.end() ? std::string("https") : protocol->second) + "://"
+      + m.at("AccountName") + ".blob."
+      + (suffix == m.end() ? std::string("core.windows.net") : suffix->second);
+}
+
+std::string get_blob_name(size_t blob_size, int index, payload_profile payload)
+{
+  const std::string profile = payload == payload_profile::random ? "" : to_string(payload) + "-";
+  return "blob-" + std::to_string(blob_size) + "-" + profile + std::to_string(index);
+}
+
+std::string get_upload_blob_name(size_t blob_size, int index, payload_profile payload)
+{
+  return "upload-" + get_blob_name(blob_size, index, payload);
+}
+
+std::map<std::string, std::string> get_payload_metadata(payload_profile payload)
+{
+  return {{"perftestpayload", to_string(payload) + "-v" + std::to_string(payload_version)}};
+}
+
+std::string get_block_id(int index)
 {
-  return "blob-" + std::to_string(blob_size) + "-" + std::to_string(index);
+  std::string id = std::to_string(index);
+  id = "block-" + std::string(10 - std::min<size_t>(id.length(), 10), '0') + id;
+  return Azure::Core::Convert::Base64Encode(std::vector<uint8_t>(id.begin(), id.end()));
 }
 
-void init_blobs(size_t blob_size, int num_blobs)
+std::string size_to_string(uint64_t size)
+{
+  const char* units[] = {"B", "KB", "MB", "GB", "TB"};
+  size_t unit = 0;
+  while (size >= 1024 && size % 1024 == 0 && unit + 1 < sizeof(units) / sizeof(units[0]))
+  {
+    size /= 1024;
+    ++unit;
+  }
+  return std::to_string(size) + units[unit];
+}
+
+void init_blobs(size_t blob_size, int num_blobs, payload_profile payload)
 {
   using namespace Azure::Storage::Blobs;
 
   BlobClientOptions clientOptions;
   clientOptions.Transport.Transport = std::make_shared<Azure::Core::Http::CurlTransport>();
   auto container_client = BlobContainerClient::CreateFromConnectionString(
-      connection_string, container_name, clientOptions);
+      get_connection_string(), settings().container_name, clientOptions);
   {
     static std::once_flag flag;
     std::call_once(flag, [container_client]() { container_client.CreateIfNotExists(); });
   }
 
-  std::vector<uint8_t> blob_content(blob_size);
-  fill_buffer(blob_content.data(), blob_content.size());
-
   std::mutex m;
   static std::set<std::string> blob_name_set;
 
-  std::vector<int> indices;
+  std::set<std::string> missing;
   for (int i = 0; i < num_blobs; ++i)
   {
-    const std::string blob_name = get_blob_name(blob_size, i);
+    const std::string blob_name = get_blob_name(blob_size, i, payload);
     if (blob_name_set.count(blob_name) == 0)
+    {
+      missing.insert(blob_name);
+    }
+  }
+  if (missing.empty())
+  {
+    return;
+  }
+
+  // Blobs left in the container by earlier runs are reused if they have the expected size and were
+  // uploaded with the same payload, which is recorded in their metadata.
+  const auto payload_metadata = get_payload_metadata(payload);
+  const auto has_payload_metadata = [&](const Azure::Storage::Metadata& metadata) {
+    return std::all_of(
+        payload_metadata.begin(),
+        payload_metadata.end(),
+        [&](const std::pair<const std::string, std::string>& m) {
+          auto ite = metadata.find(m.first);
+          return ite != metadata.end() && ite->second == m.second;
+        });
+  };
+  {
+    ListBlobsOptions options;
+    options.Prefix = "blob-" + std::to_string(blob_size) + "-";
+    options.Include = Models::ListBlobsIncludeFlags::Metadata;
+    for (auto page = container_client.ListBlobs(options); page.HasPage(); page.MoveToNextPage())
+    {
+      for (const auto& item : page.Blobs)
+      {
+        if (item.BlobSize == static_cast<int64_t>(blob_size)
+            && has_payload_metadata(item.Details.Metadata) && missing.erase(item.Name) != 0)
+        {
+          blob_name_set.insert(item.Name);
+        }
+      }
+    }
+  }
+  std::vector<int> indices;
+  for (int i = 0; i < num_blobs; ++i)
+  {
+    if (missing.count(get_blob_name(blob_size, i, payload)) != 0)
     {
       indices.push_back(i);
     }
   }
+  if (indices.empty())
+  {
+    spdlog::debug("{} test blobs of {} are up to date", num_blobs, size_to_string(blob_size));
+    return;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<uint8_t> blob_content(blob_size);
+  fill_payload_parallel(blob_content.data(), blob_content.size(), payload);
+
+  // large blobs are uploaded in blocks by several connections each, about 32 connections in total
+  UploadBlockBlobFromOptions upload_options;
+  upload_options.TransferOptions.SingleUploadThreshold = 8_MB;
+  upload_options.TransferOptions.ChunkSize = 8_MB;
+  upload_options.TransferOptions.Concurrency = blob_size >= 64_MB ? 16 : 1;
+  for (const auto& m : payload_metadata)
+  {
+    upload_options.Metadata[m.first] = m.second;
+  }
 
   std::atomic<int> counter(static_cast<int>(indices.size()));
-  std::vector<std::thread> ths;
-  auto thread_func = [&]() {
+  // unique blobs are stamped in a copy per thread, which bounds the number of threads
+  const bool unique = payload == payload_profile::unique;
+  int num_threads = std::max(32 / upload_options.TransferOptions.Concurrency, 1);
+  if (unique)
+  {
+    num_threads = static_cast<int>(std::max<size_t>(
+        std::min<size_t>(1_GB / blob_size, static_cast<size_t>(num_threads)), 1));
+  }
+  num_threads = std::min(num_threads, static_cast<int>(indices.size()));
+  auto thread_func = [&](int) {
+    std::vector<uint8_t> unique_content;
     while (true)
     {
       int i = counter.fetch_sub(1) - 1;
@@ -223,11 +314,18 @@ void init_blobs(size_t blob_size, int num_blobs)
         break;
       }
       i = indices[i];
-      const std::string blob_name = get_blob_name(blob_size, i);
+      const uint8_t* content = blob_content.data();
+      if (unique)
+      {
+        unique_content = blob_content;
+        stamp_payload(unique_content.data(), unique_content.size(), i);
+        content = unique_content.data();
+      }
+      const std::string blob_name = get_blob_name(blob_size, i, payload);
       auto blob_client = container_client.GetBlockBlobClient(blob_name);
       try
       {
-        blob_client.UploadFrom(blob_content.data(), blob_content.size());
+        blob_client.UploadFrom(content, blob_size, upload_options);
       }
       catch (std::exception&)
       {
@@ -240,107 +338,261 @@ void init_blobs(size_t blob_size, int num_blobs)
       }
     }
   };
-  for (int i = 0; i < 32; ++i)
+  benchmark_worker_pool().run(num_threads, thread_func);
+
+  const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  const uint64_t bytes = static_cast<uint64_t>(blob_size) * indices.size();
+  spdlog::info(
+      "provisioned {} of {} test blobs of {}, {} in {}ms ({:.1f}MB/s)",
+      indices.size(),
+      num_blobs,
+      size_to_string(blob_size),
+      size_to_string(bytes),
+      elapsed.count(),
+      static_cast<double>(bytes) / 1_MB * 1000.0 / std::max<double>(elapsed.count(), 1));
+}
+
+libcurl_raii::libcurl_raii() { curl_global_init(CURL_GLOBAL_DEFAULT); }
+libcurl_raii::~libcurl_raii() { curl_global_cleanup(); }
+
+namespace {
+
+/*
+ * Runs request until it succeeds, up to 5 times with exponential back-off, and rethrows the last
+ * failure. Log blobs are appended to, which isn't idempotent, so a retry is guarded by a condition
+ * that fails if an earlier attempt took effect although it failed, and done_already(e) tells
+ * whether the exception e of a retry is that condition failing.
+ */
+template <class Request, class DoneAlready>
+void retry_log_request(Request request, DoneAlready done_already)
+{
+  constexpr int max_attempts = 5;
+  for (int attempt = 1;; ++attempt)
   {
-    ths.emplace_back(thread_func);
+    try
+    {
+      request();
+      return;
+    }
+    catch (Azure::Storage::StorageException& e)
+    {
+      if (attempt > 1 && done_already(e))
+      {
+        return;
+      }
+      if (attempt == max_attempts)
+      {
+        throw;
+      }
+    }
+    catch (std::exception&)
+    {
+      if (attempt == max_attempts)
+      {
+        throw;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500) * (1 << (attempt - 1)));
   }
-  for (auto& th : ths)
+}
+
+void create_append_blob(
+    const Azure::Storage::Blobs::AppendBlobClient& blob_client,
+    const std::string& content_type)
+{
+  using namespace Azure::Storage::Blobs;
+
+  CreateAppendBlobOptions options;
+  options.HttpHeaders.ContentType = content_type;
+  // creating it again would drop what was appended
+  options.AccessConditions.IfNoneMatch = Azure::ETag::Any();
+  retry_log_request(
+      [&]() { blob_client.Create(options); },
+      [](const Azure::Storage::StorageException& e) { return e.ErrorCode == "BlobAlreadyExists"; });
+}
+
+// the largest block the service appends, and the most blocks an append blob can have
+constexpr size_t max_append_block_size = 4_MB;
+constexpr int64_t max_append_blocks = 50000;
+
+// Appends text at position, the size of the blob, in blocks no larger than the service accepts and
+// advances position by what was appended.
+void append_to_blob(
+    const Azure::Storage::Blobs::AppendBlobClient& blob_client,
+    const std::string& text,
+    int64_t& position)
+{
+  for (size_t offset = 0; offset < text.length();)
   {
-    th.join();
+    const size_t block_size = std::min(text.length() - offset, max_append_block_size);
+    Azure::Storage::Blobs::AppendBlockOptions options;
+    options.AccessConditions.IfAppendPositionEqual = position;
+    retry_log_request(
+        [&]() {
+          Azure::Core::IO::MemoryBodyStream stream(
+              reinterpret_cast<const uint8_t*>(text.data()) + offset, block_size);
+          blob_client.AppendBlock(stream, options);
+        },
+        [&](const Azure::Storage::StorageException& e) {
+          return e.ErrorCode == "AppendPositionConditionNotMet"
+              && blob_client.GetProperties().Value.BlobSize
+              == position + static_cast<int64_t>(block_size);
+        });
+    offset += block_size;
+    position += static_cast<int64_t>(block_size);
   }
 }
 
-libcurl_raii::libcurl_raii() { curl_global_init(CURL_GLOBAL_DEFAULT); }
-libcurl_raii::~libcurl_raii() { curl_global_cleanup(); }
+/*
+ * Append blob <stem><extension> that continues in <stem>.1<extension>, <stem>.2<extension> and so
+ * on, so a long run doesn't run into the block limit of an append blob. A text is appended to a
+ * single part. The first part is created by create() or by the first append().
+ */
+class rolling_append_blob {
+public:
+  rolling_append_blob(
+      const Azure::Storage::Blobs::BlobContainerClient& container_client,
+      std::string stem,
+      std::string extension,
+      std::string content_type)
+      : m_container_client(container_client), m_stem(std::move(stem)),
+        m_extension(std::move(extension)), m_content_type(std::move(content_type)),
+        m_blob_client(m_container_client.GetAppendBlobClient(m_stem + m_extension))
+  {
+  }
 
-template <class Mutex> class azure_storage_sink : public spdlog::sinks::base_sink<Mutex> {
-protected:
-  void sink_it_(const spdlog::details::log_msg& msg) override
+  void create()
   {
-    spdlog::memory_buf_t formatted;
-    spdlog::sinks::base_sink<Mutex>::formatter_->format(msg, formatted);
-    m_buffer += fmt::to_string(formatted);
+    create_append_blob(m_blob_client, m_content_type);
+    m_created = true;
   }
-  void flush_() override {}
 
-private:
-  std::string m_buffer;
+  void append(const std::string& text)
+  {
+    if (text.empty())
+    {
+      return;
+    }
+    if (!m_created)
+    {
+      create();
+    }
+    const auto blocks
+        = static_cast<int64_t>((text.length() + max_append_block_size - 1) / max_append_block_size);
+    if (m_blocks + blocks > max_append_blocks)
+    {
+      ++m_part;
+      m_blob_client = m_container_client.GetAppendBlobClient(
+          m_stem + "." + std::to_string(m_part) + m_extension);
+      m_position = 0;
+      m_blocks = 0;
+      create();
+    }
+    append_to_blob(m_blob_client, text, m_position);
+    m_blocks += blocks;
+  }
 
-  friend struct logger_raii;
+private:
+  Azure::Storage::Blobs::BlobContainerClient m_container_client;
+  std::string m_stem;
+  std::string m_extension;
+  std::string m_content_type;
+  Azure::Storage::Blobs::AppendBlobClient m_blob_client;
+  bool m_created = false;
+  int m_part = 0;
+  // size and number of blocks of the current part
+  int64_t m_position = 0;
+  int64_t m_blocks = 0;
 };
-using azure_storage_sink_mt = azure_storage_sink<std::mutex>;
 
-logger_raii::logger_raii()
+} // namespace
+
+logger_raii::logger_raii(const results_writer* results) : m_results(results)
 {
-  if (!is_connection_string_valid(log_connection_string))
+  using namespace Azure::Storage::Blobs;
+
+  const std::string timestamp = Azure::DateTime(std::chrono::system_clock::now())
+                                    .ToString(
+                                        Azure::DateTime::DateFormat::Rfc3339,
+                                        Azure::DateTime::TimeFractionFormat::Truncate);
+  const std::string hash_hex = [](const std::string& data) {
+    CryptoPP::SHA1 hash;
+    hash.Update(reinterpret_cast<const CryptoPP::byte*>(data.data()), data.length());
+    std::string digest;
+    digest.resize(hash.DigestSize());
+    hash.Final(reinterpret_cast<CryptoPP::byte*>(&digest[0]));
+    CryptoPP::HexEncoder encoder(nullptr, false);
+    encoder.Put(reinterpret_cast<const CryptoPP::byte*>(&digest[0]), digest.length());
+    encoder.MessageEnd();
+    std::string hex;
+    hex.resize(encoder.MaxRetrievable());
+    encoder.Get(reinterpret_cast<CryptoPP::byte*>(&hex[0]), hex.size());
+    return hex;
+  }(timestamp);
+  m_run_id = timestamp + "-" + hash_hex.substr(0, 7);
+  if (!is_connection_string_valid(settings().log_connection_string))
   {
     spdlog::warn(
         "failed to validate log connection string, log won't be uploaded to azure storage");
   }
   else
   {
-    const std::string timestamp = Azure::DateTime(std::chrono::system_clock::now())
-                                      .ToString(
-                                          Azure::DateTime::DateFormat::Rfc3339,
-                                          Azure::DateTime::TimeFractionFormat::Truncate);
-    const std::string hash_hex = [](const std::string& data) {
-      CryptoPP::SHA1 hash;
-      hash.Update(reinterpret_cast<const CryptoPP::byte*>(data.data()), data.length());
-      std::string digest;
-      digest.resize(hash.DigestSize());
-      hash.Final(reinterpret_cast<CryptoPP::byte*>(&digest[0]));
-      CryptoPP::HexEncoder encoder(nullptr, false);
-      encoder.Put(reinterpret_cast<const CryptoPP::byte*>(&digest[0]), digest.length());
-      encoder.MessageEnd();
-      std::string hex;
-      hex.resize(encoder.MaxRetrievable());
-      encoder.Get(reinterpret_cast<CryptoPP::byte*>(&hex[0]), hex.size());
-      return hex;
-    }(timestamp);
-    m_log_filename = timestamp + "-" + hash_hex.substr(0, 7) + ".log";
-
-    auto azure_storage_sink = std::make_shared<azure_storage_sink_mt>();
-    spdlog::default_logger()->sinks().push_back(azure_storage_sink);
+    try
+    {
+      auto blob_container_client = BlobContainerClient::CreateFromConnectionString(
+          settings().log_connection_string, log_container_name);
+      blob_container_client.CreateIfNotExists();
+      rolling_append_blob log_blob(blob_container_client, m_run_id, ".log", "text/plain");
+      log_blob.create();
+      // created with the first results, the report expects a results blob to have a suite record
+      rolling_append_blob results_blob(
+          blob_container_client, m_run_id, ".jsonl", "application/x-ndjson");
+
+      m_sink = std::make_shared<async_log_sink>(
+          [this, log_blob, results_blob](const std::string& text) mutable {
+            if (m_upload_failed)
+            {
+              return;
+            }
+            try
+            {
+              log_blob.append(text);
+              const std::string new_results = m_results
+                  ? m_results->content(m_results_uploaded)
+                  : std::string();
+              results_blob.append(new_results);
+              m_results_uploaded += new_results.length();
+            }
+            catch (std::exception&)
+            {
+              m_upload_failed = true;
+              throw;
+            }
+          },
+          std::chrono::seconds(5));
+      spdlog::default_logger()->sinks().push_back(m_sink);
+    }
+    catch (std::exception& e)
+    {
+      spdlog::error("failed to create log in azure storage, log won't be uploaded");
+      spdlog::error(e.what());
+    }
   }
   spdlog::default_logger()->set_pattern("%+", spdlog::pattern_time_type::utc);
 }
 
 logger_raii::~logger_raii()
 {
-  using namespace Azure::Storage::Blobs;
-
-  if (m_log_filename.empty())
-  {
-    return;
-  }
-  auto azure_storage_sink
-      = std::dynamic_pointer_cast<azure_storage_sink_mt>(spdlog::default_logger()->sinks().back());
-  spdlog::default_logger()->sinks().pop_back();
-
-  if (!should_flush)
+  if (!m_sink)
   {
     return;
   }
-
-  auto blob_container_client
-      = BlobContainerClient::CreateFromConnectionString(log_connection_string, log_container_name);
-  try
+  m_sink->stop();
+  auto& sinks = spdlog::default_logger()->sinks();
+  sinks.erase(std::find(sinks.begin(), sinks.end(), m_sink));
+  if (!m_upload_failed)
   {
-    blob_container_client.CreateIfNotExists();
-    UploadBlockBlobFromOptions options;
-    options.HttpHeaders.ContentType = "text/plain";
-    blob_container_client.GetBlockBlobClient(m_log_filename)
-        .UploadFrom(
-            reinterpret_cast<const uint8_t*>(azure_storage_sink->m_buffer.data()),
-            azure_storage_sink->m_buffer.length(),
-            options);
+    spdlog::info("log has been uploaded to azure storage {}/{}.log", log_container_name, m_run_id);
   }
-  catch (std::exception& e)
-  {
-    spdlog::error("failed to upload log to azure storage");
-    spdlog::error(e.what());
-    return;
-  }
-  azure_storage_sink->m_buffer.clear();
-  spdlog::info("log has been uploaded to azure storage {}/{}", log_container_name, m_log_filename);
-}
\ No newline at end of file
+}
@@ -1,11 +1,16 @@
 #pragma once
 
 #include <cstdint>
+#include <map>
+#include <memory>
 #include <string>
 
+#include <nlohmann/json.hpp>
 #undef SPDLOG_FMT_EXTERNAL
 #include <spdlog/spdlog.h>
 
+#include "payload.hh"
+
 constexpr inline unsigned long long operator""_KB(unsigned long long x) { return x * 1024; }
 constexpr inline unsigned long long operator""_MB(unsigned long long x) { return x * 1024 * 1024; }
 constexpr inline unsigned long long operator""_GB(unsigned long long x)
@@ -13,16 +18,39 @@ constexpr inline unsigned long long operator""_GB(unsigned long long x)
   return x * 1024 * 1024 * 1024;
 }
 
-void fill_buffer(uint8_t* buffer, size_t size);
-
-void check_build_environment();
+// logs the build environment and returns it as {"os", "compiler", "azure_core_version", ...}
+nlohmann::json check_build_environment();
 bool is_connection_string_valid(const std::string& connection_string);
-void validate_azure_vm();
+// returns the resource ID of the Azure VM, empty if it cannot be detected
+std::string validate_azure_vm();
+const std::string& get_connection_string();
+void set_connection_string(std::string connection_string);
 std::string get_account_name_from_connection_string();
 std::string get_access_key_from_connection_string();
+// BlobEndpoint, or the default endpoint derived from AccountName and EndpointSuffix
+std::string get_blob_endpoint_from_connection_string();
 
-std::string get_blob_name(size_t blob_size, int index = 0);
-void init_blobs(size_t blob_size, int num_blobs);
+// blobs of different payload profiles have different names
+std::string get_blob_name(
+    size_t blob_size,
+    int index = 0,
+    payload_profile payload = payload_profile::random);
+// Blobs the upload cases write. They are kept apart from the blobs init_blobs provisions because
+// measured uploads don't carry the payload metadata and would make those look stale.
+std::string get_upload_blob_name(
+    size_t blob_size,
+    int index = 0,
+    payload_profile payload = payload_profile::random);
+// the metadata of blobs init_blobs provisions, blobs without it are provisioned again
+std::map<std::string, std::string> get_payload_metadata(payload_profile payload);
+// Makes sure blobs get_blob_name(blob_size, i, payload) for i in [0, num_blobs) exist. Blobs this
+// process has uploaded, and blobs in the container whose size and payload metadata match, are kept,
+// the others are uploaded. Provisioning throughput is logged.
+void init_blobs(size_t blob_size, int num_blobs, payload_profile payload);
+// base64 encoded block ID, IDs of all blocks in a blob have the same length
+std::string get_block_id(int index);
+// 4194304 -> "4MB"
+std::string size_to_string(uint64_t size);
 
 struct libcurl_raii
 {
@@ -30,13 +58,34 @@ struct libcurl_raii
   ~libcurl_raii();
 };
 
+class async_log_sink;
+class results_writer;
+
+/*
+ * If the log connection string is valid, the log and the results are appended to the append blobs
+ * <run_id>.log and <run_id>.jsonl every few seconds while the benchmark runs, so a run that dies
+ * still leaves what it had logged. Long runs continue them in <run_id>.1.log, <run_id>.1.jsonl and
+ * so on. Logging threads only queue their messages, see async_log_sink.
+ */
 struct logger_raii
 {
   constexpr static const char* log_container_name = "raw-log";
-  logger_raii();
+  // results, if not null, must outlive the instance
+  explicit logger_raii(const results_writer* results = nullptr);
+  logger_raii(const logger_raii&) = delete;
+  logger_raii& operator=(const logger_raii&) = delete;
+  // appends what is left
   ~logger_raii();
-  bool should_flush = false;
+  // "<timestamp>-<hash>"
+  const std::string& run_id() const { return m_run_id; }
 
 private:
-  std::string m_log_filename;
+  std::string m_run_id;
+  const results_writer* m_results;
+  std::shared_ptr<async_log_sink> m_sink;
+  // the rest is only used by the sink's background thread until it stops
+  // bytes of the results appended to the results blobs
+  size_t m_results_uploaded = 0;
+  // set once an append failed after retries, the log is incomplete from there on
+  bool m_upload_failed = false;
 };
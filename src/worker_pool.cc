@@ -0,0 +1,324 @@
+#include "worker_pool.hh"
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+
+#include "settings.hh"
+#include "utilities.hh"
+
+namespace {
+
+void pin_current_thread(int cpu)
+{
+#if defined(_WIN32)
+  if (SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) == 0)
+  {
+    spdlog::warn("failed to pin thread to CPU {}", cpu);
+  }
+#elif defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+  {
+    spdlog::warn("failed to pin thread to CPU {}", cpu);
+  }
+#else
+  (void)cpu;
+#endif
+}
+
+// CPUs the process is allowed to run on, mapped to their NUMA node
+std::map<int, int> get_cpu_nodes()
+{
+  std::map<int, int> cpu_nodes;
+#if defined(_WIN32)
+  DWORD_PTR process_mask = 0;
+  DWORD_PTR system_mask = 0;
+  GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask);
+  for (int cpu = 0; cpu < static_cast<int>(sizeof(DWORD_PTR) * 8); ++cpu)
+  {
+    if (process_mask & (DWORD_PTR(1) << cpu))
+    {
+      UCHAR node = 0;
+      GetNumaProcessorNode(static_cast<UCHAR>(cpu), &node);
+      cpu_nodes[cpu] = node;
+    }
+  }
+#elif defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0)
+  {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+      if (CPU_ISSET(cpu, &set))
+      {
+        cpu_nodes[cpu] = 0;
+      }
+    }
+  }
+  if (DIR* dir = opendir("/sys/devices/system/node"))
+  {
+    while (dirent* entry = readdir(dir))
+    {
+      int node = 0;
+      if (std::sscanf(entry->d_name, "node%d", &node) != 1)
+      {
+        continue;
+      }
+      std::ifstream file(
+          std::string("/sys/devices/system/node/") + entry->d_name + "/cpulist");
+      std::string cpulist;
+      std::getline(file, cpulist);
+      if (cpulist.empty())
+      {
+        continue;
+      }
+      for (int cpu : parse_cpu_list(cpulist))
+      {
+        auto ite = cpu_nodes.find(cpu);
+        if (ite != cpu_nodes.end())
+        {
+          ite->second = node;
+        }
+      }
+    }
+    closedir(dir);
+  }
+#endif
+  return cpu_nodes;
+}
+
+} // namespace
+
+worker_pool::worker_pool(std::vector<int> cpus) : m_cpus(std::move(cpus)) {}
+
+worker_pool::~worker_pool()
+{
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_stopped = true;
+  }
+  m_task_cv.notify_all();
+  for (auto& th : m_threads)
+  {
+    th.join();
+  }
+}
+
+void worker_pool::run(int num_threads, const std::function<void(int)>& func)
+{
+  reserve(num_threads);
+
+  std::unique_lock<std::mutex> guard(m_lock);
+  m_func = &func;
+  m_num_active = num_threads;
+  m_num_pending = num_threads;
+  m_exception = nullptr;
+  ++m_generation;
+  m_task_cv.notify_all();
+  m_done_cv.wait(guard, [this]() { return m_num_pending == 0; });
+  m_func = nullptr;
+  if (m_exception)
+  {
+    std::rethrow_exception(m_exception);
+  }
+}
+
+void worker_pool::reserve(int num_threads)
+{
+  while (static_cast<int>(m_threads.size()) < num_threads)
+  {
+    const int index = static_cast<int>(m_threads.size());
+    m_threads.emplace_back(&worker_pool::worker_loop, this, index);
+  }
+}
+
+void worker_pool::worker_loop(int index)
+{
+  if (!m_cpus.empty())
+  {
+    pin_current_thread(m_cpus[index % m_cpus.size()]);
+  }
+
+  uint64_t generation = 0;
+  std::unique_lock<std::mutex> guard(m_lock);
+  while (true)
+  {
+    m_task_cv.wait(guard, [&]() { return m_stopped || m_generation != generation; });
+    if (m_stopped)
+    {
+      break;
+    }
+    generation = m_generation;
+    if (index >= m_num_active)
+    {
+      continue;
+    }
+    const auto& func = *m_func;
+    guard.unlock();
+    std::exception_ptr exception;
+    try
+    {
+      func(index);
+    }
+    catch (...)
+    {
+      exception = std::current_exception();
+    }
+    guard.lock();
+    if (exception && !m_exception)
+    {
+      m_exception = exception;
+    }
+    if (--m_num_pending == 0)
+    {
+      m_done_cv.notify_one();
+    }
+  }
+}
+
+std::string to_string(affinity_policy affinity)
+{
+  switch (affinity)
+  {
+    case affinity_policy::none:
+      return "none";
+    case affinity_policy::compact:
+      return "compact";
+    case affinity_policy::scatter:
+      return "scatter";
+  }
+  return "unknown";
+}
+
+std::vector<int> parse_cpu_list(const std::string& str)
+{
+  // digits only, std::stoi would accept a sign, leading spaces and trailing garbage
+  auto parse_cpu = [&str](const std::string& s) {
+    if (s.empty() || s.find_first_not_of("0123456789") != std::string::npos || s.length() > 9)
+    {
+      throw std::invalid_argument("invalid CPU list " + str);
+    }
+    return std::stoi(s);
+  };
+  std::vector<int> cpus;
+  size_t pos = 0;
+  while (pos < str.length())
+  {
+    size_t end = str.find(',', pos);
+    if (end == std::string::npos)
+    {
+      end = str.length();
+    }
+    const std::string range = str.substr(pos, end - pos);
+    const size_t dash = range.find('-');
+    const int first = parse_cpu(range.substr(0, dash));
+    const int last = dash == std::string::npos ? first : parse_cpu(range.substr(dash + 1));
+    if (last < first)
+    {
+      throw std::invalid_argument("invalid CPU list " + str);
+    }
+    for (int cpu = first; cpu <= last; ++cpu)
+    {
+      cpus.push_back(cpu);
+    }
+    pos = end + 1;
+  }
+  return cpus;
+}
+
+std::vector<int> get_cpu_order(affinity_policy affinity, const std::vector<int>& cpus)
+{
+  if (affinity == affinity_policy::none)
+  {
+    return {};
+  }
+  std::map<int, std::vector<int>> node_cpus;
+  for (const auto& p : get_cpu_nodes())
+  {
+    if (cpus.empty() || std::find(cpus.begin(), cpus.end(), p.first) != cpus.end())
+    {
+      node_cpus[p.second].push_back(p.first);
+    }
+  }
+
+  std::vector<int> order;
+  if (affinity == affinity_policy::compact)
+  {
+    for (const auto& p : node_cpus)
+    {
+      order.insert(order.end(), p.second.begin(), p.second.end());
+    }
+  }
+  else
+  {
+    for (size_t i = 0;; ++i)
+    {
+      bool added = false;
+      for (const auto& p : node_cpus)
+      {
+        if (i < p.second.size())
+        {
+          order.push_back(p.second[i]);
+          added = true;
+        }
+      }
+      if (!added)
+      {
+        break;
+      }
+    }
+  }
+  return order;
+}
+
+worker_pool& benchmark_worker_pool()
+{
+  static worker_pool pool([]() {
+    auto order = get_cpu_order(settings().cpu_affinity, settings().cpus);
+    if (settings().cpu_affinity != affinity_policy::none)
+    {
+      if (order.empty())
+      {
+        spdlog::warn("CPU affinity isn't supported on this platform, threads aren't pinned");
+      }
+      else
+      {
+        spdlog::info(
+            "workers are pinned to CPUs ({}): {}",
+            to_string(settings().cpu_affinity),
+            std::accumulate(
+                order.begin(), order.end(), std::string(), [](std::string& lhs, int rhs) {
+                  return lhs.empty() ? std::to_string(rhs) : lhs + "," + std::to_string(rhs);
+                }));
+      }
+    }
+    return order;
+  }());
+  return pool;
+}
+
+std::unique_ptr<uint8_t[]> allocate_worker_buffer(size_t size)
+{
+  std::unique_ptr<uint8_t[]> buffer(new uint8_t[size]);
+  if (benchmark_worker_pool().pinned())
+  {
+    std::memset(buffer.get(), 0, size);
+  }
+  return buffer;
+}
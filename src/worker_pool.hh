@@ -0,0 +1,72 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Threads that outlive a single case. Worker k is pinned to cpus[k % cpus.size()] when the list
+ * isn't empty, so a thread id of a case always runs on the same CPU and memory it allocates and
+ * touches first is placed on the NUMA node of that CPU.
+ */
+class worker_pool {
+public:
+  explicit worker_pool(std::vector<int> cpus = {});
+  worker_pool(const worker_pool&) = delete;
+  worker_pool& operator=(const worker_pool&) = delete;
+  ~worker_pool();
+
+  // Runs func(0), ..., func(num_threads - 1) on the first num_threads workers and waits for all of
+  // them, the first exception thrown is rethrown. Workers are created on demand. Must not be called
+  // from a worker.
+  void run(int num_threads, const std::function<void(int)>& func);
+  // Creates workers up to num_threads without running anything on them.
+  void reserve(int num_threads);
+
+  bool pinned() const { return !m_cpus.empty(); }
+
+private:
+  void worker_loop(int index);
+
+  std::vector<int> m_cpus;
+  std::vector<std::thread> m_threads;
+
+  std::mutex m_lock;
+  std::condition_variable m_task_cv;
+  std::condition_variable m_done_cv;
+  const std::function<void(int)>* m_func = nullptr;
+  int m_num_active = 0;
+  int m_num_pending = 0;
+  uint64_t m_generation = 0;
+  bool m_stopped = false;
+  std::exception_ptr m_exception;
+};
+
+enum class affinity_policy
+{
+  none,
+  // fill the CPUs of one NUMA node before moving to the next
+  compact,
+  // round-robin over NUMA nodes
+  scatter,
+};
+
+std::string to_string(affinity_policy affinity);
+// "0-15,32-47" -> {0, 1, ..., 15, 32, ..., 47}, throws std::invalid_argument
+std::vector<int> parse_cpu_list(const std::string& str);
+// CPUs the process may run on in the order workers are pinned to them, cpus restricts the set if
+// not empty. Empty for affinity_policy::none.
+std::vector<int> get_cpu_order(affinity_policy affinity, const std::vector<int>& cpus);
+
+// pool shared by all cases, pinned according to settings()
+worker_pool& benchmark_worker_pool();
+// Memory for a worker's buffer. When benchmark_worker_pool() is pinned its pages are touched by the
+// calling thread, which places them on that thread's NUMA node, otherwise they're left untouched
+// until the transfer writes them.
+std::unique_ptr<uint8_t[]> allocate_worker_buffer(size_t size);
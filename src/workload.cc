@@ -0,0 +1,126 @@
+#include "workload.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <random>
+
+std::string to_string(size_distribution sizes)
+{
+  switch (sizes)
+  {
+    case size_distribution::fixed:
+      return "fixed";
+    case size_distribution::log_normal:
+      return "lognormal";
+    case size_distribution::histogram:
+      return "histogram";
+  }
+  return "unknown";
+}
+
+std::string to_string(key_popularity popularity)
+{
+  switch (popularity)
+  {
+    case key_popularity::uniform:
+      return "uniform";
+    case key_popularity::zipf:
+      return "zipf";
+  }
+  return "unknown";
+}
+
+workload_plan::workload_plan(const mixed_workload& workload, int64_t blob_size, int num_operations)
+{
+  // seeded with the parameters so that every transport runs the same operations
+  std::mt19937_64 g(static_cast<uint64_t>(workload.key_space) * 31 + num_operations);
+
+  std::vector<int64_t> sizes(workload.key_space, blob_size);
+  if (workload.sizes == size_distribution::log_normal)
+  {
+    std::normal_distribution<double> z(0.0, 1.0);
+    for (auto& s : sizes)
+    {
+      const double x = std::max(-3.0, std::min(3.0, z(g)));
+      const double size = static_cast<double>(blob_size) * std::exp(workload.size_sigma * x);
+      s = std::max<int64_t>(1, std::llround(std::exp2(std::round(std::log2(size) * 4.0) / 4.0)));
+    }
+  }
+  else if (workload.sizes == size_distribution::histogram)
+  {
+    std::vector<double> weights;
+    for (const auto& bucket : workload.size_histogram)
+    {
+      weights.push_back(bucket.second);
+    }
+    std::discrete_distribution<size_t> bucket(weights.begin(), weights.end());
+    for (auto& s : sizes)
+    {
+      s = workload.size_histogram[bucket(g)].first;
+    }
+  }
+  m_class_sizes = sizes;
+  std::sort(m_class_sizes.begin(), m_class_sizes.end());
+  m_class_sizes.erase(std::unique(m_class_sizes.begin(), m_class_sizes.end()), m_class_sizes.end());
+  m_class_keys.assign(m_class_sizes.size(), 0);
+  for (auto s : sizes)
+  {
+    const auto size_class = static_cast<uint32_t>(
+        std::lower_bound(m_class_sizes.begin(), m_class_sizes.end(), s) - m_class_sizes.begin());
+    m_keys.push_back({size_class, m_class_keys[size_class]++});
+  }
+
+  // keys are ranked by their number, sizes are drawn independently of popularity
+  std::vector<double> cdf;
+  if (workload.popularity == key_popularity::zipf)
+  {
+    double total = 0.0;
+    for (int r = 0; r < workload.key_space; ++r)
+    {
+      total += 1.0 / std::pow(static_cast<double>(r + 1), workload.zipf_exponent);
+      cdf.push_back(total);
+    }
+  }
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  std::uniform_int_distribution<uint32_t> uniform_key(0, workload.key_space - 1);
+  std::bernoulli_distribution write(1.0 - workload.read_ratio);
+  m_operations.reserve(num_operations);
+  for (int i = 0; i < num_operations; ++i)
+  {
+    uint32_t k;
+    if (cdf.empty())
+    {
+      k = uniform_key(g);
+    }
+    else
+    {
+      k = static_cast<uint32_t>(std::min<size_t>(
+          std::upper_bound(cdf.begin(), cdf.end(), u(g) * cdf.back()) - cdf.begin(),
+          cdf.size() - 1));
+    }
+    m_operations.push_back({write(g), k});
+  }
+}
+
+double workload_plan::share_of_top_keys(double fraction) const
+{
+  if (m_operations.empty())
+  {
+    return 0.0;
+  }
+  std::vector<int> counts(m_keys.size(), 0);
+  for (const auto& op : m_operations)
+  {
+    ++counts[op.key];
+  }
+  std::sort(counts.begin(), counts.end(), std::greater<int>());
+  const size_t top = std::max<size_t>(
+      1, static_cast<size_t>(std::ceil(fraction * static_cast<double>(counts.size()))));
+  int64_t sum = 0;
+  for (size_t i = 0; i < top && i < counts.size(); ++i)
+  {
+    sum += counts[i];
+  }
+  return static_cast<double>(sum) / static_cast<double>(m_operations.size());
+}
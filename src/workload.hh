@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum class size_distribution
+{
+  // every key is transfer_config.blob_size bytes
+  fixed,
+  // the median is transfer_config.blob_size, cut off at 3 standard deviations
+  log_normal,
+  // sizes and weights loaded from a file
+  histogram,
+};
+
+enum class key_popularity
+{
+  uniform,
+  // the key of rank r is picked with a probability proportional to 1 / (r + 1)^zipf_exponent
+  zipf,
+};
+
+std::string to_string(size_distribution sizes);
+std::string to_string(key_popularity popularity);
+
+// Parameters of the mixed case, the key space is provisioned before the case is timed.
+struct mixed_workload
+{
+  // fraction of operations that download, the others upload
+  double read_ratio = 0.9;
+  size_distribution sizes = size_distribution::fixed;
+  // standard deviation of the natural log of the size, log_normal only
+  double size_sigma = 1.0;
+  // histogram only, name is the file name without its extension
+  std::string size_histogram_name;
+  std::vector<std::pair<int64_t, double>> size_histogram;
+  key_popularity popularity = key_popularity::zipf;
+  double zipf_exponent = 0.99;
+  int key_space = 10000;
+};
+
+/*
+ * The keys of a mixed workload and the operations run on them, the same for every transport and
+ * trial. Every key gets a size drawn from the size distribution. Log-normal sizes are rounded to a
+ * quarter-octave grid, so the key space falls into a few dozen size classes at most and key j of a
+ * class is get_blob_name(class size, j), blobs that other cases of that size use too.
+ */
+class workload_plan {
+public:
+  struct key
+  {
+    uint32_t size_class;
+    int index;
+  };
+  struct operation
+  {
+    bool write;
+    uint32_t key;
+  };
+
+  workload_plan(const mixed_workload& workload, int64_t blob_size, int num_operations);
+
+  // ascending
+  const std::vector<int64_t>& class_sizes() const { return m_class_sizes; }
+  const std::vector<int>& class_keys() const { return m_class_keys; }
+  const key& key_of(uint32_t k) const { return m_keys[k]; }
+  int64_t size_of(uint32_t k) const { return m_class_sizes[m_keys[k].size_class]; }
+  const std::vector<operation>& operations() const { return m_operations; }
+  // share of operations on the most popular fraction of keys, e.g. 0.01 for the top 1%
+  double share_of_top_keys(double fraction) const;
+
+private:
+  std::vector<int64_t> m_class_sizes;
+  std::vector<int> m_class_keys;
+  std::vector<key> m_keys;
+  std::vector<operation> m_operations;
+};